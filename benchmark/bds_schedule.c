@@ -0,0 +1,176 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../params.h"
+#include "../xmss_core_fast.h"
+
+/* Measures the cost of choosing the treehash instance for a BDS update,
+   without the hashing that the update itself does. Build with
+   -DBDS_LINEAR_SCAN (see benchmark/bds_schedule_linear) for the scan over
+   all instances, and without it for the schedule heap. */
+
+#define BDS_DECISIONS 1000000
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Applies an update of instance i to the heights and counters, as the BDS
+ * traversal does (without computing any nodes).
+ */
+static void plan_update(bds_state *state, unsigned int i)
+{
+    treehash_inst *treehash = &state->treehash[i];
+    unsigned int nodeheight = 0;
+
+    while (treehash->stackusage > 0 &&
+           state->stacklevels[state->stackoffset - 1] == nodeheight) {
+        nodeheight++;
+        treehash->stackusage--;
+        state->stackoffset--;
+    }
+    if (nodeheight == treehash->h) {
+        treehash->completed = 1;
+    }
+    else {
+        treehash->stackusage++;
+        state->stacklevels[state->stackoffset] = nodeheight;
+        state->stackoffset++;
+        treehash->next_idx++;
+    }
+}
+
+/**
+ * Replays the schedule of the treehash updates over all leaves of a tree,
+ * restarting the instances as the BDS rounds do, and returns the number of
+ * decisions (and their time in *elapsed).
+ */
+static unsigned long long replay(const xmss_params *params, bds_state *state,
+                                 unsigned long long *checksum, double *elapsed)
+{
+    const unsigned int instances = params->tree_height - params->bds_k;
+    unsigned long long decisions = 0;
+    unsigned long leaf, startidx;
+    unsigned int tau, level, i, j;
+    double start = now_ns();
+
+    for (i = 0; i < instances; i++) {
+        state->treehash[i].h = i;
+        state->treehash[i].completed = 1;
+        state->treehash[i].stackusage = 0;
+    }
+    state->stackoffset = 0;
+    bds_treehash_schedule_init(params, state);
+
+    for (leaf = 0; leaf < (1UL << params->tree_height) - 1; leaf++) {
+        for (tau = 0; tau < params->tree_height && ((leaf >> tau) & 1); tau++);
+        for (i = 0; i < tau && i < instances; i++) {
+            startidx = leaf + 1 + 3 * (1UL << i);
+            if (startidx < 1UL << params->tree_height) {
+                state->treehash[i].next_idx = startidx;
+                state->treehash[i].completed = 0;
+                state->treehash[i].stackusage = 0;
+                bds_treehash_reschedule(params, state, i);
+            }
+        }
+        for (j = 0; j < instances >> 1; j++) {
+            level = bds_treehash_select(params, state);
+            if (level == instances) {
+                break;
+            }
+            plan_update(state, level);
+            bds_treehash_reschedule(params, state, level);
+            *checksum += level;
+            decisions++;
+        }
+    }
+    *elapsed = now_ns() - start;
+    return decisions;
+}
+
+static int run(const char *variant)
+{
+    xmss_params params;
+    uint32_t oid;
+    unsigned int instances, level, i, j;
+    unsigned long long checksum = 0, decisions;
+    double start, elapsed;
+
+    if (xmss_str_to_oid(&oid, variant) || xmss_parse_oid(&params, oid)) {
+        printf("Failed to parse OID.\n");
+        return -1;
+    }
+    instances = params.tree_height - params.bds_k;
+    if (instances < 2 || instances > params.tree_height) {
+        printf("Not enough treehash instances.\n");
+        return -1;
+    }
+
+    bds_state state;
+    treehash_inst treehash[instances];
+    unsigned char heap[instances + 1];
+    unsigned char stacklevels[params.tree_height + 1];
+
+    memset(&state, 0, sizeof(state));
+    memset(treehash, 0, sizeof(treehash));
+    state.treehash = treehash;
+    state.heap = heap;
+    state.stacklevels = stacklevels;
+
+    /* A state in which the highest instance is building its node, with one
+       node of every lower height on the stack, and is therefore scheduled;
+       the lowest instance is done, the others are waiting. This is the
+       typical case; more than one instance with nodes on the stack is rare. */
+    for (i = 0; i < instances; i++) {
+        treehash[i].h = i;
+    }
+    treehash[0].completed = 1;
+    treehash[instances - 1].stackusage = instances - 1;
+    for (j = 0; j < instances - 1; j++) {
+        stacklevels[j] = instances - 2 - j;
+    }
+    state.stackoffset = instances - 1;
+    bds_treehash_schedule_init(&params, &state);
+
+    start = now_ns();
+    for (i = 0; i < BDS_DECISIONS; i++) {
+        level = bds_treehash_select(&params, &state);
+        /* The update would change the instance; account for its re-keying. */
+        bds_treehash_reschedule(&params, &state, level);
+        checksum += level;
+    }
+    elapsed = now_ns() - start;
+
+    printf("%-18s %2u instances: %6.1f ns per decision (%llu)\n",
+           variant, instances, elapsed / BDS_DECISIONS, checksum);
+
+    /* The updates of a whole tree, including the restarts; this also counts
+       applying the updates to the heights, which both variants do. */
+    checksum = 0;
+    decisions = replay(&params, &state, &checksum, &elapsed);
+    printf("%-18s whole tree:   %6.1f ns per decision (%llu)\n",
+           variant, elapsed / decisions, checksum);
+    return 0;
+}
+
+int main()
+{
+#ifdef BDS_LINEAR_SCAN
+    printf("Treehash scheduling using a linear scan:\n");
+#else
+    printf("Treehash scheduling using a min-heap:\n");
+#endif
+    if (run("XMSS-SHA2_16_256") || run("XMSS-SHA2_20_256")) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../params.h"
+#include "../xmss.h"
+#include "../xmss_signer.h"
+#include "../randombytes.h"
+
+#define XMSS_SIGNATURES 100
+#define XMSS_MLEN 32
+#define XMSS_VARIANT "XMSS-SHA2_10_256"
+/* Time between two signing requests, in which background work can happen. */
+#define XMSS_IDLE_NS 30000000
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    if (*(const double *)a < *(const double *)b) return -1;
+    if (*(const double *)a > *(const double *)b) return 1;
+    return 0;
+}
+
+/* Signs XMSS_SIGNATURES messages and prints the p50 and p99 latency. */
+static int run(const char *name, const xmss_params *params,
+               const unsigned char *sk, int async, unsigned int precompute,
+               unsigned int threads)
+{
+    struct timespec idle = {0, XMSS_IDLE_NS};
+    double t[XMSS_SIGNATURES];
+    unsigned char m[XMSS_MLEN];
+    unsigned char *sm = malloc(params->sig_bytes + XMSS_MLEN);
+    unsigned long long smlen;
+    xmss_signer *signer;
+    int i;
+
+    signer = xmss_signer_load(params, sk);
+    if (signer == NULL || sm == NULL ||
+        xmss_signer_set_precompute(signer, precompute) ||
+        xmss_signer_set_threads(signer, threads) ||
+        xmss_signer_set_async(signer, async)) {
+        printf("Failed to set up signer.\n");
+        return -1;
+    }
+    xmss_signer_precompute(signer);
+
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        randombytes(m, XMSS_MLEN);
+        nanosleep(&idle, NULL);
+
+        double start = now_us();
+        xmss_signer_sign(signer, sm, &smlen, m, XMSS_MLEN);
+        t[i] = now_us() - start;
+
+        /* Without a background thread, refilling happens between requests. */
+        if (!async) {
+            xmss_signer_precompute(signer);
+        }
+    }
+
+    qsort(t, XMSS_SIGNATURES, sizeof(double), cmp_double);
+    printf("%-28s p50: %9.1f us   p99: %9.1f us\n", name,
+           t[XMSS_SIGNATURES / 2], t[(XMSS_SIGNATURES * 99) / 100]);
+
+    xmss_signer_free(signer);
+    free(sm);
+    return 0;
+}
+
+int main() {
+    xmss_params params;
+    uint32_t oid;
+
+    if (xmss_str_to_oid(&oid, XMSS_VARIANT) || xmss_parse_oid(&params, oid)) {
+        printf("Failed to parse OID.\n");
+        return -1;
+    }
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+
+    printf("Generating %s key pair...\n", XMSS_VARIANT);
+    xmss_keypair(pk, sk, oid);
+
+    printf("Signing latency over %d signatures:\n", XMSS_SIGNATURES);
+    run("synchronous", &params, sk + XMSS_OID_LEN, 0, 0, 1);
+    run("synchronous, 4 threads", &params, sk + XMSS_OID_LEN, 0, 0, 4);
+    run("synchronous, precomputed", &params, sk + XMSS_OID_LEN, 0, 1, 1);
+    run("asynchronous", &params, sk + XMSS_OID_LEN, 1, 0, 1);
+    run("asynchronous, precomputed", &params, sk + XMSS_OID_LEN, 1, 1, 1);
+
+    return 0;
+}
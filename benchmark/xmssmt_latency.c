@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../params.h"
+#include "../xmss.h"
+#include "../xmss_signer.h"
+#include "../randombytes.h"
+
+#define XMSS_MLEN 32
+#define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+
+/* Prints the latency of every signature over the lifetime of one second-layer
+   subtree (i.e. 2^(2h/d) signatures, which includes the boundaries of all
+   bottom trees below it), as CSV with and without latency smoothing:
+
+       index,plain_us,smoothed_us
+
+   The summary lines at the end start with '#', so that the output can be
+   passed to a plotting tool as is. */
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    if (*(const double *)a < *(const double *)b) return -1;
+    if (*(const double *)a > *(const double *)b) return 1;
+    return 0;
+}
+
+static double time_sign(xmss_signer *signer, unsigned char *sm,
+                        const unsigned char *m)
+{
+    unsigned long long smlen;
+    double start = now_us();
+
+    xmss_signer_sign(signer, sm, &smlen, m, XMSS_MLEN);
+    return now_us() - start;
+}
+
+/* Prints the percentiles of t, and the mean latency of the signatures that
+   complete a bottom tree versus all other signatures. */
+static void summary(const char *name, double *t, unsigned int count,
+                    unsigned int tree_height)
+{
+    double boundary = 0, other = 0;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        if (((i + 1) & ((1U << tree_height) - 1)) == 0) {
+            boundary += t[i];
+        }
+        else {
+            other += t[i];
+        }
+    }
+    printf("# %-9s mean at tree boundaries: %9.1f us   elsewhere: %9.1f us\n",
+           name, boundary / (count >> tree_height),
+           other / (count - (count >> tree_height)));
+
+    qsort(t, count, sizeof(double), cmp_double);
+    printf("# %-9s p50: %9.1f us   p99: %9.1f us   p99.9: %9.1f us   max: %9.1f us\n",
+           name, t[count / 2], t[(count * 99) / 100], t[(count * 999) / 1000],
+           t[count - 1]);
+}
+
+int main() {
+    xmss_params params;
+    xmss_signer *plain, *smoothed;
+    unsigned int count, i;
+    uint32_t oid;
+
+    if (xmssmt_str_to_oid(&oid, XMSS_VARIANT) ||
+        xmssmt_parse_oid(&params, oid)) {
+        printf("Failed to parse OID.\n");
+        return -1;
+    }
+    count = 1U << (2 * params.tree_height);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char m[XMSS_MLEN];
+    unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
+    double *t_plain = malloc(count * sizeof(double));
+    double *t_smoothed = malloc(count * sizeof(double));
+
+    printf("# Generating %s key pair...\n", XMSS_VARIANT);
+    xmssmt_keypair(pk, sk, oid);
+
+    /* Both signers start from the same key and sign in lockstep, so that
+       external noise affects both series in the same way. */
+    plain = xmss_signer_load(&params, sk + XMSS_OID_LEN);
+    smoothed = xmss_signer_load(&params, sk + XMSS_OID_LEN);
+    if (plain == NULL || smoothed == NULL || sm == NULL ||
+        t_plain == NULL || t_smoothed == NULL ||
+        xmss_signer_set_smoothing(smoothed, 1)) {
+        printf("Failed to set up signers.\n");
+        return -1;
+    }
+
+    printf("index,plain_us,smoothed_us\n");
+    for (i = 0; i < count; i++) {
+        randombytes(m, XMSS_MLEN);
+        t_plain[i] = time_sign(plain, sm, m);
+        t_smoothed[i] = time_sign(smoothed, sm, m);
+        printf("%u,%.1f,%.1f\n", i, t_plain[i], t_smoothed[i]);
+    }
+
+    summary("plain", t_plain, count, params.tree_height);
+    summary("smoothed", t_smoothed, count, params.tree_height);
+
+    xmss_signer_free(plain);
+    xmss_signer_free(smoothed);
+    free(sm);
+    free(t_plain);
+    free(t_smoothed);
+    return 0;
+}
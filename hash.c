@@ -1,5 +1,7 @@
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
 #include "hash_address.h"
@@ -13,6 +15,17 @@
 #define XMSS_HASH_PADDING_HASH 2
 #define XMSS_HASH_PADDING_PRF 3
 #define XMSS_HASH_PADDING_PRF_KEYGEN 4
+/* Not one of the RFC 8391 / SP 800-208 values; for XMSS_MSG_BATCH_ROOT. */
+#define XMSS_HASH_PADDING_HASH_BATCH 5
+
+/* The routines that are instantiated with constant parameters (see
+   HASH_DISPATCH) have to be inlined into each instance for the constants to
+   take effect, which the compiler would not always do on its own. */
+#ifdef __GNUC__
+    #define HASH_INLINE inline __attribute__((always_inline))
+#else
+    #define HASH_INLINE inline
+#endif
 
 void addr_to_bytes(unsigned char *bytes, const uint32_t addr[8])
 {
@@ -22,7 +35,7 @@ void addr_to_bytes(unsigned char *bytes, const uint32_t addr[8])
     }
 }
 
-static int core_hash(const xmss_params *params,
+static HASH_INLINE int core_hash(const xmss_params *params,
                      unsigned char *out,
                      const unsigned char *in, unsigned long long inlen)
 {
@@ -72,6 +85,81 @@ int prf(const xmss_params *params,
     return core_hash(params, out, buf, params->padding_len + params->n + 32);
 }
 
+/* The SHA-2 state after absorbing toByte(3, padding_len) || PUB_SEED, which
+   is exactly one block for SHA2 with n = 32 or n = 64. All keys and masks of
+   thash_f and thash_h under the same PUB_SEED start with that block, so a
+   holder of a seed context (see params->seed_ctx) resumes from it rather than
+   hashing it again. 'work' is the context that each PRF call finalizes. */
+struct xmss_seed_ctx {
+    unsigned int n;
+    unsigned char pub_seed[64];
+    EVP_MD_CTX *base;
+    EVP_MD_CTX *work;
+};
+
+xmss_seed_ctx *xmss_seed_ctx_create(const xmss_params *params,
+                                    const unsigned char *pub_seed)
+{
+    unsigned char buf[params->padding_len + params->n];
+    xmss_seed_ctx *seed;
+
+    if (params->func != XMSS_SHA2 || params->padding_len != params->n ||
+        (params->n != 32 && params->n != 64)) {
+        return NULL;
+    }
+    seed = calloc(1, sizeof(xmss_seed_ctx));
+    if (seed == NULL) {
+        return NULL;
+    }
+    seed->n = params->n;
+    memcpy(seed->pub_seed, pub_seed, params->n);
+    seed->base = EVP_MD_CTX_new();
+    seed->work = EVP_MD_CTX_new();
+
+    ull_to_bytes(buf, params->padding_len, XMSS_HASH_PADDING_PRF);
+    memcpy(buf + params->padding_len, pub_seed, params->n);
+    if (seed->base == NULL || seed->work == NULL ||
+        !EVP_DigestInit_ex(seed->base,
+                           params->n == 32 ? EVP_sha256() : EVP_sha512(),
+                           NULL) ||
+        !EVP_DigestUpdate(seed->base, buf, sizeof(buf))) {
+        xmss_seed_ctx_free(seed);
+        return NULL;
+    }
+    return seed;
+}
+
+void xmss_seed_ctx_free(xmss_seed_ctx *seed)
+{
+    if (seed == NULL) {
+        return;
+    }
+    EVP_MD_CTX_free(seed->base);
+    EVP_MD_CTX_free(seed->work);
+    free(seed);
+}
+
+/*
+ * Computes PRF(pub_seed, in) as prf does, resuming from the midstate in seed
+ * if there is one, and it is that of pub_seed.
+ */
+static HASH_INLINE int prf_seeded(const xmss_params *params,
+                                  xmss_seed_ctx *seed,
+                                  unsigned char *out, const unsigned char in[32],
+                                  const unsigned char *pub_seed)
+{
+    if (seed == NULL || seed->n != params->n ||
+        memcmp(seed->pub_seed, pub_seed, params->n)) {
+        return prf(params, out, in, pub_seed);
+    }
+    if (!EVP_MD_CTX_copy_ex(seed->work, seed->base) ||
+        !EVP_DigestUpdate(seed->work, in, 32) ||
+        !EVP_DigestFinal_ex(seed->work, out, NULL)) {
+        return -1;
+    }
+    return 0;
+}
+
 /*
  * Computes PRF_keygen(key, in), for a key of params->n bytes, and an input
  * of 32 + params->n bytes
@@ -103,7 +191,9 @@ int hash_message(const xmss_params *params, unsigned char *out,
 {
     /* We're creating a hash using input of the form:
        toByte(X, 32) || R || root || index || M */
-    ull_to_bytes(m_with_prefix, params->padding_len, XMSS_HASH_PADDING_HASH);
+    ull_to_bytes(m_with_prefix, params->padding_len,
+                 params->msg_domain == XMSS_MSG_BATCH_ROOT ?
+                 XMSS_HASH_PADDING_HASH_BATCH : XMSS_HASH_PADDING_HASH);
     memcpy(m_with_prefix + params->padding_len, R, params->n);
     memcpy(m_with_prefix + params->padding_len + params->n, root, params->n);
     ull_to_bytes(m_with_prefix + params->padding_len + 2*params->n, params->n, idx);
@@ -111,12 +201,42 @@ int hash_message(const xmss_params *params, unsigned char *out,
     return core_hash(params, out, m_with_prefix, mlen + params->padding_len + 3*params->n);
 }
 
+/* The parameters that the hash routines depend on (func, n and padding_len)
+   for each of the specialized instances. The public routines below pass these
+   rather than the caller's params to the inline routines that implement them,
+   so that the compiler sees constant sizes in every buffer, copy and loop. */
+static const xmss_params impl_sha2_256 = {
+    .func = XMSS_SHA2, .n = 32, .padding_len = 32
+};
+static const xmss_params impl_shake128_256 = {
+    .func = XMSS_SHAKE128, .n = 32, .padding_len = 32
+};
+static const xmss_params impl_shake256_256 = {
+    .func = XMSS_SHAKE256, .n = 32, .padding_len = 32
+};
+
+/* Returns fn called with the instance that params selects, the seed context
+   of params (which the instances do not carry), and the rest of the
+   arguments. */
+#define HASH_DISPATCH(fn, params, ...) \
+    switch ((params)->impl) { \
+        case XMSS_IMPL_SHA2_256: \
+            return fn(&impl_sha2_256, (params)->seed_ctx, __VA_ARGS__); \
+        case XMSS_IMPL_SHAKE128_256: \
+            return fn(&impl_shake128_256, (params)->seed_ctx, __VA_ARGS__); \
+        case XMSS_IMPL_SHAKE256_256: \
+            return fn(&impl_shake256_256, (params)->seed_ctx, __VA_ARGS__); \
+        default: \
+            return fn(params, (params)->seed_ctx, __VA_ARGS__); \
+    }
+
 /**
  * We assume the left half is in in[0]...in[n-1]
  */
-int thash_h(const xmss_params *params,
-            unsigned char *out, const unsigned char *in,
-            const unsigned char *pub_seed, uint32_t addr[8])
+static HASH_INLINE int thash_h_impl(const xmss_params *params,
+                               xmss_seed_ctx *seed,
+                               unsigned char *out, const unsigned char *in,
+                               const unsigned char *pub_seed, uint32_t addr[8])
 {
     unsigned char buf[params->padding_len + 3 * params->n];
     unsigned char bitmask[2 * params->n];
@@ -129,16 +249,16 @@ int thash_h(const xmss_params *params,
     /* Generate the n-byte key. */
     set_key_and_mask(addr, 0);
     addr_to_bytes(addr_as_bytes, addr);
-    prf(params, buf + params->padding_len, addr_as_bytes, pub_seed);
+    prf_seeded(params, seed, buf + params->padding_len, addr_as_bytes, pub_seed);
 
     /* Generate the 2n-byte mask. */
     set_key_and_mask(addr, 1);
     addr_to_bytes(addr_as_bytes, addr);
-    prf(params, bitmask, addr_as_bytes, pub_seed);
+    prf_seeded(params, seed, bitmask, addr_as_bytes, pub_seed);
 
     set_key_and_mask(addr, 2);
     addr_to_bytes(addr_as_bytes, addr);
-    prf(params, bitmask + params->n, addr_as_bytes, pub_seed);
+    prf_seeded(params, seed, bitmask + params->n, addr_as_bytes, pub_seed);
 
     for (i = 0; i < 2 * params->n; i++) {
         buf[params->padding_len + params->n + i] = in[i] ^ bitmask[i];
@@ -146,9 +266,51 @@ int thash_h(const xmss_params *params,
     return core_hash(params, out, buf, params->padding_len + 3 * params->n);
 }
 
-int thash_f(const xmss_params *params,
+int thash_h(const xmss_params *params,
             unsigned char *out, const unsigned char *in,
             const unsigned char *pub_seed, uint32_t addr[8])
+{
+    HASH_DISPATCH(thash_h_impl, params, out, in, pub_seed, addr);
+}
+
+/*
+ * Hashes 'count' consecutive pairs of nodes on the same level; pair i is at
+ * in + 2*i*n, is written to out + i*n, and has tree index t + i, where t is
+ * the tree index in addr. out may equal in. This is the entry point for a
+ * hash backend that processes several pairs at once; here they are hashed
+ * one after another. addr is left at the index of the last pair.
+ */
+static HASH_INLINE int thash_h_batch_impl(const xmss_params *params,
+                                     xmss_seed_ctx *seed,
+                                     unsigned char *out,
+                                     const unsigned char *in,
+                                     unsigned int count,
+                                     const unsigned char *pub_seed,
+                                     uint32_t addr[8])
+{
+    const uint32_t first = addr[6];
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        set_tree_index(addr, first + i);
+        thash_h_impl(params, seed, out + i*params->n, in + 2*i*params->n,
+                     pub_seed, addr);
+    }
+    return 0;
+}
+
+int thash_h_batch(const xmss_params *params,
+                  unsigned char *out, const unsigned char *in,
+                  unsigned int count,
+                  const unsigned char *pub_seed, uint32_t addr[8])
+{
+    HASH_DISPATCH(thash_h_batch_impl, params, out, in, count, pub_seed, addr);
+}
+
+static HASH_INLINE int thash_f_impl(const xmss_params *params,
+                               xmss_seed_ctx *seed,
+                               unsigned char *out, const unsigned char *in,
+                               const unsigned char *pub_seed, uint32_t addr[8])
 {
     unsigned char buf[params->padding_len + 2 * params->n];
     unsigned char bitmask[params->n];
@@ -161,15 +323,22 @@ int thash_f(const xmss_params *params,
     /* Generate the n-byte key. */
     set_key_and_mask(addr, 0);
     addr_to_bytes(addr_as_bytes, addr);
-    prf(params, buf + params->padding_len, addr_as_bytes, pub_seed);
+    prf_seeded(params, seed, buf + params->padding_len, addr_as_bytes, pub_seed);
 
     /* Generate the n-byte mask. */
     set_key_and_mask(addr, 1);
     addr_to_bytes(addr_as_bytes, addr);
-    prf(params, bitmask, addr_as_bytes, pub_seed);
+    prf_seeded(params, seed, bitmask, addr_as_bytes, pub_seed);
 
     for (i = 0; i < params->n; i++) {
         buf[params->padding_len + params->n + i] = in[i] ^ bitmask[i];
     }
     return core_hash(params, out, buf, params->padding_len + 2 * params->n);
 }
+
+int thash_f(const xmss_params *params,
+            unsigned char *out, const unsigned char *in,
+            const unsigned char *pub_seed, uint32_t addr[8])
+{
+    HASH_DISPATCH(thash_f_impl, params, out, in, pub_seed, addr);
+}
@@ -4,6 +4,25 @@
 #include <stdint.h>
 #include "params.h"
 
+/* The hash state after absorbing the PRF prefix and a PUB_SEED, from which
+   the keys and masks of thash_f and thash_h under that PUB_SEED are
+   computed. It is used through params->seed_ctx, and only for SHA2 with
+   n = 32 or n = 64. A seed context is not thread-safe: it must not be used
+   by two hash calls at once. */
+typedef struct xmss_seed_ctx xmss_seed_ctx;
+
+/**
+ * Creates the seed context of pub_seed. Returns NULL if the parameters do
+ * not allow one or memory could not be allocated; hashing works without it.
+ */
+xmss_seed_ctx *xmss_seed_ctx_create(const xmss_params *params,
+                                    const unsigned char *pub_seed);
+
+/**
+ * Releases a seed context; does nothing if seed is NULL.
+ */
+void xmss_seed_ctx_free(xmss_seed_ctx *seed);
+
 void addr_to_bytes(unsigned char *bytes, const uint32_t addr[8]);
 
 int prf(const xmss_params *params,
@@ -23,6 +42,11 @@ int thash_h(const xmss_params *params,
             unsigned char *out, const unsigned char *in,
             const unsigned char *pub_seed, uint32_t addr[8]);
 
+int thash_h_batch(const xmss_params *params,
+                  unsigned char *out, const unsigned char *in,
+                  unsigned int count,
+                  const unsigned char *pub_seed, uint32_t addr[8]);
+
 int thash_f(const xmss_params *params,
             unsigned char *out, const unsigned char *in,
             const unsigned char *pub_seed, uint32_t addr[8]);
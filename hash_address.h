@@ -6,6 +6,8 @@
 #define XMSS_ADDR_TYPE_OTS 0
 #define XMSS_ADDR_TYPE_LTREE 1
 #define XMSS_ADDR_TYPE_HASHTREE 2
+/* Not part of RFC 8391; used for the message trees of batch signatures. */
+#define XMSS_ADDR_TYPE_BATCH 3
 
 void set_layer_addr(uint32_t addr[8], uint32_t layer);
 
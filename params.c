@@ -4,368 +4,140 @@
 #include "params.h"
 #include "xmss_core.h"
 
-int xmss_str_to_oid(uint32_t *oid, const char *s)
-{
-    if (!strcmp(s, "XMSS-SHA2_10_256")) {
-        *oid = 0x00000001;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_16_256")) {
-        *oid = 0x00000002;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_20_256")) {
-        *oid = 0x00000003;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_10_512")) {
-        *oid = 0x00000004;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_16_512")) {
-        *oid = 0x00000005;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_20_512")) {
-        *oid = 0x00000006;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE_10_256")) {
-        *oid = 0x00000007;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE_16_256")) {
-        *oid = 0x00000008;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE_20_256")) {
-        *oid = 0x00000009;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE_10_512")) {
-        *oid = 0x0000000a;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE_16_512")) {
-        *oid = 0x0000000b;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE_20_512")) {
-        *oid = 0x0000000c;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_10_192")) {
-        *oid = 0x0000000d;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_16_192")) {
-        *oid = 0x0000000e;
-    }
-    else if (!strcmp(s, "XMSS-SHA2_20_192")) {
-        *oid = 0x0000000f;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE256_10_256")) {
-        *oid = 0x00000010;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE256_16_256")) {
-        *oid = 0x00000011;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE256_20_256")) {
-        *oid = 0x00000012;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE256_10_192")) {
-        *oid = 0x00000013;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE256_16_192")) {
-        *oid = 0x00000014;
-    }
-    else if (!strcmp(s, "XMSS-SHAKE256_20_192")) {
-        *oid = 0x00000015;
-    }
-    else {
-        return -1;
-    }
-    return 0;
-}
+/* A parameter set of the draft. The OID of the set is its position in the
+   table plus one, so that parsing an OID is a single lookup. */
+typedef struct {
+    const char *name;
+    unsigned int func;
+    unsigned int n;
+    unsigned int padding_len;
+    unsigned int full_height;
+    unsigned int d;
+} xmss_oid_entry;
+
+static const xmss_oid_entry xmss_oids[] = {
+    {"XMSS-SHA2_10_256",     XMSS_SHA2,      32, 32, 10,  1},
+    {"XMSS-SHA2_16_256",     XMSS_SHA2,      32, 32, 16,  1},
+    {"XMSS-SHA2_20_256",     XMSS_SHA2,      32, 32, 20,  1},
+    {"XMSS-SHA2_10_512",     XMSS_SHA2,      64, 64, 10,  1},
+    {"XMSS-SHA2_16_512",     XMSS_SHA2,      64, 64, 16,  1},
+    {"XMSS-SHA2_20_512",     XMSS_SHA2,      64, 64, 20,  1},
+    {"XMSS-SHAKE_10_256",    XMSS_SHAKE128,  32, 32, 10,  1},
+    {"XMSS-SHAKE_16_256",    XMSS_SHAKE128,  32, 32, 16,  1},
+    {"XMSS-SHAKE_20_256",    XMSS_SHAKE128,  32, 32, 20,  1},
+    {"XMSS-SHAKE_10_512",    XMSS_SHAKE256,  64, 64, 10,  1},
+    {"XMSS-SHAKE_16_512",    XMSS_SHAKE256,  64, 64, 16,  1},
+    {"XMSS-SHAKE_20_512",    XMSS_SHAKE256,  64, 64, 20,  1},
+    {"XMSS-SHA2_10_192",     XMSS_SHA2,      24,  4, 10,  1},
+    {"XMSS-SHA2_16_192",     XMSS_SHA2,      24,  4, 16,  1},
+    {"XMSS-SHA2_20_192",     XMSS_SHA2,      24,  4, 20,  1},
+    {"XMSS-SHAKE256_10_256", XMSS_SHAKE256,  32, 32, 10,  1},
+    {"XMSS-SHAKE256_16_256", XMSS_SHAKE256,  32, 32, 16,  1},
+    {"XMSS-SHAKE256_20_256", XMSS_SHAKE256,  32, 32, 20,  1},
+    {"XMSS-SHAKE256_10_192", XMSS_SHAKE256,  24,  4, 10,  1},
+    {"XMSS-SHAKE256_16_192", XMSS_SHAKE256,  24,  4, 16,  1},
+    {"XMSS-SHAKE256_20_192", XMSS_SHAKE256,  24,  4, 20,  1},
+};
+
+static const xmss_oid_entry xmssmt_oids[] = {
+    {"XMSSMT-SHA2_20/2_256",      XMSS_SHA2,      32, 32, 20,  2},
+    {"XMSSMT-SHA2_20/4_256",      XMSS_SHA2,      32, 32, 20,  4},
+    {"XMSSMT-SHA2_40/2_256",      XMSS_SHA2,      32, 32, 40,  2},
+    {"XMSSMT-SHA2_40/4_256",      XMSS_SHA2,      32, 32, 40,  4},
+    {"XMSSMT-SHA2_40/8_256",      XMSS_SHA2,      32, 32, 40,  8},
+    {"XMSSMT-SHA2_60/3_256",      XMSS_SHA2,      32, 32, 60,  3},
+    {"XMSSMT-SHA2_60/6_256",      XMSS_SHA2,      32, 32, 60,  6},
+    {"XMSSMT-SHA2_60/12_256",     XMSS_SHA2,      32, 32, 60, 12},
+    {"XMSSMT-SHA2_20/2_512",      XMSS_SHA2,      64, 64, 20,  2},
+    {"XMSSMT-SHA2_20/4_512",      XMSS_SHA2,      64, 64, 20,  4},
+    {"XMSSMT-SHA2_40/2_512",      XMSS_SHA2,      64, 64, 40,  2},
+    {"XMSSMT-SHA2_40/4_512",      XMSS_SHA2,      64, 64, 40,  4},
+    {"XMSSMT-SHA2_40/8_512",      XMSS_SHA2,      64, 64, 40,  8},
+    {"XMSSMT-SHA2_60/3_512",      XMSS_SHA2,      64, 64, 60,  3},
+    {"XMSSMT-SHA2_60/6_512",      XMSS_SHA2,      64, 64, 60,  6},
+    {"XMSSMT-SHA2_60/12_512",     XMSS_SHA2,      64, 64, 60, 12},
+    {"XMSSMT-SHAKE_20/2_256",     XMSS_SHAKE128,  32, 32, 20,  2},
+    {"XMSSMT-SHAKE_20/4_256",     XMSS_SHAKE128,  32, 32, 20,  4},
+    {"XMSSMT-SHAKE_40/2_256",     XMSS_SHAKE128,  32, 32, 40,  2},
+    {"XMSSMT-SHAKE_40/4_256",     XMSS_SHAKE128,  32, 32, 40,  4},
+    {"XMSSMT-SHAKE_40/8_256",     XMSS_SHAKE128,  32, 32, 40,  8},
+    {"XMSSMT-SHAKE_60/3_256",     XMSS_SHAKE128,  32, 32, 60,  3},
+    {"XMSSMT-SHAKE_60/6_256",     XMSS_SHAKE128,  32, 32, 60,  6},
+    {"XMSSMT-SHAKE_60/12_256",    XMSS_SHAKE128,  32, 32, 60, 12},
+    {"XMSSMT-SHAKE_20/2_512",     XMSS_SHAKE256,  64, 64, 20,  2},
+    {"XMSSMT-SHAKE_20/4_512",     XMSS_SHAKE256,  64, 64, 20,  4},
+    {"XMSSMT-SHAKE_40/2_512",     XMSS_SHAKE256,  64, 64, 40,  2},
+    {"XMSSMT-SHAKE_40/4_512",     XMSS_SHAKE256,  64, 64, 40,  4},
+    {"XMSSMT-SHAKE_40/8_512",     XMSS_SHAKE256,  64, 64, 40,  8},
+    {"XMSSMT-SHAKE_60/3_512",     XMSS_SHAKE256,  64, 64, 60,  3},
+    {"XMSSMT-SHAKE_60/6_512",     XMSS_SHAKE256,  64, 64, 60,  6},
+    {"XMSSMT-SHAKE_60/12_512",    XMSS_SHAKE256,  64, 64, 60, 12},
+    {"XMSSMT-SHA2_20/2_192",      XMSS_SHA2,      24,  4, 20,  2},
+    {"XMSSMT-SHA2_20/4_192",      XMSS_SHA2,      24,  4, 20,  4},
+    {"XMSSMT-SHA2_40/2_192",      XMSS_SHA2,      24,  4, 40,  2},
+    {"XMSSMT-SHA2_40/4_192",      XMSS_SHA2,      24,  4, 40,  4},
+    {"XMSSMT-SHA2_40/8_192",      XMSS_SHA2,      24,  4, 40,  8},
+    {"XMSSMT-SHA2_60/3_192",      XMSS_SHA2,      24,  4, 60,  3},
+    {"XMSSMT-SHA2_60/6_192",      XMSS_SHA2,      24,  4, 60,  6},
+    {"XMSSMT-SHA2_60/12_192",     XMSS_SHA2,      24,  4, 60, 12},
+    {"XMSSMT-SHAKE256_20/2_256",  XMSS_SHAKE256,  32, 32, 20,  2},
+    {"XMSSMT-SHAKE256_20/4_256",  XMSS_SHAKE256,  32, 32, 20,  4},
+    {"XMSSMT-SHAKE256_40/2_256",  XMSS_SHAKE256,  32, 32, 40,  2},
+    {"XMSSMT-SHAKE256_40/4_256",  XMSS_SHAKE256,  32, 32, 40,  4},
+    {"XMSSMT-SHAKE256_40/8_256",  XMSS_SHAKE256,  32, 32, 40,  8},
+    {"XMSSMT-SHAKE256_60/3_256",  XMSS_SHAKE256,  32, 32, 60,  3},
+    {"XMSSMT-SHAKE256_60/6_256",  XMSS_SHAKE256,  32, 32, 60,  6},
+    {"XMSSMT-SHAKE256_60/12_256", XMSS_SHAKE256,  32, 32, 60, 12},
+    {"XMSSMT-SHAKE256_20/2_192",  XMSS_SHAKE256,  24,  4, 20,  2},
+    {"XMSSMT-SHAKE256_20/4_192",  XMSS_SHAKE256,  24,  4, 20,  4},
+    {"XMSSMT-SHAKE256_40/2_192",  XMSS_SHAKE256,  24,  4, 40,  2},
+    {"XMSSMT-SHAKE256_40/4_192",  XMSS_SHAKE256,  24,  4, 40,  4},
+    {"XMSSMT-SHAKE256_40/8_192",  XMSS_SHAKE256,  24,  4, 40,  8},
+    {"XMSSMT-SHAKE256_60/3_192",  XMSS_SHAKE256,  24,  4, 60,  3},
+    {"XMSSMT-SHAKE256_60/6_192",  XMSS_SHAKE256,  24,  4, 60,  6},
+    {"XMSSMT-SHAKE256_60/12_192", XMSS_SHAKE256,  24,  4, 60, 12},
+};
+
+#define XMSS_OID_COUNT (sizeof(xmss_oids) / sizeof(xmss_oids[0]))
+#define XMSSMT_OID_COUNT (sizeof(xmssmt_oids) / sizeof(xmssmt_oids[0]))
 
-int xmssmt_str_to_oid(uint32_t *oid, const char *s)
+/**
+ * Looks up the name s in a table of count entries.
+ * Returns -1 when the parameter set is not found, 0 otherwise.
+ */
+static int oid_lookup(uint32_t *oid, const char *s,
+                      const xmss_oid_entry *table, unsigned int count)
 {
-    if (!strcmp(s, "XMSSMT-SHA2_20/2_256")) {
-        *oid = 0x00000001;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_20/4_256")) {
-        *oid = 0x00000002;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/2_256")) {
-        *oid = 0x00000003;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/4_256")) {
-        *oid = 0x00000004;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/8_256")) {
-        *oid = 0x00000005;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/3_256")) {
-        *oid = 0x00000006;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/6_256")) {
-        *oid = 0x00000007;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/12_256")) {
-        *oid = 0x00000008;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_20/2_512")) {
-        *oid = 0x00000009;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_20/4_512")) {
-        *oid = 0x0000000a;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/2_512")) {
-        *oid = 0x0000000b;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/4_512")) {
-        *oid = 0x0000000c;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/8_512")) {
-        *oid = 0x0000000d;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/3_512")) {
-        *oid = 0x0000000e;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/6_512")) {
-        *oid = 0x0000000f;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/12_512")) {
-        *oid = 0x00000010;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_20/2_256")) {
-        *oid = 0x00000011;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_20/4_256")) {
-        *oid = 0x00000012;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_40/2_256")) {
-        *oid = 0x00000013;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_40/4_256")) {
-        *oid = 0x00000014;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_40/8_256")) {
-        *oid = 0x00000015;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_60/3_256")) {
-        *oid = 0x00000016;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_60/6_256")) {
-        *oid = 0x00000017;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_60/12_256")) {
-        *oid = 0x00000018;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_20/2_512")) {
-        *oid = 0x00000019;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_20/4_512")) {
-        *oid = 0x0000001a;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_40/2_512")) {
-        *oid = 0x0000001b;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_40/4_512")) {
-        *oid = 0x0000001c;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_40/8_512")) {
-        *oid = 0x0000001d;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_60/3_512")) {
-        *oid = 0x0000001e;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_60/6_512")) {
-        *oid = 0x0000001f;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE_60/12_512")) {
-        *oid = 0x00000020;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_20/2_192")) {
-        *oid = 0x00000021;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_20/4_192")) {
-        *oid = 0x00000022;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/2_192")) {
-        *oid = 0x00000023;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/4_192")) {
-        *oid = 0x00000024;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_40/8_192")) {
-        *oid = 0x00000025;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/3_192")) {
-        *oid = 0x00000026;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/6_192")) {
-        *oid = 0x00000027;
-    }
-    else if (!strcmp(s, "XMSSMT-SHA2_60/12_192")) {
-        *oid = 0x00000028;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_20/2_256")) {
-        *oid = 0x00000029;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_20/4_256")) {
-        *oid = 0x0000002a;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_40/2_256")) {
-        *oid = 0x0000002b;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_40/4_256")) {
-        *oid = 0x0000002c;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_40/8_256")) {
-        *oid = 0x0000002d;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_60/3_256")) {
-        *oid = 0x0000002e;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_60/6_256")) {
-        *oid = 0x0000002f;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_60/12_256")) {
-        *oid = 0x00000030;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_20/2_192")) {
-        *oid = 0x00000031;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_20/4_192")) {
-        *oid = 0x00000032;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_40/2_192")) {
-        *oid = 0x00000033;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_40/4_192")) {
-        *oid = 0x00000034;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_40/8_192")) {
-        *oid = 0x00000035;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_60/3_192")) {
-        *oid = 0x00000036;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_60/6_192")) {
-        *oid = 0x00000037;
-    }
-    else if (!strcmp(s, "XMSSMT-SHAKE256_60/12_192")) {
-        *oid = 0x00000038;
-    }
-    else {
-        return -1;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        if (!strcmp(s, table[i].name)) {
+            *oid = i + 1;
+            return 0;
+        }
     }
-    return 0;
+    return -1;
 }
 
-int xmss_parse_oid(xmss_params *params, const uint32_t oid)
+/**
+ * Configures params according to the entry of the OID in a table of count
+ * entries. Returns -1 when the OID is not found, 0 otherwise.
+ */
+static int oid_parse(xmss_params *params, const uint32_t oid,
+                     const xmss_oid_entry *table, unsigned int count)
 {
-    switch (oid) {
-        case 0x00000001:
-        case 0x00000002:
-        case 0x00000003:
-        case 0x00000004:
-        case 0x00000005:
-        case 0x00000006:
-
-        case 0x0000000d:
-        case 0x0000000e:
-        case 0x0000000f:
-            params->func = XMSS_SHA2;
-            break;
-
-        case 0x00000007:
-        case 0x00000008:
-        case 0x00000009:
-            params->func = XMSS_SHAKE128;
-            break;
-
-        case 0x0000000a:
-        case 0x0000000b:
-        case 0x0000000c:
-
-        case 0x00000010:
-        case 0x00000011:
-        case 0x00000012:
-        case 0x00000013:
-        case 0x00000014:
-        case 0x00000015:
-            params->func = XMSS_SHAKE256;
-            break;
-
-        default:
-            return -1;
-    }
-    switch (oid) {
-        case 0x0000000d:
-        case 0x0000000e:
-        case 0x0000000f:
-
-        case 0x00000013:
-        case 0x00000014:
-        case 0x00000015:
-            params->n = 24;
-            params->padding_len = 4;
-            break;
-
-        case 0x00000001:
-        case 0x00000002:
-        case 0x00000003:
-
-        case 0x00000007:
-        case 0x00000008:
-        case 0x00000009:
-
-        case 0x00000010:
-        case 0x00000011:
-        case 0x00000012:
-            params->n = 32;
-            params->padding_len = 32;
-            break;
-
-        case 0x00000004:
-        case 0x00000005:
-        case 0x00000006:
-
-        case 0x0000000a:
-        case 0x0000000b:
-        case 0x0000000c:
-            params->n = 64;
-            params->padding_len = 64;
-            break;
-
-        default:
-            return -1;
-    }
-    switch (oid) {
-        case 0x00000001:
-        case 0x00000004:
-        case 0x00000007:
-        case 0x0000000a:
-        case 0x0000000d:
-        case 0x00000010:
-        case 0x00000013:
-            params->full_height = 10;
-            break;
+    const xmss_oid_entry *entry;
 
-        case 0x00000002:
-        case 0x00000005:
-        case 0x00000008:
-        case 0x0000000b:
-        case 0x0000000e:
-        case 0x00000011:
-        case 0x00000014:
-            params->full_height = 16;
-            break;
-
-        case 0x00000003:
-        case 0x00000006:
-        case 0x00000009:
-        case 0x0000000c:
-        case 0x0000000f:
-        case 0x00000012:
-        case 0x00000015:
-            params->full_height = 20;
-
-            break;
-        default:
-            return -1;
+    if (oid == 0 || oid > count) {
+        return -1;
     }
+    entry = &table[oid - 1];
 
-    params->d = 1;
+    params->func = entry->func;
+    params->n = entry->n;
+    params->padding_len = entry->padding_len;
+    params->full_height = entry->full_height;
+    params->d = entry->d;
     params->wots_w = 16;
 
     // TODO figure out sensible and legal values for this based on the above
@@ -374,327 +146,24 @@ int xmss_parse_oid(xmss_params *params, const uint32_t oid)
     return xmss_xmssmt_initialize_params(params);
 }
 
-int xmssmt_parse_oid(xmss_params *params, const uint32_t oid)
+int xmss_str_to_oid(uint32_t *oid, const char *s)
 {
-    switch (oid) {
-        case 0x00000001:
-        case 0x00000002:
-        case 0x00000003:
-        case 0x00000004:
-        case 0x00000005:
-        case 0x00000006:
-        case 0x00000007:
-        case 0x00000008:
-        case 0x00000009:
-        case 0x0000000a:
-        case 0x0000000b:
-        case 0x0000000c:
-        case 0x0000000d:
-        case 0x0000000e:
-        case 0x0000000f:
-        case 0x00000010:
-
-        case 0x00000021:
-        case 0x00000022:
-        case 0x00000023:
-        case 0x00000024:
-        case 0x00000025:
-        case 0x00000026:
-        case 0x00000027:
-        case 0x00000028:
-            params->func = XMSS_SHA2;
-            break;
-
-        case 0x00000011:
-        case 0x00000012:
-        case 0x00000013:
-        case 0x00000014:
-        case 0x00000015:
-        case 0x00000016:
-        case 0x00000017:
-        case 0x00000018:
-            params->func = XMSS_SHAKE128;
-            break;
-
-        case 0x00000019:
-        case 0x0000001a:
-        case 0x0000001b:
-        case 0x0000001c:
-        case 0x0000001e:
-        case 0x0000001d:
-        case 0x0000001f:
-        case 0x00000020:
-
-        case 0x00000029:
-        case 0x0000002a:
-        case 0x0000002b:
-        case 0x0000002c:
-        case 0x0000002d:
-        case 0x0000002e:
-        case 0x0000002f:
-        case 0x00000030:
-        case 0x00000031:
-        case 0x00000032:
-        case 0x00000033:
-        case 0x00000034:
-        case 0x00000035:
-        case 0x00000036:
-        case 0x00000037:
-        case 0x00000038:
-            params->func = XMSS_SHAKE256;
-            break;
-
-        default:
-            return -1;
-    }
-    switch (oid) {
-        case 0x00000021:
-        case 0x00000022:
-        case 0x00000023:
-        case 0x00000024:
-        case 0x00000025:
-        case 0x00000026:
-        case 0x00000027:
-        case 0x00000028:
-
-        case 0x00000031:
-        case 0x00000032:
-        case 0x00000033:
-        case 0x00000034:
-        case 0x00000035:
-        case 0x00000036:
-        case 0x00000037:
-        case 0x00000038:
-            params->n = 24;
-            params->padding_len = 4;
-            break;
-
-        case 0x00000001:
-        case 0x00000002:
-        case 0x00000003:
-        case 0x00000004:
-        case 0x00000005:
-        case 0x00000006:
-        case 0x00000007:
-        case 0x00000008:
-
-        case 0x00000011:
-        case 0x00000012:
-        case 0x00000013:
-        case 0x00000014:
-        case 0x00000015:
-        case 0x00000016:
-        case 0x00000017:
-        case 0x00000018:
-
-        case 0x00000029:
-        case 0x0000002a:
-        case 0x0000002b:
-        case 0x0000002c:
-        case 0x0000002d:
-        case 0x0000002e:
-        case 0x0000002f:
-        case 0x00000030:
-            params->n = 32;
-            params->padding_len = 32;
-            break;
-
-        case 0x00000009:
-        case 0x0000000a:
-        case 0x0000000b:
-        case 0x0000000c:
-        case 0x0000000d:
-        case 0x0000000e:
-        case 0x0000000f:
-        case 0x00000010:
-
-        case 0x00000019:
-        case 0x0000001a:
-        case 0x0000001b:
-        case 0x0000001c:
-        case 0x0000001d:
-        case 0x0000001e:
-        case 0x0000001f:
-        case 0x00000020:
-            params->n = 64;
-            params->padding_len = 64;
-            break;
-
-        default:
-            return -1;
-    }
-    switch (oid) {
-        case 0x00000001:
-        case 0x00000002:
-
-        case 0x00000009:
-        case 0x0000000a:
-
-        case 0x00000011:
-        case 0x00000012:
-
-        case 0x00000019:
-        case 0x0000001a:
-
-        case 0x00000021:
-        case 0x00000022:
-
-        case 0x00000029:
-        case 0x0000002a:
-
-        case 0x00000031:
-        case 0x00000032:
-            params->full_height = 20;
-            break;
-
-        case 0x00000003:
-        case 0x00000004:
-        case 0x00000005:
-
-        case 0x0000000b:
-        case 0x0000000c:
-        case 0x0000000d:
-
-        case 0x00000013:
-        case 0x00000014:
-        case 0x00000015:
-
-        case 0x0000001b:
-        case 0x0000001c:
-        case 0x0000001d:
-
-        case 0x00000023:
-        case 0x00000024:
-        case 0x00000025:
-
-        case 0x0000002b:
-        case 0x0000002c:
-        case 0x0000002d:
-
-        case 0x00000033:
-        case 0x00000034:
-        case 0x00000035:
-            params->full_height = 40;
-            break;
-
-        case 0x00000006:
-        case 0x00000007:
-        case 0x00000008:
-
-        case 0x0000000e:
-        case 0x0000000f:
-        case 0x00000010:
-
-        case 0x00000016:
-        case 0x00000017:
-        case 0x00000018:
-
-        case 0x0000001e:
-        case 0x0000001f:
-        case 0x00000020:
-
-        case 0x00000026:
-        case 0x00000027:
-        case 0x00000028:
-
-        case 0x0000002e:
-        case 0x0000002f:
-        case 0x00000030:
-
-        case 0x00000036:
-        case 0x00000037:
-        case 0x00000038:
-            params->full_height = 60;
-            break;
-
-        default:
-            return -1;
-    }
-    switch (oid) {
-        case 0x00000001:
-        case 0x00000003:
-        case 0x00000009:
-        case 0x0000000b:
-        case 0x00000011:
-        case 0x00000013:
-        case 0x00000019:
-        case 0x0000001b:
-        case 0x00000021:
-        case 0x00000023:
-        case 0x00000029:
-        case 0x0000002b:
-        case 0x00000031:
-        case 0x00000033:
-            params->d = 2;
-            break;
-
-        case 0x00000002:
-        case 0x00000004:
-        case 0x0000000a:
-        case 0x0000000c:
-        case 0x00000012:
-        case 0x00000014:
-        case 0x0000001a:
-        case 0x0000001c:
-        case 0x00000022:
-        case 0x00000024:
-        case 0x0000002a:
-        case 0x0000002c:
-        case 0x00000032:
-        case 0x00000034:
-            params->d = 4;
-            break;
-
-        case 0x00000005:
-        case 0x0000000d:
-        case 0x00000015:
-        case 0x0000001d:
-        case 0x00000025:
-        case 0x0000002d:
-        case 0x00000035:
-            params->d = 8;
-            break;
-
-        case 0x00000006:
-        case 0x0000000e:
-        case 0x00000016:
-        case 0x0000001e:
-        case 0x00000026:
-        case 0x0000002e:
-        case 0x00000036:
-            params->d = 3;
-            break;
-
-        case 0x00000007:
-        case 0x0000000f:
-        case 0x00000017:
-        case 0x0000001f:
-        case 0x00000027:
-        case 0x0000002f:
-        case 0x00000037:
-            params->d = 6;
-            break;
-
-        case 0x00000008:
-        case 0x00000010:
-        case 0x00000018:
-        case 0x00000020:
-        case 0x00000028:
-        case 0x00000030:
-        case 0x00000038:
-            params->d = 12;
-            break;
-
-        default:
-            return -1;
-    }
+    return oid_lookup(oid, s, xmss_oids, XMSS_OID_COUNT);
+}
 
-    params->wots_w = 16;
+int xmssmt_str_to_oid(uint32_t *oid, const char *s)
+{
+    return oid_lookup(oid, s, xmssmt_oids, XMSSMT_OID_COUNT);
+}
 
-    // TODO figure out sensible and legal values for this based on the above
-    params->bds_k = 0;
+int xmss_parse_oid(xmss_params *params, const uint32_t oid)
+{
+    return oid_parse(params, oid, xmss_oids, XMSS_OID_COUNT);
+}
 
-    return xmss_xmssmt_initialize_params(params);
+int xmssmt_parse_oid(xmss_params *params, const uint32_t oid)
+{
+    return oid_parse(params, oid, xmssmt_oids, XMSSMT_OID_COUNT);
 }
 
 /**
@@ -704,6 +173,7 @@ int xmssmt_parse_oid(xmss_params *params, const uint32_t oid)
  *  - d; the number of layers (d > 1 implies XMSSMT)
  *  - func; one of {XMSS_SHA2, XMSS_SHAKE128, XMSS_SHAKE256}
  *  - wots_w; the Winternitz parameter
+ *  - padding_len; the length of the domain separator of the hashes
  *  - optionally, bds_k; the BDS traversal trade-off parameter,
  * this function initializes the remainder of the params structure.
  */
@@ -749,5 +219,22 @@ int xmss_xmssmt_initialize_params(xmss_params *params)
     params->pk_bytes = 2 * params->n;
     params->sk_bytes = xmss_xmssmt_core_sk_bytes(params);
 
+    params->msg_domain = XMSS_MSG_REGULAR;
+    params->seed_ctx = NULL;
+
+    /* Select the hash instance with these n and padding_len built in. */
+    params->impl = XMSS_IMPL_GENERIC;
+    if (params->n == 32 && params->padding_len == 32) {
+        if (params->func == XMSS_SHA2) {
+            params->impl = XMSS_IMPL_SHA2_256;
+        }
+        else if (params->func == XMSS_SHAKE128) {
+            params->impl = XMSS_IMPL_SHAKE128_256;
+        }
+        else if (params->func == XMSS_SHAKE256) {
+            params->impl = XMSS_IMPL_SHAKE256_256;
+        }
+    }
+
     return 0;
 }
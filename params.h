@@ -8,6 +8,20 @@
 #define XMSS_SHAKE128 1
 #define XMSS_SHAKE256 2
 
+/* Specialized instances of the hash routines (see hash.c). Parameter sets
+   with n = 32 and a padding of 32 bytes (i.e. all *_256 sets) are hashed by
+   an instance in which these are compile-time constants. */
+#define XMSS_IMPL_GENERIC 0
+#define XMSS_IMPL_SHA2_256 1
+#define XMSS_IMPL_SHAKE128_256 2
+#define XMSS_IMPL_SHAKE256_256 3
+
+/* The domains of the message hash (see hash_message). The root that a batch
+   signature signs is hashed in a domain of its own, so that it never opens
+   as a regular signed message, nor the other way around. */
+#define XMSS_MSG_REGULAR 0
+#define XMSS_MSG_BATCH_ROOT 1
+
 /* This is a result of the OID definitions in the draft; needed for parsing. */
 #define XMSS_OID_LEN 4
 
@@ -30,6 +44,13 @@ typedef struct {
     unsigned int pk_bytes;
     unsigned long long sk_bytes;
     unsigned int bds_k;
+    /* One of XMSS_IMPL_*; set by xmss_xmssmt_initialize_params. */
+    unsigned int impl;
+    /* One of XMSS_MSG_*; xmss_xmssmt_initialize_params sets XMSS_MSG_REGULAR. */
+    unsigned int msg_domain;
+    /* A precomputed hash state of PUB_SEED (see hash.h), or NULL;
+       xmss_xmssmt_initialize_params sets NULL. Not owned by params. */
+    struct xmss_seed_ctx *seed_ctx;
 } xmss_params;
 
 /**
@@ -65,8 +86,10 @@ int xmssmt_parse_oid(xmss_params *params, const uint32_t oid);
     - d; the number of layers (d > 1 implies XMSSMT)
     - func; one of {XMSS_SHA2, XMSS_SHAKE128, XMSS_SHAKE256}
     - wots_w; the Winternitz parameter
+    - padding_len; the length of the domain separator of the hashes
     - optionally, bds_k; the BDS traversal trade-off parameter,
-    this function initializes the remainder of the params structure. */
+    this function initializes the remainder of the params structure,
+    including the instance of the hash routines that is used. */
 int xmss_xmssmt_initialize_params(xmss_params *params);
 
 #endif
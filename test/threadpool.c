@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "../xmss.h"
+#include "../xmss_commons.h"
+#include "../xmss_core.h"
+#include "../xmss_signer.h"
+#include "../hash_address.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../threadpool.h"
+
+#define XMSS_MLEN 32
+#define THREADS 4
+#define LOOP_COUNT 100
+#define SUBMITTERS 3
+#define SIGNATURES 8
+
+typedef struct {
+    atomic_uint calls[LOOP_COUNT];
+    threadpool *pool;
+    int nested;
+} loop_counts;
+
+static void count_call(void *arg, unsigned int i)
+{
+    loop_counts *counts = arg;
+    loop_counts inner;
+    unsigned int j;
+
+    atomic_fetch_add(&counts->calls[i], 1);
+    /* Some calls run a loop of their own on the same pool. */
+    if (counts->nested && i % 10 == 0) {
+        memset(&inner, 0, sizeof(inner));
+        threadpool_run(counts->pool, count_call, &inner, LOOP_COUNT);
+        for (j = 0; j < LOOP_COUNT; j++) {
+            if (atomic_load(&inner.calls[j]) != 1) {
+                atomic_fetch_add(&counts->calls[i], 100);
+            }
+        }
+    }
+}
+
+/* Returns 0 if every call of the loop was made exactly once. */
+static int run_counted(threadpool *pool, int nested)
+{
+    loop_counts counts;
+    unsigned int i;
+
+    memset(&counts, 0, sizeof(counts));
+    counts.pool = pool;
+    counts.nested = nested;
+    threadpool_run(pool, count_call, &counts, LOOP_COUNT);
+    for (i = 0; i < LOOP_COUNT; i++) {
+        if (atomic_load(&counts.calls[i]) != 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *submitter(void *arg)
+{
+    int *ret = arg;
+    int i;
+
+    for (i = 0; i < 20; i++) {
+        *ret |= run_counted(threadpool_shared(), 1);
+    }
+    return NULL;
+}
+
+int main()
+{
+    xmss_params params;
+    threadpool_stats before, after, single;
+    threadpool *pool;
+    pthread_t threads[SUBMITTERS];
+    int rets[SUBMITTERS] = {0};
+    uint32_t oid;
+    int ret = 0;
+    int cpus[1] = {0};
+    unsigned int ncpus = 0;
+    int i;
+
+    xmssmt_str_to_oid(&oid, "XMSSMT-SHA2_20/4_256");
+    xmssmt_parse_oid(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char m[XMSS_MLEN];
+    unsigned char *sm[SIGNATURES];
+    unsigned long long smlen[SIGNATURES];
+    unsigned char *sm_signer = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen_signer;
+    int status[SIGNATURES];
+    unsigned char seed[params.n], root[params.n], root_inline[params.n];
+    unsigned char auth[params.tree_height * params.n];
+    unsigned char auth_inline[params.tree_height * params.n];
+    uint32_t addr[8] = {0};
+    xmss_signer *signer;
+
+    printf("Testing the shared work-stealing pool.. \n");
+
+#ifdef __linux__
+    /* Pin the workers to a CPU that this process may run on. */
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (i = 0; i < CPU_SETSIZE && !CPU_ISSET(i, &set); i++);
+        cpus[0] = i;
+        ncpus = 1;
+    }
+#endif
+
+    /* Until it is configured, the shared pool runs inline. */
+    randombytes(seed, params.n);
+    set_layer_addr(addr, 1);
+    xmss_treehash(&params, root_inline, auth_inline, 5, seed, seed, 0,
+                  params.tree_height, addr);
+    if (threadpool_shared() != NULL || run_counted(NULL, 0)) {
+        printf("  X inline pool does not run loops in place!\n");
+        ret = -1;
+    }
+
+    if (threadpool_shared_configure(THREADS, cpus, ncpus) ||
+        threadpool_size(threadpool_shared()) != THREADS) {
+        printf("  X could not start the shared pool!\n");
+        return -1;
+    }
+
+    threadpool_get_stats(threadpool_shared(), &before);
+    if (run_counted(threadpool_shared(), 0)) {
+        printf("  X loop calls were not made exactly once!\n");
+        ret = -1;
+    }
+    threadpool_get_stats(threadpool_shared(), &after);
+    if (after.tasks - before.tasks != LOOP_COUNT || after.threads != THREADS) {
+        printf("  X pool counted %llu calls!\n", after.tasks - before.tasks);
+        ret = -1;
+    }
+
+    /* With a single worker, there is no other worker to steal from: the
+       calls that the worker does not make are the ones the caller helps
+       with. */
+    pool = threadpool_create(2);
+    if (pool == NULL || run_counted(pool, 0)) {
+        printf("  X loop on a single worker failed!\n");
+        ret = -1;
+    }
+    threadpool_get_stats(pool, &single);
+    if (single.steals != 0 || single.helps > single.tasks) {
+        printf("  X single worker counted %llu steals and %llu helps!\n",
+               single.steals, single.helps);
+        ret = -1;
+    }
+    threadpool_free(pool);
+
+    /* Several threads run loops (with nested loops) at the same time. */
+    for (i = 0; i < SUBMITTERS; i++) {
+        pthread_create(&threads[i], NULL, submitter, &rets[i]);
+    }
+    for (i = 0; i < SUBMITTERS; i++) {
+        pthread_join(threads[i], NULL);
+        ret |= rets[i];
+    }
+    if (ret) {
+        printf("  X concurrent or nested loops lost calls!\n");
+    }
+    else {
+        printf("    loops from %d threads are complete.\n", SUBMITTERS + 1);
+    }
+
+    /* The library paths give the same results on the pool. */
+    xmss_treehash(&params, root, auth, 5, seed, seed, 0, params.tree_height,
+                  addr);
+    if (memcmp(root, root_inline, params.n) ||
+        memcmp(auth, auth_inline, sizeof(auth))) {
+        printf("  X treehash on the pool differs!\n");
+        ret = -1;
+    }
+
+    xmssmt_keypair(pk, sk, oid);
+    signer = xmss_signer_load(&params, sk + XMSS_OID_LEN);
+    if (signer == NULL || xmss_signer_set_threads(signer, 0) ||
+        xmss_signer_set_precompute(signer, 3)) {
+        printf("  X could not create signer!\n");
+        return -1;
+    }
+    for (i = 0; i < SIGNATURES; i++) {
+        randombytes(m, XMSS_MLEN);
+        sm[i] = malloc(params.sig_bytes + XMSS_MLEN);
+        xmss_signer_precompute(signer);
+        xmssmt_sign(sk, sm[i], &smlen[i], m, XMSS_MLEN);
+        xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN);
+        if (smlen[i] != smlen_signer || memcmp(sm[i], sm_signer, smlen_signer)) {
+            printf("  X signature #%d of the signer differs!\n", i);
+            ret = -1;
+        }
+    }
+    /* A parallel batch runs on the shared pool. */
+    threadpool_get_stats(threadpool_shared(), &before);
+    if (xmssmt_verify_batch(status, (const unsigned char * const *)sm, smlen,
+                            SIGNATURES, pk, 1)) {
+        printf("  X batch verification on the pool failed!\n");
+        ret = -1;
+    }
+    threadpool_get_stats(threadpool_shared(), &after);
+    if (after.tasks - before.tasks != SIGNATURES) {
+        printf("  X batch made %llu calls on the shared pool!\n",
+               after.tasks - before.tasks);
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    key generation, signatures and verification agree.\n");
+    }
+
+    threadpool_get_stats(threadpool_shared(), &after);
+    printf("    %llu calls, %llu stolen, %llu by callers, %.0f%% utilization.\n",
+           after.tasks, after.steals, after.helps, 100 * after.utilization);
+    if (after.busy <= 0 || after.utilization <= 0) {
+        printf("  X pool did not count its work!\n");
+        ret = -1;
+    }
+
+    xmss_signer_free(signer);
+    threadpool_shared_configure(1, NULL, 0);
+    for (i = 0; i < SIGNATURES; i++) {
+        free(sm[i]);
+    }
+    free(sm_signer);
+
+    return ret;
+}
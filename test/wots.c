@@ -6,6 +6,7 @@
 #include "../wots.h"
 #include "../randombytes.h"
 #include "../params.h"
+#include "../utils.h"
 
 int main()
 {
@@ -21,8 +22,12 @@ int main()
     unsigned char pk1[params.wots_sig_bytes];
     unsigned char pk2[params.wots_sig_bytes];
     unsigned char sig[params.wots_sig_bytes];
+    unsigned char sig2[params.wots_sig_bytes];
+    unsigned char chains[params.wots_len * params.wots_w * params.n];
     unsigned char m[params.n];
+    int lengths[params.wots_len];
     uint32_t addr[8] = {0};
+    uint32_t i;
 
     randombytes(seed, params.n);
     randombytes(pub_seed, params.n);
@@ -40,5 +45,69 @@ int main()
         return -1;
     }
     printf("successful.\n");
+
+    printf("Testing WOTS signature from precomputed chains.. ");
+
+    wots_chains_gen(&params, chains, seed, pub_seed, addr);
+    wots_sign_from_chains(&params, sig2, m, chains);
+
+    if (memcmp(sig, sig2, params.wots_sig_bytes)) {
+        printf("failed!\n");
+        return -1;
+    }
+    printf("successful.\n");
+
+    printf("Testing WOTS PK derivation one chain at a time.. ");
+
+    wots_chain_lengths(&params, lengths, m);
+    for (i = 0; i < params.wots_len; i++) {
+        wots_chain_from_sig(&params, pk2 + i*params.n, sig, i, lengths[i],
+                            pub_seed, addr);
+    }
+
+    if (memcmp(pk1, pk2, params.wots_sig_bytes)) {
+        printf("failed!\n");
+        return -1;
+    }
+    printf("successful.\n");
+
+    printf("Testing specialized hash instances against the generic one.. ");
+
+    /* SHA2_10_256, SHAKE_10_256 and SHAKE256_10_256; all have n = 32. */
+    const uint32_t oids[3] = {0x00000001, 0x00000007, 0x00000010};
+    xmss_params generic;
+
+    for (i = 0; i < 3; i++) {
+        xmss_parse_oid(&params, oids[i]);
+        generic = params;
+        generic.impl = XMSS_IMPL_GENERIC;
+
+        wots_pkgen(&params, pk1, seed, pub_seed, addr);
+        wots_pkgen(&generic, pk2, seed, pub_seed, addr);
+        if (params.impl == XMSS_IMPL_GENERIC ||
+            memcmp(pk1, pk2, params.wots_sig_bytes)) {
+            printf("failed!\n");
+            return -1;
+        }
+    }
+    printf("successful.\n");
+
+    printf("Testing that a workspace that is too small is refused.. ");
+
+    unsigned char ws_buf[wots_workspace_size(&params)];
+    xmss_workspace ws;
+
+    /* Too small by the alignment, as the buffer need not be aligned. */
+    xmss_ws_init(&ws, ws_buf, sizeof(ws_buf) - XMSS_WS_ALIGN);
+    memcpy(pk2, pk1, params.wots_sig_bytes);
+    if (wots_pkgen_ws(&params, pk2, seed, pub_seed, addr, &ws) != -1 ||
+        wots_sign_ws(&params, pk2, m, seed, pub_seed, addr, &ws) != -1 ||
+        wots_pk_from_sig_ws(&params, pk2, sig, m, pub_seed, addr, &ws) != -1 ||
+        wots_sign_from_chains_ws(&params, pk2, m, chains, &ws) != -1 ||
+        memcmp(pk1, pk2, params.wots_sig_bytes) || ws.used != 0) {
+        printf("failed!\n");
+        return -1;
+    }
+    printf("successful.\n");
     return 0;
 }
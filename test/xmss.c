@@ -4,8 +4,11 @@
 #include <stdlib.h>
 
 #include "../xmss.h"
+#include "../xmss_commons.h"
+#include "../xmss_core.h"
 #include "../params.h"
 #include "../randombytes.h"
+#include "../utils.h"
 
 #define XMSS_MLEN 32
 
@@ -126,6 +129,50 @@ int main()
 #endif
     }
 
+    /* Signing and verifying with a caller-supplied (and deliberately
+       misaligned) workspace gives the same results as with the stack. */
+    unsigned char sk_ws[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *sm_ws = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long ws_size = xmssmt_core_sign_workspace_size(&params);
+    unsigned char *ws_buf;
+    xmss_workspace ws;
+
+    if (xmssmt_core_sign_open_workspace_size(&params) > ws_size) {
+        ws_size = xmssmt_core_sign_open_workspace_size(&params);
+    }
+    ws_buf = malloc(ws_size + XMSS_WS_ALIGN + 1);
+    /* Start from a fresh key, as the loop above may have used up the key. */
+    XMSS_KEYPAIR(pk, sk, oid);
+    memcpy(sk_ws, sk, sizeof(sk));
+    xmss_ws_init(&ws, ws_buf + 1, ws_size + XMSS_WS_ALIGN);
+
+    XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
+    if (xmssmt_core_sign_ws(&params, sk_ws + XMSS_OID_LEN, sm_ws, &mlen,
+                            m, XMSS_MLEN, &ws) ||
+        mlen != smlen || memcmp(sm, sm_ws, smlen) ||
+        memcmp(sk, sk_ws, sizeof(sk)) || ws.used != 0) {
+        printf("  X signing with a workspace differs!\n");
+        ret = -1;
+    }
+    else if (xmssmt_core_sign_open_ws(&params, mout, &mlen, sm_ws, smlen,
+                                      pk + XMSS_OID_LEN, &ws) ||
+             mlen != XMSS_MLEN || memcmp(m, mout, XMSS_MLEN)) {
+        printf("  X verification with a workspace failed!\n");
+        ret = -1;
+    }
+    else {
+        printf("    signing and verifying with a workspace succeeded.\n");
+    }
+    /* A workspace that is too small is rejected rather than overrun. */
+    xmss_ws_init(&ws, ws_buf, xmssmt_core_sign_workspace_size(&params) / 2);
+    if (xmssmt_core_sign_ws(&params, sk_ws + XMSS_OID_LEN, sm_ws, &mlen,
+                            m, XMSS_MLEN, &ws) != -1) {
+        printf("  X signing accepted a workspace that is too small!\n");
+        ret = -1;
+    }
+
+    free(ws_buf);
+    free(sm_ws);
     free(m);
     free(sm);
     free(mout);
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../xmss.h"
+#include "../xmss_commons.h"
+#include "../hash.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+/* The largest batch; messages have different lengths, up to XMSS_MLEN. */
+#define XMSS_BATCH 9
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_SIGN_BATCH xmssmt_sign_batch
+    #define XMSS_SIGN_OPEN_BATCH xmssmt_sign_open_batch
+    #define XMSS_SIGN xmssmt_sign
+    #define XMSS_SIGN_OPEN xmssmt_sign_open
+    #define XMSS_VERIFY_BATCH xmssmt_verify_batch
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_SIGN_BATCH xmss_sign_batch
+    #define XMSS_SIGN_OPEN_BATCH xmss_sign_open_batch
+    #define XMSS_SIGN xmss_sign
+    #define XMSS_SIGN_OPEN xmss_sign_open
+    #define XMSS_VERIFY_BATCH xmss_verify_batch
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+#endif
+
+int main()
+{
+    xmss_params params;
+    uint32_t oid;
+    int ret = 0;
+    unsigned int count, j;
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char m[XMSS_BATCH][XMSS_MLEN];
+    const unsigned char *mp[XMSS_BATCH];
+    unsigned long long mlen[XMSS_BATCH];
+    unsigned char *sigs = malloc(XMSS_BATCH * xmss_batch_sig_bytes(&params, XMSS_BATCH));
+    unsigned long long sig_bytes;
+
+    for (j = 0; j < XMSS_BATCH; j++) {
+        randombytes(m[j], XMSS_MLEN);
+        mp[j] = m[j];
+        mlen[j] = XMSS_MLEN - j;
+    }
+
+    XMSS_KEYPAIR(pk, sk, oid);
+
+    printf("Testing batches of 1 to %d %s signatures.. \n",
+           XMSS_BATCH, XMSS_VARIANT);
+
+    for (count = 1; count <= XMSS_BATCH; count++) {
+        sig_bytes = xmss_batch_sig_bytes(&params, count);
+
+        if (XMSS_SIGN_BATCH(sk, sigs, mp, mlen, count)) {
+            printf("  X signing a batch of %u failed!\n", count);
+            ret = -1;
+            continue;
+        }
+        for (j = 0; j < count; j++) {
+            if (XMSS_SIGN_OPEN_BATCH(sigs + j*sig_bytes, sig_bytes,
+                                     m[j], mlen[j], pk)) {
+                printf("  X verification of message %u of %u failed!\n",
+                       j, count);
+                ret = -1;
+            }
+        }
+
+        /* A signature does not carry over to another message of the batch. */
+        if (count > 1 && !XMSS_SIGN_OPEN_BATCH(sigs, sig_bytes,
+                                               m[1], mlen[1], pk)) {
+            printf("  X signature verified for the wrong message!\n");
+            ret = -1;
+        }
+        /* Nor does a modified inclusion path verify. */
+        if (count > 1) {
+            sigs[sig_bytes - 1] ^= 1;
+            if (!XMSS_SIGN_OPEN_BATCH(sigs, sig_bytes, m[0], mlen[0], pk)) {
+                printf("  X signature with a modified path verified!\n");
+                ret = -1;
+            }
+            sigs[sig_bytes - 1] ^= 1;
+        }
+        /* Nor does a signature that claims a different batch size. */
+        sigs[params.sig_bytes + 3] ^= 2;
+        if (!XMSS_SIGN_OPEN_BATCH(sigs, sig_bytes, m[0], mlen[0], pk)) {
+            printf("  X signature with a modified batch size verified!\n");
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        printf("    all batch signatures verified, modified ones did not.\n");
+    }
+
+    /* Verify a batch of regular signatures at once, some of them modified. */
+    printf("Testing batch verification of %d %s signatures.. \n",
+           XMSS_BATCH, XMSS_VARIANT);
+    unsigned char *sm = malloc(XMSS_BATCH * (params.sig_bytes + XMSS_MLEN));
+    const unsigned char *smp[XMSS_BATCH];
+    unsigned long long smlen[XMSS_BATCH];
+    int status[XMSS_BATCH];
+
+    for (j = 0; j < XMSS_BATCH; j++) {
+        smp[j] = sm + j*(params.sig_bytes + XMSS_MLEN);
+        XMSS_SIGN(sk, sm + j*(params.sig_bytes + XMSS_MLEN), &smlen[j],
+                  m[j], mlen[j]);
+    }
+    sm[2*(params.sig_bytes + XMSS_MLEN) + params.index_bytes + params.n] ^= 1;
+    sm[5*(params.sig_bytes + XMSS_MLEN) + params.sig_bytes] ^= 1;
+    smlen[7] = params.sig_bytes - 1;
+
+    if (!XMSS_VERIFY_BATCH(status, smp, smlen, XMSS_BATCH, pk, 1)) {
+        printf("  X batch with modified signatures verified!\n");
+        ret = -1;
+    }
+    for (j = 0; j < XMSS_BATCH; j++) {
+        if ((status[j] != 0) != (j == 2 || j == 5 || j == 7)) {
+            printf("  X wrong status %d for signature %u!\n", status[j], j);
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        printf("    exactly the modified signatures were rejected.\n");
+    }
+
+    /* The root of a batch is signed in a domain of its own: the shared
+       signature, followed by (count || root), is not a regular signed
+       message; nor does a regular signature on such a message make a batch
+       signature. With a single message, the root is the hash of its leaf. */
+    printf("Testing that batch and regular signatures are separated.. \n");
+    sig_bytes = xmss_batch_sig_bytes(&params, 1);
+    unsigned char *buf = malloc(params.padding_len + 3*params.n + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + 4 + params.n);
+    unsigned char root[4 + params.n];
+    unsigned long long rootlen;
+
+    XMSS_SIGN_BATCH(sk, sigs, mp, mlen, 1);
+    memcpy(buf + params.padding_len + 3*params.n, m[0], mlen[0]);
+    hash_message(&params, root + 4, sigs + params.sig_bytes + 8,
+                 pk + XMSS_OID_LEN, 0, buf, mlen[0]);
+    ull_to_bytes(root, 4, 1);
+    memcpy(sm, sigs, params.sig_bytes);
+    memcpy(sm + params.sig_bytes, root, sizeof(root));
+    if (!XMSS_SIGN_OPEN(mout, &rootlen, sm, params.sig_bytes + sizeof(root), pk)) {
+        printf("  X batch signature opened as a regular signature!\n");
+        ret = -1;
+    }
+
+    XMSS_SIGN(sk, sm, &smlen[0], root, sizeof(root));
+    memcpy(sigs, sm, params.sig_bytes);
+    if (!XMSS_SIGN_OPEN_BATCH(sigs, sig_bytes, m[0], mlen[0], pk)) {
+        printf("  X regular signature verified as a batch signature!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    neither opens as the other.\n");
+    }
+
+    free(buf);
+    free(mout);
+    free(sm);
+    free(sigs);
+
+    return ret;
+}
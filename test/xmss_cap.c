@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../xmss.h"
+#include "../xmss_commons.h"
+#include "../params.h"
+#include "../randombytes.h"
+
+#define XMSS_MLEN 32
+#define XMSS_SIGNATURES 4
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_SIGN xmssmt_sign
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_SIGN xmss_sign
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+#endif
+
+int main()
+{
+    xmss_params params;
+    uint32_t oid;
+    int ret = 0;
+    int i;
+    unsigned int c;
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *xpk = malloc(xmss_cap_pk_bytes(&params, params.tree_height));
+    unsigned char *m = malloc(XMSS_MLEN);
+    unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen, csmlen, mlen;
+
+    XMSS_KEYPAIR(pk, sk, oid);
+
+    printf("Testing %s signatures with Merkle caps.. \n", XMSS_VARIANT);
+
+    /* Every cap height, up to a cap that holds all leaves of the top tree. */
+    for (c = 0; c <= params.tree_height && ret == 0; c++) {
+        if (xmssmt_core_cap_pk(&params, xpk, sk + XMSS_OID_LEN, c) ||
+            memcmp(xpk, pk + XMSS_OID_LEN, params.pk_bytes) ||
+            xmssmt_core_cap_check(&params, xpk, c)) {
+            printf("  X extended public key with cap %u is not valid!\n", c);
+            ret = -1;
+            break;
+        }
+
+        for (i = 0; i < XMSS_SIGNATURES; i++) {
+            randombytes(m, XMSS_MLEN);
+            XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
+            xmssmt_core_cap_strip(&params, sm, &csmlen, sm, smlen, c);
+
+            if (csmlen != xmss_capped_sig_bytes(&params, c) + XMSS_MLEN ||
+                xmssmt_core_sign_open_capped(&params, mout, &mlen, sm, csmlen,
+                                             xpk, c) ||
+                mlen != XMSS_MLEN || memcmp(mout, m, XMSS_MLEN)) {
+                printf("  X signature #%d with cap %u was not accepted!\n", i, c);
+                ret = -1;
+                break;
+            }
+
+            /* Modified signatures and messages are rejected. */
+            sm[params.index_bytes + params.n + (i * 97) % (csmlen - XMSS_MLEN -
+                                                           params.index_bytes - params.n)] ^= 1;
+            if (!xmssmt_core_sign_open_capped(&params, mout, &mlen, sm, csmlen,
+                                              xpk, c)) {
+                printf("  X modified signature #%d with cap %u was accepted!\n", i, c);
+                ret = -1;
+                break;
+            }
+            sm[params.index_bytes + params.n + (i * 97) % (csmlen - XMSS_MLEN -
+                                                           params.index_bytes - params.n)] ^= 1;
+            sm[csmlen - 1] ^= 1;
+            if (!xmssmt_core_sign_open_capped(&params, mout, &mlen, sm, csmlen,
+                                              xpk, c)) {
+                printf("  X modified message #%d with cap %u was accepted!\n", i, c);
+                ret = -1;
+                break;
+            }
+        }
+
+        /* A modified cap does not match the root. */
+        xpk[params.pk_bytes] ^= 1;
+        if (ret == 0 && !xmssmt_core_cap_check(&params, xpk, c)) {
+            printf("  X modified cap %u was accepted!\n", c);
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        printf("    signatures verify with caps of height 0 to %u.\n",
+               params.tree_height);
+    }
+
+    free(xpk);
+    free(m);
+    free(sm);
+    free(mout);
+
+    return ret;
+}
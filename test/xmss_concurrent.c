@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../xmss_concurrent.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+#define XMSS_THREADS 4
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_SIGN_OPEN xmssmt_sign_open
+    /* Small subtrees, so that several tree boundaries are crossed. */
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+    #define XMSS_SIGNATURES 96
+    #define XMSS_COMPARE_EVERY 5
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_SIGN_OPEN xmss_sign_open
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+    #define XMSS_SIGNATURES 32
+    /* Every xmss_core_sign recomputes the whole tree. */
+    #define XMSS_COMPARE_EVERY 11
+#endif
+
+typedef struct {
+    xmss_concurrent *signer;
+    const xmss_params *params;
+    unsigned char *m;
+    unsigned char *sm;
+    unsigned long long *smlen;
+    int count;
+    int ret;
+} worker;
+
+static void *work(void *arg)
+{
+    worker *w = arg;
+    int i;
+
+    for (i = 0; i < w->count; i++) {
+        if (xmss_concurrent_sign(w->signer,
+                                 w->sm + i*(w->params->sig_bytes + XMSS_MLEN),
+                                 &w->smlen[i], w->m + i*XMSS_MLEN, XMSS_MLEN)) {
+            w->ret = -1;
+        }
+    }
+    return NULL;
+}
+
+int main()
+{
+    xmss_params params;
+    xmss_concurrent *signer;
+    uint32_t oid;
+    int ret = 0;
+    int i, t;
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+
+    const unsigned long long smbytes = params.sig_bytes + XMSS_MLEN;
+    const int per_thread = XMSS_SIGNATURES / XMSS_THREADS;
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *sk_ref = malloc(params.sk_bytes);
+    unsigned char *sk_persisted = malloc(params.sk_bytes);
+    unsigned char *m = malloc(XMSS_SIGNATURES * XMSS_MLEN);
+    unsigned char *sm = malloc(XMSS_SIGNATURES * smbytes);
+    unsigned char *sm_ref = malloc(smbytes);
+    unsigned char *mout = malloc(smbytes);
+    unsigned char *used = calloc(XMSS_SIGNATURES, 1);
+    unsigned long long smlen[XMSS_SIGNATURES];
+    unsigned long long smlen_ref, mlen, idx;
+    pthread_t threads[XMSS_THREADS];
+    worker workers[XMSS_THREADS];
+
+    XMSS_KEYPAIR(pk, sk, oid);
+    randombytes(m, XMSS_SIGNATURES * XMSS_MLEN);
+
+    signer = xmss_concurrent_load(&params, sk + XMSS_OID_LEN);
+    if (signer == NULL) {
+        printf("  X could not create signer!\n");
+        return -1;
+    }
+
+    printf("Testing %d %s signatures from %d threads.. \n",
+           XMSS_SIGNATURES, XMSS_VARIANT, XMSS_THREADS);
+
+    for (t = 0; t < XMSS_THREADS; t++) {
+        workers[t].signer = signer;
+        workers[t].params = &params;
+        workers[t].m = m + t*per_thread*XMSS_MLEN;
+        workers[t].sm = sm + t*per_thread*smbytes;
+        workers[t].smlen = smlen + t*per_thread;
+        workers[t].count = per_thread;
+        workers[t].ret = 0;
+        pthread_create(&threads[t], NULL, work, &workers[t]);
+    }
+    for (t = 0; t < XMSS_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        if (workers[t].ret) {
+            printf("  X signing failed on thread %d!\n", t);
+            ret = -1;
+        }
+    }
+
+    for (i = 0; i < XMSS_SIGNATURES && ret == 0; i++) {
+        idx = bytes_to_ull(sm + i*smbytes, params.index_bytes);
+        if (idx >= XMSS_SIGNATURES || used[idx]) {
+            printf("  X index %llu was used twice!\n", idx);
+            ret = -1;
+            break;
+        }
+        used[idx] = 1;
+
+        if (XMSS_SIGN_OPEN(mout, &mlen, sm + i*smbytes, smlen[i], pk)) {
+            printf("  X verification of signature #%llu failed!\n", idx);
+            ret = -1;
+            break;
+        }
+
+        /* The signature is the one the core produces for the same index. */
+        if (idx % XMSS_COMPARE_EVERY == 0) {
+            memcpy(sk_ref, sk + XMSS_OID_LEN, params.sk_bytes);
+            ull_to_bytes(sk_ref, params.index_bytes, idx);
+            xmssmt_core_sign(&params, sk_ref, sm_ref, &smlen_ref,
+                             m + i*XMSS_MLEN, XMSS_MLEN);
+            if (smlen_ref != smlen[i] ||
+                memcmp(sm_ref, sm + i*smbytes, smlen_ref)) {
+                printf("  X signature #%llu differs from the core!\n", idx);
+                ret = -1;
+                break;
+            }
+        }
+    }
+    if (ret == 0) {
+        printf("    indices are unique and signatures are identical.\n");
+    }
+
+    /* The persisted index covers all reservations, and never moves back. */
+    memcpy(sk_persisted, sk + XMSS_OID_LEN, params.sk_bytes);
+    xmss_concurrent_persist(signer, sk_persisted);
+    if (bytes_to_ull(sk_persisted, params.index_bytes) != XMSS_SIGNATURES) {
+        printf("  X persisted index does not match!\n");
+        ret = -1;
+    }
+    ull_to_bytes(sk_persisted, params.index_bytes, XMSS_SIGNATURES + 5);
+    xmss_concurrent_persist(signer, sk_persisted);
+    if (bytes_to_ull(sk_persisted, params.index_bytes) != XMSS_SIGNATURES + 5) {
+        printf("  X persisted index moved back!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    persisted index is monotonic.\n");
+    }
+
+    xmss_concurrent_free(signer);
+    free(sk_ref);
+    free(sk_persisted);
+    free(m);
+    free(sm);
+    free(sm_ref);
+    free(mout);
+    free(used);
+
+    return ret;
+}
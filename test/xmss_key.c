@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../xmss.h"
+#include "../params.h"
+#include "../randombytes.h"
+
+#define XMSS_MLEN 32
+#define XMSS_SIGNATURES 8
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_SIGN xmssmt_sign
+    #define XMSS_KEY_CREATE xmssmt_key_create
+    #define XMSS_OTHER_KEY_CREATE xmss_key_create
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_SIGN xmss_sign
+    #define XMSS_KEY_CREATE xmss_key_create
+    #define XMSS_OTHER_KEY_CREATE xmssmt_key_create
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+#endif
+
+int main()
+{
+    xmss_params params;
+    xmss_key *key, *verify_key;
+    uint32_t oid;
+    int ret = 0;
+    int i;
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char sk_copy[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *m = malloc(XMSS_MLEN);
+    unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *sm_key = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen, smlen_key, mlen;
+
+    XMSS_KEYPAIR(pk, sk, oid);
+    memcpy(sk_copy, sk, sizeof(sk));
+
+    printf("Testing %d %s signatures through a key handle.. \n",
+           XMSS_SIGNATURES, XMSS_VARIANT);
+
+    key = XMSS_KEY_CREATE(pk, sk);
+    verify_key = XMSS_KEY_CREATE(pk, NULL);
+    if (key == NULL || verify_key == NULL) {
+        printf("  X could not create key handles!\n");
+        return -1;
+    }
+    if (xmss_key_params(key)->sig_bytes != params.sig_bytes ||
+        xmss_key_params(key)->sk_bytes != params.sk_bytes) {
+        printf("  X key handle has different parameters!\n");
+        ret = -1;
+    }
+
+    for (i = 0; i < XMSS_SIGNATURES && ret == 0; i++) {
+        randombytes(m, XMSS_MLEN);
+
+        /* The handle signs with (and updates) the sk it was created from. */
+        XMSS_SIGN(sk_copy, sm, &smlen, m, XMSS_MLEN);
+        if (xmss_key_sign(key, sm_key, &smlen_key, m, XMSS_MLEN) ||
+            smlen != smlen_key || memcmp(sm, sm_key, smlen) ||
+            memcmp(sk, sk_copy, sizeof(sk))) {
+            printf("  X signature #%d differs from the byte-array API!\n", i);
+            ret = -1;
+        }
+        else if (xmss_key_sign_open(verify_key, mout, &mlen, sm_key, smlen_key) ||
+                 mlen != XMSS_MLEN || memcmp(m, mout, XMSS_MLEN)) {
+            printf("  X verification of signature #%d failed!\n", i);
+            ret = -1;
+        }
+        sm_key[smlen_key - 1] ^= 1;
+        if (ret == 0 && !xmss_key_sign_open(key, mout, &mlen, sm_key, smlen_key)) {
+            printf("  X flipping a bit of m DID NOT invalidate signature!\n");
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        printf("    signatures are identical and verify.\n");
+    }
+
+    /* A handle without sk cannot sign, a pk and sk of different parameter
+       sets do not form a key pair, and unknown OIDs are rejected. */
+    if (xmss_key_sign(verify_key, sm_key, &smlen_key, m, XMSS_MLEN) != -1) {
+        printf("  X key handle without sk signed!\n");
+        ret = -1;
+    }
+    sk_copy[XMSS_OID_LEN - 1] ^= 1;
+    if (XMSS_KEY_CREATE(pk, sk_copy) != NULL) {
+        printf("  X key handle accepted mismatching OIDs!\n");
+        ret = -1;
+    }
+    sk_copy[XMSS_OID_LEN - 1] ^= 1;
+    memset(sk_copy, 0xFF, XMSS_OID_LEN);
+    if (XMSS_KEY_CREATE(NULL, sk_copy) != NULL ||
+        XMSS_OTHER_KEY_CREATE(NULL, NULL) != NULL) {
+        printf("  X key handle accepted an unknown OID!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    invalid keys and uses are rejected.\n");
+    }
+
+    xmss_key_free(key);
+    xmss_key_free(verify_key);
+    free(m);
+    free(sm);
+    free(sm_key);
+    free(mout);
+
+    return ret;
+}
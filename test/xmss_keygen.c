@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../xmss_core.h"
+#include "../xmss_keygen.h"
+#include "../xmss_signer.h"
+#include "../params.h"
+#include "../randombytes.h"
+
+#define XMSS_MLEN 32
+#define XMSS_LAZY_SIGNATURES 40
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    /* Small subtrees, so that checkpoints also fall on tree boundaries. */
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+    #define XMSS_INTERVAL 8
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+    #define XMSS_INTERVAL 100
+#endif
+
+typedef struct {
+    unsigned char *saved;
+    const char *path;
+    int calls;
+    int fail_at;
+    unsigned long long done;
+    int reports;
+    int bad_reports;
+} keygen_log;
+
+/* Keeps the third checkpoint in memory, and writes the fifth to a file. */
+static int keep_checkpoints(void *ctx, const unsigned char *record,
+                            unsigned long long len)
+{
+    keygen_log *log = ctx;
+
+    log->calls++;
+    if (log->calls == log->fail_at) {
+        return -1;
+    }
+    if (log->calls == 3) {
+        memcpy(log->saved, record, len);
+    }
+    if (log->calls == 5) {
+        return xmss_keygen_write_file((void *)log->path, record, len);
+    }
+    return 0;
+}
+
+static void check_progress(void *ctx, unsigned long long done,
+                           unsigned long long total, double rate)
+{
+    keygen_log *log = ctx;
+
+    if (done < log->done || done > total || rate < 0) {
+        log->bad_reports++;
+    }
+    log->done = done;
+    log->reports++;
+}
+
+int main()
+{
+    xmss_params params;
+    uint32_t oid;
+    int ret = 0;
+    char path[64];
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+    snprintf(path, sizeof(path), "/tmp/xmss_keygen_test_%d", (int)getpid());
+
+    unsigned long long len = xmss_keygen_checkpoint_bytes(&params);
+    unsigned char pk[params.pk_bytes], pk2[params.pk_bytes];
+    unsigned char sk[params.sk_bytes], sk2[params.sk_bytes];
+    unsigned char *record = malloc(len);
+    unsigned char m[XMSS_MLEN];
+    unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen, mlen;
+    keygen_log log = {malloc(len), path, 0, 0, 0, 0, 0};
+    xmss_signer *signer;
+    unsigned char *sm_signer = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *sk_persisted = malloc(params.sk_bytes);
+    unsigned long long smlen_signer;
+    /* The seeds and root, and a single BDS state. */
+    const unsigned long long keys_bytes = params.index_bytes + 4*params.n;
+    const unsigned long long state_bytes =
+        xmssmt_core_lazy_sk_bytes(&params) - keys_bytes;
+    unsigned char *lazy_sk = malloc(xmssmt_core_lazy_sk_bytes(&params));
+    int i;
+
+    printf("Testing resumable and pipelined %s key generation.. \n", XMSS_VARIANT);
+
+    if (xmssmt_core_keypair_resumable(&params, pk, sk, NULL, XMSS_INTERVAL, 4,
+                                      keep_checkpoints, check_progress, &log) ||
+        log.calls < 5 || log.bad_reports > 0 ||
+        log.done != (unsigned long long)params.d << params.tree_height) {
+        printf("  X key generation reported %d checkpoints and %d of %d bad"
+               " progress reports!\n", log.calls, log.bad_reports, log.reports);
+        ret = -1;
+    }
+    else {
+        printf("    %d checkpoints and %d progress reports.\n",
+               log.calls, log.reports);
+    }
+
+    /* Resuming from a checkpoint in memory and from one in a file both
+       produce the same key as the key generation that was not stopped, also
+       when the leaves are computed in a pipeline. */
+    if (xmssmt_core_keypair_resumable(&params, pk2, sk2, log.saved, 0, 1,
+                                      NULL, NULL, NULL) ||
+        memcmp(pk, pk2, sizeof(pk)) || memcmp(sk, sk2, sizeof(sk))) {
+        printf("  X key resumed from the third checkpoint differs!\n");
+        ret = -1;
+    }
+    memset(sk2, 0, sizeof(sk2));
+    if (xmss_keygen_read_file(path, record, len) ||
+        xmssmt_core_keypair_resumable(&params, pk2, sk2, record, 0, 3,
+                                      NULL, NULL, NULL) ||
+        memcmp(pk, pk2, sizeof(pk)) || memcmp(sk, sk2, sizeof(sk))) {
+        printf("  X key resumed from the checkpoint file differs!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    resumed keys are identical.\n");
+    }
+
+    randombytes(m, XMSS_MLEN);
+    if (xmssmt_core_sign(&params, sk2, sm, &smlen, m, XMSS_MLEN) ||
+        xmssmt_core_sign_open(&params, mout, &mlen, sm, smlen, pk)) {
+        printf("  X signature by the resumed key does not verify!\n");
+        ret = -1;
+    }
+
+    /* A failing checkpoint stops the key generation, and corrupted records
+       are rejected. */
+    log.calls = 0;
+    log.fail_at = 2;
+    if (xmssmt_core_keypair_resumable(&params, pk2, sk2, NULL, XMSS_INTERVAL, 2,
+                                      keep_checkpoints, NULL, &log) != -1 ||
+        log.calls != 2) {
+        printf("  X key generation continued after a failed checkpoint!\n");
+        ret = -1;
+    }
+    record[0] = params.d;
+    if (xmssmt_core_keypair_resumable(&params, pk2, sk2, record, 0, 1,
+                                      NULL, NULL, NULL) != -1) {
+        printf("  X key generation accepted an invalid checkpoint!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    failed checkpoints and invalid records are handled.\n");
+    }
+
+    /* A lazy key holds the seeds and the top-layer state of a full key;
+       expanding it builds the rest of that key. */
+    printf("Testing %d signatures with a lazily generated key.. \n",
+           XMSS_LAZY_SIGNATURES);
+    memcpy(lazy_sk, sk, keys_bytes);
+    memcpy(lazy_sk + keys_bytes, sk + keys_bytes + (params.d - 1) * state_bytes,
+           state_bytes);
+    if (xmssmt_core_materialize(&params, sk2, lazy_sk) ||
+        memcmp(sk, sk2, sizeof(sk))) {
+        printf("  X expanded lazy key differs from the full key!\n");
+        ret = -1;
+    }
+
+    /* The signer of a lazy key builds the lower layers at its first
+       signature, after which it is the same as that of the expanded key. */
+    xmssmt_core_keypair_lazy(&params, pk, lazy_sk);
+    xmssmt_core_materialize(&params, sk, lazy_sk);
+    signer = xmss_signer_load_lazy(&params, lazy_sk);
+    if (signer != NULL) {
+        /* Persisting builds the layers as well, as an sk holds all of them. */
+        xmss_signer_persist(signer, sk_persisted);
+        xmss_signer_free(signer);
+    }
+    if (signer == NULL || memcmp(sk, sk_persisted, params.sk_bytes)) {
+        printf("  X persisted lazy key differs from the expanded key!\n");
+        ret = -1;
+    }
+    signer = xmss_signer_load_lazy(&params, lazy_sk);
+    if (signer == NULL ||
+        xmss_signer_layers(signer) != 1ULL << (params.d - 1)) {
+        printf("  X signer of the lazy key has more than the top layer!\n");
+        ret = -1;
+    }
+    for (i = 0; signer != NULL && i < XMSS_LAZY_SIGNATURES; i++) {
+        randombytes(m, XMSS_MLEN);
+        xmssmt_core_sign(&params, sk, sm, &smlen, m, XMSS_MLEN);
+        if (xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN) ||
+            xmss_signer_layers(signer) != (1ULL << params.d) - 1) {
+            printf("  X signer of the lazy key did not build its layers!\n");
+            ret = -1;
+            break;
+        }
+        if (smlen != smlen_signer || memcmp(sm, sm_signer, smlen) ||
+            xmssmt_core_sign_open(&params, mout, &mlen, sm, smlen, pk)) {
+            printf("  X signature #%d of the lazy key is invalid!\n", i);
+            ret = -1;
+            break;
+        }
+    }
+    if (signer != NULL) {
+        xmss_signer_persist(signer, sk_persisted);
+    }
+    if (signer == NULL || memcmp(sk, sk_persisted, params.sk_bytes)) {
+        printf("  X state of the lazy key differs after signing!\n");
+        ret = -1;
+    }
+    else if (ret == 0) {
+        printf("    lazy key of %llu rather than %llu bytes; signatures are "
+               "valid.\n", xmssmt_core_lazy_sk_bytes(&params), params.sk_bytes);
+    }
+    xmss_signer_free(signer);
+    free(sm_signer);
+    free(sk_persisted);
+    free(lazy_sk);
+
+    unlink(path);
+    free(log.saved);
+    free(record);
+    free(sm);
+    free(mout);
+
+    return ret;
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../xmss.h"
+#include "../xmss_commons.h"
+#include "../xmss_keystore.h"
+#include "../xmss_signer.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+#define XMSS_SIGNATURES 12
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_SIGN_OPEN xmssmt_sign_open
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_SIGN_OPEN xmss_sign_open
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+#endif
+
+int main()
+{
+    xmss_params params;
+    xmss_keystore *store;
+    xmss_signer *signer, *stale;
+    xmss_sk_range ranges[16];
+    uint32_t oid;
+    int ret = 0;
+    int count, i;
+    unsigned long long dirty, max_dirty = 0;
+    char path[64];
+    FILE *f;
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *sk_signer = malloc(params.sk_bytes);
+    unsigned char m[XMSS_MLEN];
+    unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen, mlen;
+    /* The sk part of a key pair file as written by ui/keypair. */
+    const unsigned long long offset = XMSS_OID_LEN + params.pk_bytes + XMSS_OID_LEN;
+
+    printf("Testing %s key store with %d signatures.. \n",
+           XMSS_VARIANT, XMSS_SIGNATURES);
+
+    XMSS_KEYPAIR(pk, sk, oid);
+    snprintf(path, sizeof(path), "/tmp/xmss_keystore_test_%d", (int)getpid());
+    f = fopen(path, "wb");
+    if (f == NULL ||
+        fwrite(pk, 1, sizeof(pk), f) != sizeof(pk) ||
+        fwrite(sk, 1, sizeof(sk), f) != sizeof(sk) || fclose(f)) {
+        printf("  X could not write key file!\n");
+        return -1;
+    }
+
+    store = xmss_keystore_open(path, offset, params.sk_bytes);
+    if (store == NULL ||
+        memcmp(xmss_keystore_sk(store), sk + XMSS_OID_LEN, params.sk_bytes)) {
+        printf("  X could not map the key!\n");
+        unlink(path);
+        return -1;
+    }
+    signer = xmss_signer_load(&params, xmss_keystore_sk(store));
+    /* A second signer of the same state, which falls behind. */
+    stale = xmss_signer_load(&params, xmss_keystore_sk(store));
+
+    /* Persist only the changed ranges after every signature. */
+    for (i = 0; i < XMSS_SIGNATURES && ret == 0; i++) {
+        randombytes(m, XMSS_MLEN);
+        xmss_signer_sign(signer, sm, &smlen, m, XMSS_MLEN);
+        if (XMSS_SIGN_OPEN(mout, &mlen, sm, smlen, pk)) {
+            printf("  X verification of signature #%d failed!\n", i);
+            ret = -1;
+        }
+        count = xmss_signer_persist_dirty(signer, xmss_keystore_sk(store),
+                                          ranges, 16);
+        if (count < 0 || xmss_keystore_sync(store, ranges, count)) {
+            printf("  X could not persist state after signature #%d!\n", i);
+            ret = -1;
+        }
+        for (dirty = 0; count > 0; count--) {
+            dirty += ranges[count - 1].len;
+        }
+        if (dirty > max_dirty) {
+            max_dirty = dirty;
+        }
+    }
+    xmss_keystore_close(store);
+
+    /* The state survives unmapping and mapping the file again. */
+    store = xmss_keystore_open(path, offset, params.sk_bytes);
+    xmss_signer_persist(signer, sk_signer);
+    if (ret == 0 &&
+        (store == NULL ||
+         bytes_to_ull(xmss_keystore_sk(store), params.index_bytes) != XMSS_SIGNATURES ||
+         memcmp(xmss_keystore_sk(store), sk_signer, params.sk_bytes))) {
+        printf("  X reloaded key differs from the signer!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    reloaded key holds the state; at most %llu of %llu bytes "
+               "changed per signature.\n", max_dirty, params.sk_bytes);
+    }
+
+    /* A signer that is behind the stored index may not write its state. */
+    if (ret == 0 &&
+        (xmss_signer_persist_dirty(stale, xmss_keystore_sk(store), ranges, 16) != -1 ||
+         memcmp(xmss_keystore_sk(store), sk_signer, params.sk_bytes))) {
+        printf("  X stale state was written to the key store!\n");
+        ret = -1;
+    }
+    else if (ret == 0) {
+        printf("    stale state is refused.\n");
+    }
+
+    xmss_keystore_close(store);
+    xmss_signer_free(signer);
+    xmss_signer_free(stale);
+    unlink(path);
+    free(sk_signer);
+    free(sm);
+    free(mout);
+
+    return ret;
+}
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../xmss_signer.h"
+#include "../xmss_commons.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+#define XMSS_LEASE_WINDOW 8
+#define XMSS_LEASE_SIGNATURES 20
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_SIGN xmssmt_sign
+    #define XMSS_SIGN_OPEN xmssmt_sign_open
+    /* Small subtrees, so that several tree boundaries are crossed. */
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+    #define XMSS_SIGNATURES 80
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_SIGN xmss_sign
+    #define XMSS_SIGN_OPEN xmss_sign_open
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+    #define XMSS_SIGNATURES 40
+#endif
+
+typedef struct {
+    unsigned char *record;
+    int calls;
+} lease_store;
+
+static int store_lease(void *ctx, const unsigned char *record,
+                       unsigned long long len)
+{
+    lease_store *store = ctx;
+
+    memcpy(store->record, record, len);
+    store->calls++;
+    return 0;
+}
+
+int main()
+{
+    xmss_params params;
+    xmss_signer *signer;
+    uint32_t oid;
+    int ret = 0;
+    int i;
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *sk_persisted = malloc(params.sk_bytes);
+    unsigned char *m = malloc(XMSS_MLEN);
+    unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *sm_signer = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen, smlen_signer;
+    unsigned long long mlen;
+    unsigned long long lease_start;
+    unsigned long long dirty, max_dirty = 0;
+    xmss_sk_range ranges[16];
+    int count;
+    lease_store store = {malloc(xmss_signer_lease_bytes(&params)), 0};
+
+    XMSS_KEYPAIR(pk, sk, oid);
+
+    signer = xmss_signer_load(&params, sk + XMSS_OID_LEN);
+    if (signer == NULL) {
+        printf("  X could not create signer!\n");
+        return -1;
+    }
+
+    printf("Testing %d %s signatures using an in-memory signer.. \n",
+           XMSS_SIGNATURES, XMSS_VARIANT);
+
+    /* Precompute WOTS chains for some (but not all) of the signatures. */
+    if (xmss_signer_set_precompute(signer, 4)) {
+        printf("  X could not allocate precomputation buffer!\n");
+        return -1;
+    }
+    /* Compute the leaves of the treehash updates on several threads. */
+    if (xmss_signer_set_threads(signer, 3)) {
+        printf("  X could not start threads!\n");
+        return -1;
+    }
+    /* Prepare the upper-layer WOTS signatures ahead of the tree boundaries. */
+    if (xmss_signer_set_smoothing(signer, 1)) {
+        printf("  X could not allocate smoothing tables!\n");
+        return -1;
+    }
+
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        randombytes(m, XMSS_MLEN);
+
+        if (i % 7 == 0) {
+            xmss_signer_precompute(signer);
+        }
+        /* Let a background thread advance the state for the second half. */
+        if (i == XMSS_SIGNATURES / 2 && xmss_signer_set_async(signer, 1)) {
+            printf("  X could not start background thread!\n");
+            ret = -1;
+            break;
+        }
+
+        XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
+        xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN);
+
+        if (smlen != smlen_signer || memcmp(sm, sm_signer, smlen)) {
+            printf("  X signature #%d differs from xmss[mt]_sign!\n", i);
+            ret = -1;
+            break;
+        }
+        if (XMSS_SIGN_OPEN(mout, &mlen, sm_signer, smlen_signer, pk)) {
+            printf("  X verification of signature #%d failed!\n", i);
+            ret = -1;
+            break;
+        }
+
+        /* The persisted state should match the byte-array key exactly, also
+           when only the changed ranges are written. */
+        if (i % 2 == 0) {
+            xmss_signer_persist(signer, sk_persisted);
+        }
+        else {
+            count = xmss_signer_persist_dirty(signer, sk_persisted, ranges, 16);
+            for (dirty = 0; count > 0; count--) {
+                dirty += ranges[count - 1].len;
+            }
+            if (dirty > max_dirty) {
+                max_dirty = dirty;
+            }
+        }
+        if (memcmp(sk_persisted, sk + XMSS_OID_LEN, params.sk_bytes)) {
+            printf("  X persisted sk differs after signature #%d!\n", i);
+            ret = -1;
+            break;
+        }
+    }
+    if (ret == 0) {
+        printf("    signatures and persisted state are identical.\n");
+        printf("    at most %llu of %llu bytes of the state changed per signature.\n",
+               max_dirty, params.sk_bytes);
+    }
+
+    /* A signer reloaded from its persisted state continues where it was. */
+    xmss_signer_free(signer);
+    signer = xmss_signer_load(&params, sk_persisted);
+    XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
+    xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN);
+    if (xmss_signer_index(signer) != XMSS_SIGNATURES + 1 ||
+        memcmp(sm, sm_signer, smlen)) {
+        printf("  X reloaded signer does not continue the key!\n");
+        ret = -1;
+    }
+    else {
+        printf("    reloaded signer continues the key.\n");
+    }
+
+    /* With lease-ahead persistence, the state is only persisted once per
+       window, and a signer restored from it skips the rest of the lease. */
+    lease_start = xmss_signer_index(signer);
+    if (xmss_signer_set_lease(signer, XMSS_LEASE_WINDOW, store_lease, &store)) {
+        printf("  X could not enable lease-ahead persistence!\n");
+        ret = -1;
+    }
+    for (i = 0; i < XMSS_LEASE_SIGNATURES && ret == 0; i++) {
+        randombytes(m, XMSS_MLEN);
+        XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
+        xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN);
+        if (memcmp(sm, sm_signer, smlen)) {
+            printf("  X signature #%d with lease differs!\n", i);
+            ret = -1;
+        }
+    }
+    if (ret == 0 &&
+        (store.calls != (XMSS_LEASE_SIGNATURES + XMSS_LEASE_WINDOW - 1) / XMSS_LEASE_WINDOW ||
+         xmss_signer_watermark(signer) != lease_start + store.calls * XMSS_LEASE_WINDOW)) {
+        printf("  X lease was persisted %d times, up to %llu!\n",
+               store.calls, xmss_signer_watermark(signer));
+        ret = -1;
+    }
+    xmss_signer_free(signer);
+    signer = xmss_signer_load_lease(&params, store.record);
+    while (ret == 0 && bytes_to_ull(sk + XMSS_OID_LEN, params.index_bytes) <
+                       lease_start + store.calls * XMSS_LEASE_WINDOW) {
+        XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
+    }
+    XMSS_SIGN(sk, sm, &smlen, m, XMSS_MLEN);
+    xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN);
+    if (ret == 0 && memcmp(sm, sm_signer, smlen)) {
+        printf("  X signer restored from lease does not continue the key!\n");
+        ret = -1;
+    }
+    else if (ret == 0) {
+        printf("    %d leases persisted; restored signer skips the rest.\n",
+               store.calls);
+    }
+
+    xmss_signer_free(signer);
+    signer = NULL;
+
+    /* A signer of a sub-key that is restored from a lease keeps its range. */
+    unsigned char *subkey = malloc(xmss_subkey_bytes(&params));
+    lease_start = bytes_to_ull(sk + XMSS_OID_LEN, params.index_bytes);
+    store.calls = 0;
+    if (ret == 0 &&
+        (xmssmt_core_subkey(&params, subkey, sk + XMSS_OID_LEN, lease_start,
+                            lease_start + XMSS_LEASE_WINDOW + 4) ||
+         (signer = xmss_signer_load_subkey(&params, subkey)) == NULL ||
+         xmss_signer_set_lease(signer, XMSS_LEASE_WINDOW, store_lease, &store))) {
+        printf("  X could not create sub-key signer!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        for (i = 0; i < 3; i++) {
+            xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN);
+        }
+        xmss_signer_free(signer);
+        signer = xmss_signer_load_lease(&params, store.record);
+        for (i = 0; i < 4 && ret == 0; i++) {
+            if (xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN) ||
+                bytes_to_ull(sm_signer, params.index_bytes) != lease_start + XMSS_LEASE_WINDOW + i ||
+                XMSS_SIGN_OPEN(mout, &mlen, sm_signer, smlen_signer, pk)) {
+                printf("  X restored sub-key signer failed to sign!\n");
+                ret = -1;
+            }
+        }
+        if (ret == 0 &&
+            xmss_signer_sign(signer, sm_signer, &smlen_signer, m, XMSS_MLEN) != -2) {
+            printf("  X restored sub-key signer signed beyond its range!\n");
+            ret = -1;
+        }
+        else if (ret == 0) {
+            printf("    restored sub-key signer stops at the end of its range.\n");
+        }
+    }
+
+    xmss_signer_free(signer);
+    free(subkey);
+    free(store.record);
+    free(sk_persisted);
+    free(m);
+    free(sm);
+    free(sm_signer);
+    free(mout);
+
+    return ret;
+}
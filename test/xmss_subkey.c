@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../xmss_commons.h"
+#include "../xmss_signer.h"
+#include "../params.h"
+#include "../randombytes.h"
+#include "../utils.h"
+
+#define XMSS_MLEN 32
+
+#ifdef XMSSMT
+    #define XMSS_PARSE_OID xmssmt_parse_oid
+    #define XMSS_STR_TO_OID xmssmt_str_to_oid
+    #define XMSS_KEYPAIR xmssmt_keypair
+    #define XMSS_SIGN xmssmt_sign
+    #define XMSS_SIGN_OPEN xmssmt_sign_open
+    #define XMSS_SUBKEY_SIGN xmssmt_subkey_sign
+    /* Small subtrees, so that the ranges cross tree boundaries. */
+    #define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+    #define XMSS_SIGNATURES 160
+    static const unsigned long long ranges[][2] = {{37, 70}, {96, 130}, {1000, 1030}};
+#else
+    #define XMSS_PARSE_OID xmss_parse_oid
+    #define XMSS_STR_TO_OID xmss_str_to_oid
+    #define XMSS_KEYPAIR xmss_keypair
+    #define XMSS_SIGN xmss_sign
+    #define XMSS_SIGN_OPEN xmss_sign_open
+    #define XMSS_SUBKEY_SIGN xmss_subkey_sign
+    #define XMSS_VARIANT "XMSS-SHA2_10_256"
+    #define XMSS_SIGNATURES 200
+    static const unsigned long long ranges[][2] = {{5, 20}, {130, 170}, {700, 720}};
+#endif
+
+int main()
+{
+    xmss_params params;
+    xmss_signer *signer;
+    uint32_t oid;
+    int ret = 0;
+    unsigned int r;
+    unsigned long long i, idx;
+
+    XMSS_STR_TO_OID(&oid, XMSS_VARIANT);
+    XMSS_PARSE_OID(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *subkey = malloc(XMSS_OID_LEN + xmss_subkey_bytes(&params));
+    unsigned char *overlap = malloc(xmss_subkey_bytes(&params));
+    unsigned char *m = malloc(XMSS_SIGNATURES * XMSS_MLEN);
+    unsigned char *sm = malloc(XMSS_SIGNATURES * (params.sig_bytes + XMSS_MLEN));
+    unsigned char *sm_sub = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen, smlen_sub, mlen;
+
+    XMSS_KEYPAIR(pk, sk, oid);
+    randombytes(m, XMSS_SIGNATURES * XMSS_MLEN);
+
+    /* Derive the sub-keys from a copy of the key, as the whole key produces
+       the reference signatures. */
+    unsigned char sk_fresh[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char sk_parent[XMSS_OID_LEN + params.sk_bytes];
+    memcpy(sk_fresh, sk, sizeof(sk_fresh));
+
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        XMSS_SIGN(sk, sm + i*(params.sig_bytes + XMSS_MLEN), &smlen,
+                  m + i*XMSS_MLEN, XMSS_MLEN);
+    }
+
+    for (r = 0; r < sizeof(ranges) / sizeof(ranges[0]) && ret == 0; r++) {
+        printf("Testing %s sub-key for [%llu, %llu).. \n",
+               XMSS_VARIANT, ranges[r][0], ranges[r][1]);
+
+        memcpy(subkey, sk_fresh, XMSS_OID_LEN);
+        if (xmssmt_core_subkey(&params, subkey + XMSS_OID_LEN,
+                               sk_fresh + XMSS_OID_LEN,
+                               ranges[r][0], ranges[r][1])) {
+            printf("  X could not derive sub-key!\n");
+            ret = -1;
+            break;
+        }
+
+        /* The key moves on past the range, so that neither a second sub-key
+           nor the key itself can sign in it. */
+        if (bytes_to_ull(sk_fresh + XMSS_OID_LEN, params.index_bytes) != ranges[r][1] ||
+            xmssmt_core_subkey(&params, overlap, sk_fresh + XMSS_OID_LEN,
+                               ranges[r][1] - 1, ranges[r][1] + 5) != -1) {
+            printf("  X derived an overlapping sub-key!\n");
+            ret = -1;
+            break;
+        }
+        memcpy(sk_parent, sk_fresh, sizeof(sk_parent));
+        idx = ranges[r][1];
+        XMSS_SIGN(sk_parent, sm_sub, &smlen_sub,
+                  m + (idx % XMSS_SIGNATURES)*XMSS_MLEN, XMSS_MLEN);
+        if (bytes_to_ull(sm_sub, params.index_bytes) != idx ||
+            XMSS_SIGN_OPEN(mout, &mlen, sm_sub, smlen_sub, pk) ||
+            (idx < XMSS_SIGNATURES &&
+             memcmp(sm_sub, sm + idx*(params.sig_bytes + XMSS_MLEN), smlen_sub))) {
+            printf("  X the key signed inside the range of its sub-key!\n");
+            ret = -1;
+            break;
+        }
+
+        /* Sign the first half with the byte-array sub-key, and the rest with
+           a signer that was loaded from it. */
+        signer = NULL;
+        for (idx = ranges[r][0]; idx < ranges[r][1]; idx++) {
+            const unsigned char *msg = m + (idx % XMSS_SIGNATURES)*XMSS_MLEN;
+
+            if (idx < (ranges[r][0] + ranges[r][1]) / 2) {
+                ret = XMSS_SUBKEY_SIGN(subkey, sm_sub, &smlen_sub, msg, XMSS_MLEN);
+            }
+            else {
+                if (signer == NULL) {
+                    signer = xmss_signer_load_subkey(&params, subkey + XMSS_OID_LEN);
+                }
+                ret = xmss_signer_sign(signer, sm_sub, &smlen_sub, msg, XMSS_MLEN);
+            }
+            if (ret) {
+                printf("  X signing with index %llu failed!\n", idx);
+                break;
+            }
+            if (bytes_to_ull(sm_sub, params.index_bytes) != idx ||
+                XMSS_SIGN_OPEN(mout, &mlen, sm_sub, smlen_sub, pk)) {
+                printf("  X verification of signature #%llu failed!\n", idx);
+                ret = -1;
+                break;
+            }
+            /* Sub-keys produce the signatures of the whole key. */
+            if (idx < XMSS_SIGNATURES &&
+                memcmp(sm_sub, sm + idx*(params.sig_bytes + XMSS_MLEN), smlen_sub)) {
+                printf("  X signature #%llu differs from the whole key!\n", idx);
+                ret = -1;
+                break;
+            }
+        }
+        if (ret == 0 && xmss_signer_sign(signer, sm_sub, &smlen_sub, m, XMSS_MLEN) != -2) {
+            printf("  X sub-key signed beyond the end of its range!\n");
+            ret = -1;
+        }
+        if (ret == 0) {
+            printf("    signatures verify and match the whole key.\n");
+        }
+        xmss_signer_free(signer);
+    }
+
+    /* Ranges that are empty or have already been used are refused. */
+    if (ret == 0 &&
+        (xmssmt_core_subkey(&params, subkey + XMSS_OID_LEN, sk + XMSS_OID_LEN, 10, 20) != -1 ||
+         xmssmt_core_subkey(&params, subkey + XMSS_OID_LEN, sk_fresh + XMSS_OID_LEN, 20, 20) != -1)) {
+        printf("  X derived a sub-key for an unavailable range!\n");
+        ret = -1;
+    }
+
+    free(subkey);
+    free(overlap);
+    free(m);
+    free(sm);
+    free(sm_sub);
+    free(mout);
+
+    return ret;
+}
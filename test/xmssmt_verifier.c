@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../xmss.h"
+#include "../xmss_core.h"
+#include "../xmss_verifier.h"
+#include "../params.h"
+#include "../randombytes.h"
+
+#define XMSS_MLEN 32
+/* Small subtrees, so that several tree boundaries are crossed. */
+#define XMSS_VARIANT "XMSSMT-SHA2_20/4_256"
+#define XMSS_SIGNATURES 40
+/* Fewer entries than would be needed to never evict any. */
+#define XMSS_CACHE 2
+/* Signers of the messages verified through a verifier cache, which holds
+   fewer verifiers than there are signers. */
+#define XMSS_KEYS 3
+#define XMSS_CACHE_KEYS 2
+#define XMSS_KEY_SIGNATURES 12
+
+/* Verifies with both the verifier and xmssmt_core_sign_open, and returns 0 if
+   both agree that the signature is valid, 1 if they agree that it is not,
+   and -1 if they disagree. */
+static int check(xmss_verifier *verifier, const xmss_params *params,
+                 unsigned char *sm, unsigned long long smlen,
+                 const unsigned char *pk, unsigned char *mout)
+{
+    unsigned long long mlen;
+    int a = xmss_verifier_open(verifier, mout, &mlen, sm, smlen);
+    int b = xmssmt_core_sign_open(params, mout, &mlen, sm, smlen, pk);
+
+    if ((a == 0) != (b == 0)) {
+        return -1;
+    }
+    return a == 0 ? 0 : 1;
+}
+
+int main()
+{
+    xmss_params params;
+    xmss_verifier *verifier;
+    uint32_t oid;
+    int ret = 0;
+    int i;
+    unsigned long long layers, skipped;
+
+    xmssmt_str_to_oid(&oid, XMSS_VARIANT);
+    xmssmt_parse_oid(&params, oid);
+
+    unsigned char pk[XMSS_OID_LEN + params.pk_bytes];
+    unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char *m = malloc(XMSS_MLEN);
+    unsigned char *sm = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned char *mout = malloc(params.sig_bytes + XMSS_MLEN);
+    unsigned long long smlen;
+    /* Offsets of the bottom auth path, and of the WOTS signature on layer 2. */
+    const unsigned long long auth0 = params.index_bytes + params.n + params.wots_sig_bytes;
+    const unsigned long long wots2 = params.index_bytes + params.n +
+        2 * (params.wots_sig_bytes + params.tree_height * params.n);
+
+    xmssmt_keypair(pk, sk, oid);
+    verifier = xmss_verifier_create(&params, pk + XMSS_OID_LEN, XMSS_CACHE);
+    if (verifier == NULL) {
+        printf("  X could not create verifier!\n");
+        return -1;
+    }
+
+    printf("Testing %d %s signatures using a caching verifier.. \n",
+           XMSS_SIGNATURES, XMSS_VARIANT);
+
+    for (i = 0; i < XMSS_SIGNATURES; i++) {
+        randombytes(m, XMSS_MLEN);
+        xmssmt_sign(sk, sm, &smlen, m, XMSS_MLEN);
+
+        if (check(verifier, &params, sm, smlen, pk + XMSS_OID_LEN, mout)) {
+            printf("  X signature #%d was not accepted!\n", i);
+            ret = -1;
+            break;
+        }
+        if (memcmp(mout, m, XMSS_MLEN)) {
+            printf("  X message #%d was not recovered!\n", i);
+            ret = -1;
+            break;
+        }
+
+        /* Modified signatures are rejected, also where the cache skips the
+           hashing of a layer. */
+        sm[auth0 + (i % (params.tree_height * params.n))] ^= 1;
+        if (check(verifier, &params, sm, smlen, pk + XMSS_OID_LEN, mout) != 1) {
+            printf("  X modified auth path #%d was not rejected!\n", i);
+            ret = -1;
+            break;
+        }
+        sm[auth0 + (i % (params.tree_height * params.n))] ^= 1;
+        sm[wots2 + i] ^= 1;
+        if (check(verifier, &params, sm, smlen, pk + XMSS_OID_LEN, mout) != 1) {
+            printf("  X modified upper layer #%d was not rejected!\n", i);
+            ret = -1;
+            break;
+        }
+        sm[wots2 + i] ^= 1;
+        sm[params.sig_bytes] ^= 1;
+        if (check(verifier, &params, sm, smlen, pk + XMSS_OID_LEN, mout) != 1) {
+            printf("  X modified message #%d was not rejected!\n", i);
+            ret = -1;
+            break;
+        }
+    }
+
+    xmss_verifier_stats(verifier, &layers, &skipped);
+    if (ret == 0 && skipped == 0) {
+        printf("  X no layers were skipped!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    results are identical to xmssmt_core_sign_open.\n");
+        printf("    verified %llu layers, skipped %llu.\n", layers, skipped);
+    }
+
+    /* A verifier cache accepts the signatures of each signer under its own
+       key only, also after its verifier was evicted. */
+    unsigned char *pks = malloc(XMSS_KEYS * (XMSS_OID_LEN + params.pk_bytes));
+    unsigned char *sks = malloc(XMSS_KEYS * (XMSS_OID_LEN + params.sk_bytes));
+    xmss_verifier_cache *cache = xmss_verifier_cache_create(1, XMSS_CACHE_KEYS,
+                                                            XMSS_CACHE);
+    unsigned long long mlen;
+    unsigned int k;
+
+    if (cache == NULL) {
+        printf("  X could not create verifier cache!\n");
+        ret = -1;
+    }
+    for (k = 0; k < XMSS_KEYS && ret == 0; k++) {
+        xmssmt_keypair(pks + k * (XMSS_OID_LEN + params.pk_bytes),
+                       sks + k * (XMSS_OID_LEN + params.sk_bytes), oid);
+    }
+    for (i = 0; i < XMSS_KEY_SIGNATURES && ret == 0; i++) {
+        k = i % XMSS_KEYS;
+        randombytes(m, XMSS_MLEN);
+        xmssmt_sign(sks + k * (XMSS_OID_LEN + params.sk_bytes),
+                    sm, &smlen, m, XMSS_MLEN);
+        if (xmss_verifier_cache_open(cache, mout, &mlen, sm, smlen,
+                                     pks + k * (XMSS_OID_LEN + params.pk_bytes)) ||
+            memcmp(mout, m, XMSS_MLEN)) {
+            printf("  X signature #%d by key %u was not accepted!\n", i, k);
+            ret = -1;
+        }
+        k = (k + 1) % XMSS_KEYS;
+        if (ret == 0 &&
+            !xmss_verifier_cache_open(cache, mout, &mlen, sm, smlen,
+                                      pks + k * (XMSS_OID_LEN + params.pk_bytes))) {
+            printf("  X signature #%d was accepted under key %u!\n", i, k);
+            ret = -1;
+        }
+    }
+    if (ret == 0 &&
+        xmss_verifier_cache_get(cache, pks) != xmss_verifier_cache_get(cache, pks)) {
+        printf("  X verifier cache did not return the cached verifier!\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        printf("    verifier cache of %d keys accepts signatures of %d signers.\n",
+               XMSS_CACHE_KEYS, XMSS_KEYS);
+    }
+
+    xmss_verifier_cache_free(cache);
+    free(pks);
+    free(sks);
+    xmss_verifier_free(verifier);
+    free(m);
+    free(sm);
+    free(mout);
+
+    return ret;
+}
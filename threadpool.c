@@ -0,0 +1,424 @@
+/* For pthread_setaffinity_np. */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "threadpool.h"
+
+/* A loop that is being run; its calls are the tasks. It lives on the stack
+   of the thread that runs it, until all of its calls have returned. */
+typedef struct {
+    threadpool_fn fn;
+    void *arg;
+    atomic_uint pending;
+} threadpool_loop;
+
+typedef struct {
+    threadpool_loop *loop;
+    unsigned int i;
+} threadpool_task;
+
+/* The deque of a worker, as a ring that grows when it is full. The owner
+   pushes and pops at the back; other threads steal from the front. */
+typedef struct {
+    pthread_mutex_t lock;
+    threadpool_task *tasks;
+    unsigned int capacity;
+    unsigned int front;
+    unsigned int back;
+} threadpool_deque;
+
+struct threadpool {
+    unsigned int threads;
+    pthread_t *workers;
+    /* The deques of the workers; the pool has room for ndeques workers, of
+       which threads - 1 have been started. */
+    threadpool_deque *deques;
+    unsigned int ndeques;
+    /* Idle threads sleep on wake until tasks are queued, a loop completes,
+       or the pool is stopped. queued counts the tasks in all deques. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_uint queued;
+    int stop;
+    /* The deque that the next loop from outside the pool starts at. */
+    atomic_uint rotate;
+    atomic_ullong tasks;
+    atomic_ullong steals;
+    atomic_ullong helps;
+    atomic_ullong busy_ns;
+    struct timespec created;
+};
+
+/* The worker that the current thread is, if any. */
+typedef struct {
+    threadpool *pool;
+    unsigned int index;
+} threadpool_worker_arg;
+
+static _Thread_local threadpool_worker_arg *current_worker;
+
+static _Atomic(threadpool *) shared_pool;
+
+static unsigned long long threadpool_ns(const struct timespec *t)
+{
+    return (unsigned long long)t->tv_sec * 1000000000ULL + t->tv_nsec;
+}
+
+/**
+ * Appends a task at the back of the deque. Returns -1 if the deque could not
+ * grow, 0 otherwise.
+ */
+static int deque_push(threadpool_deque *deque, threadpool_task task)
+{
+    threadpool_task *tasks;
+    unsigned int i, size;
+
+    pthread_mutex_lock(&deque->lock);
+    size = deque->back - deque->front;
+    if (size == deque->capacity) {
+        tasks = malloc(2 * deque->capacity * sizeof(threadpool_task));
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&deque->lock);
+            return -1;
+        }
+        for (i = 0; i < size; i++) {
+            tasks[i] = deque->tasks[(deque->front + i) & (deque->capacity - 1)];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity *= 2;
+        deque->front = 0;
+        deque->back = size;
+    }
+    deque->tasks[deque->back & (deque->capacity - 1)] = task;
+    deque->back++;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+/**
+ * Takes the task at the back (if own is set) or the front of the deque.
+ * Returns 0 if there was none.
+ */
+static int deque_take(threadpool_deque *deque, threadpool_task *task, int own)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->back != deque->front) {
+        if (own) {
+            deque->back--;
+            *task = deque->tasks[deque->back & (deque->capacity - 1)];
+        }
+        else {
+            *task = deque->tasks[deque->front & (deque->capacity - 1)];
+            deque->front++;
+        }
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/**
+ * Finds a task: from the back of the own deque of worker self (if self is
+ * below the number of workers), or else from the front of another one.
+ * Returns 0 if there was none.
+ */
+static int threadpool_take(threadpool *pool, unsigned int self,
+                           threadpool_task *task)
+{
+    const unsigned int workers = pool->threads - 1;
+    unsigned int i, start;
+
+    if (self < workers && deque_take(&pool->deques[self], task, 1)) {
+        atomic_fetch_sub(&pool->queued, 1);
+        return 1;
+    }
+    start = self < workers ? self + 1 : atomic_load(&pool->rotate);
+    for (i = 0; i < workers; i++) {
+        if (deque_take(&pool->deques[(start + i) % workers], task, 0)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            /* A thread outside the pool has no deque to steal for. */
+            atomic_fetch_add_explicit(self < workers ? &pool->steals : &pool->helps,
+                                      1, memory_order_relaxed);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Makes the call of a task, and wakes the thread that runs its loop if this
+ * was the last call. The loop may be gone once pending has reached 0.
+ */
+static void threadpool_execute(threadpool *pool, threadpool_task task)
+{
+    threadpool_loop *loop = task.loop;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    loop->fn(loop->arg, task.i);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    atomic_fetch_add_explicit(&pool->busy_ns,
+                              threadpool_ns(&end) - threadpool_ns(&start),
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->tasks, 1, memory_order_relaxed);
+
+    if (atomic_fetch_sub(&loop->pending, 1) == 1) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void *threadpool_worker(void *arg)
+{
+    threadpool_worker_arg *self = arg;
+    threadpool *pool = self->pool;
+    threadpool_task task;
+
+    current_worker = self;
+    for (;;) {
+        /* Sleep first, as the pool is still being set up when this starts. */
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        while (threadpool_take(pool, self->index, &task)) {
+            threadpool_execute(pool, task);
+        }
+    }
+    free(self);
+
+    return NULL;
+}
+
+threadpool *threadpool_create(unsigned int threads)
+{
+    return threadpool_create_affinity(threads, NULL, 0);
+}
+
+threadpool *threadpool_create_affinity(unsigned int threads,
+                                       const int *cpus, unsigned int ncpus)
+{
+    threadpool_worker_arg *self;
+    threadpool *pool;
+    unsigned int i;
+    int pinned = 1;
+
+#ifndef __linux__
+    if (ncpus > 0) {
+        return NULL;
+    }
+#endif
+    if (threads < 2) {
+        return NULL;
+    }
+    pool = calloc(1, sizeof(threadpool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = malloc((threads - 1) * sizeof(pthread_t));
+    pool->deques = calloc(threads - 1, sizeof(threadpool_deque));
+    if (pool->workers == NULL || pool->deques == NULL ||
+        pthread_mutex_init(&pool->lock, NULL)) {
+        free(pool->workers);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    pthread_cond_init(&pool->wake, NULL);
+    pool->ndeques = threads - 1;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->rotate, 0);
+    atomic_init(&pool->tasks, 0);
+    atomic_init(&pool->steals, 0);
+    atomic_init(&pool->helps, 0);
+    atomic_init(&pool->busy_ns, 0);
+    clock_gettime(CLOCK_MONOTONIC, &pool->created);
+    pool->threads = 1;
+
+    for (i = 0; i < threads - 1; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].capacity = 16;
+        pool->deques[i].tasks = malloc(16 * sizeof(threadpool_task));
+        self = malloc(sizeof(threadpool_worker_arg));
+        if (pool->deques[i].tasks == NULL || self == NULL) {
+            free(self);
+            break;
+        }
+        self->pool = pool;
+        self->index = i;
+        /* The deque of a worker exists before it starts, and before loops
+           can be distributed over it. */
+        if (pthread_create(&pool->workers[i], NULL, threadpool_worker, self)) {
+            free(self);
+            break;
+        }
+        pool->threads = i + 2;
+#ifdef __linux__
+        if (ncpus > 0) {
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i % ncpus], &set);
+            if (pthread_setaffinity_np(pool->workers[i], sizeof(set), &set)) {
+                pinned = 0;
+                break;
+            }
+        }
+#endif
+    }
+    /* Without all workers pinned, or without any workers, there is no pool.
+       Otherwise, it runs on the workers that could be started. */
+    if (!pinned || pool->threads < 2) {
+        threadpool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void threadpool_run(threadpool *pool, threadpool_fn fn, void *arg,
+                    unsigned int count)
+{
+    threadpool_loop loop;
+    threadpool_task task;
+    unsigned int i, self, start, workers;
+
+    if (pool == NULL || count < 2) {
+        for (i = 0; i < count; i++) {
+            fn(arg, i);
+        }
+        return;
+    }
+
+    workers = pool->threads - 1;
+    loop.fn = fn;
+    loop.arg = arg;
+    atomic_init(&loop.pending, count);
+
+    /* A worker keeps the calls in its own deque, for the others to steal.
+       Other threads spread them over all deques. */
+    if (current_worker != NULL && current_worker->pool == pool) {
+        self = current_worker->index;
+    }
+    else {
+        self = workers;
+    }
+    start = atomic_fetch_add(&pool->rotate, 1);
+    atomic_fetch_add(&pool->queued, count);
+    for (i = 0; i < count; i++) {
+        task.loop = &loop;
+        task.i = i;
+        if (deque_push(&pool->deques[self < workers ? self : (start + i) % workers], task)) {
+            /* Make the call here if it could not be queued. */
+            atomic_fetch_sub(&pool->queued, 1);
+            threadpool_execute(pool, task);
+        }
+    }
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    /* Help with any queued calls (not only of this loop) until it is done. */
+    while (atomic_load(&loop.pending) > 0) {
+        if (threadpool_take(pool, self, &task)) {
+            threadpool_execute(pool, task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&loop.pending) > 0 &&
+               atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+unsigned int threadpool_size(const threadpool *pool)
+{
+    return pool == NULL ? 1 : pool->threads;
+}
+
+void threadpool_get_stats(const threadpool *pool, threadpool_stats *stats)
+{
+    struct timespec now;
+
+    stats->threads = threadpool_size(pool);
+    stats->tasks = 0;
+    stats->steals = 0;
+    stats->helps = 0;
+    stats->busy = 0;
+    stats->elapsed = 0;
+    stats->utilization = 0;
+    if (pool == NULL) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    /* The counters are only read; atomic_load does not take const. */
+    stats->tasks = atomic_load((atomic_ullong *)&pool->tasks);
+    stats->steals = atomic_load((atomic_ullong *)&pool->steals);
+    stats->helps = atomic_load((atomic_ullong *)&pool->helps);
+    stats->busy = atomic_load((atomic_ullong *)&pool->busy_ns) / 1e9;
+    stats->elapsed = (threadpool_ns(&now) - threadpool_ns(&pool->created)) / 1e9;
+    if (stats->elapsed > 0) {
+        stats->utilization = stats->busy / (stats->elapsed * stats->threads);
+    }
+}
+
+void threadpool_free(threadpool *pool)
+{
+    unsigned int i, workers;
+
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    /* Workers that were started are the first threads - 1 entries. */
+    workers = pool->threads - 1;
+    for (i = 0; i < workers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    /* A deque may have been set up for a worker that did not start. */
+    for (i = 0; i < pool->ndeques && pool->deques[i].capacity > 0; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
+
+threadpool *threadpool_shared(void)
+{
+    return atomic_load(&shared_pool);
+}
+
+int threadpool_shared_configure(unsigned int threads,
+                                const int *cpus, unsigned int ncpus)
+{
+    threadpool *pool = NULL;
+
+    if (threads >= 2) {
+        pool = threadpool_create_affinity(threads, cpus, ncpus);
+    }
+    threadpool_free(atomic_exchange(&shared_pool, pool));
+    return threads >= 2 && pool == NULL ? -1 : 0;
+}
@@ -0,0 +1,96 @@
+#ifndef XMSS_THREADPOOL_H
+#define XMSS_THREADPOOL_H
+
+/* A work-stealing scheduler for data-parallel loops, such as computing
+   independent leaves or chains. Every worker has its own deque of tasks; it
+   takes tasks from the back of its own deque, and steals from the front of
+   the others' when it runs out. The thread that calls threadpool_run takes
+   part in the work until its loop is done, so a pool of n threads starts n-1
+   workers. Several threads (including workers) may run loops on the same
+   pool at once.
+
+   The library keeps one shared pool, which the parallel paths use when they
+   are not given a thread count of their own (see threadpool_shared). It runs
+   everything inline on the calling thread until it is configured. */
+
+typedef struct threadpool threadpool;
+
+/* A unit of work; called once for every index i in 0 .. count-1. */
+typedef void (*threadpool_fn)(void *arg, unsigned int i);
+
+/* Counters of the work that a pool has done since it was created. */
+typedef struct {
+    /* The number of threads that run loops on the pool (1 if inline). */
+    unsigned int threads;
+    /* The number of calls made through the pool; how many of them a worker
+       stole from the deque of another worker; and how many a thread outside
+       the pool took from the deques while it waited for its loop. */
+    unsigned long long tasks;
+    unsigned long long steals;
+    unsigned long long helps;
+    /* The time spent in calls, summed over all threads, and the time since
+       the pool was created, in seconds. */
+    double busy;
+    double elapsed;
+    /* busy / (elapsed * threads); the share of the pool that was in use.
+       This exceeds 1 if more threads than one at a time run loops on it. */
+    double utilization;
+} threadpool_stats;
+
+/**
+ * Creates a pool that runs loops on (up to) 'threads' threads, including the
+ * calling one. Returns NULL if threads < 2 (use no pool instead), or if the
+ * workers could not be started.
+ */
+threadpool *threadpool_create(unsigned int threads);
+
+/**
+ * Creates a pool as threadpool_create does, and pins worker i to the CPU
+ * cpus[i % ncpus] (if ncpus is not 0). The calling threads are not pinned.
+ * Returns NULL if a worker could not be pinned, or on platforms without
+ * thread affinity.
+ */
+threadpool *threadpool_create_affinity(unsigned int threads,
+                                       const int *cpus, unsigned int ncpus);
+
+/**
+ * Calls fn(arg, i) for all i in 0 .. count-1, distributed over the threads
+ * of the pool, and returns once all calls have returned. If pool is NULL,
+ * the calls are made in order by the calling thread.
+ */
+void threadpool_run(threadpool *pool, threadpool_fn fn, void *arg,
+                    unsigned int count);
+
+/**
+ * Returns the number of threads that run loops on the pool (1 for NULL).
+ */
+unsigned int threadpool_size(const threadpool *pool);
+
+/**
+ * Reads the counters of the pool. For NULL, these are all 0 (apart from
+ * threads, which is 1).
+ */
+void threadpool_get_stats(const threadpool *pool, threadpool_stats *stats);
+
+/**
+ * Stops the workers and releases the pool. No loops may be running on it.
+ */
+void threadpool_free(threadpool *pool);
+
+/**
+ * Returns the shared pool, or NULL if it runs inline (the default).
+ */
+threadpool *threadpool_shared(void);
+
+/**
+ * Replaces the shared pool by one with 'threads' threads, pinned to cpus as
+ * in threadpool_create_affinity (if ncpus is not 0). With threads < 2, the
+ * shared pool runs inline again. This must not be called while any loop is
+ * running on the shared pool.
+ * Returns -1 if the new pool could not be created (in which case the shared
+ * pool runs inline), 0 otherwise.
+ */
+int threadpool_shared_configure(unsigned int threads,
+                                const int *cpus, unsigned int ncpus);
+
+#endif
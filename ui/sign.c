@@ -1,10 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../params.h"
 #include "../xmss.h"
+#include "../xmss_commons.h"
 #include "../utils.h"
 
+/* The number of changed ranges of the secret key that are written back
+   separately; any further changes are merged into the last one. */
+#define XMSS_SK_RANGES 32
+
 #ifdef XMSSMT
     #define XMSS_PARSE_OID xmssmt_parse_oid
     #define XMSS_SIGN xmssmt_sign
@@ -76,20 +82,31 @@ int main(int argc, char **argv) {
     }
 
     unsigned char sk[XMSS_OID_LEN + params.sk_bytes];
+    unsigned char sk_before[XMSS_OID_LEN + params.sk_bytes];
     unsigned char *m = malloc(mlen);
     unsigned char *sm = malloc(params.sig_bytes + mlen);
     unsigned long long smlen;
+    xmss_sk_range ranges[XMSS_SK_RANGES];
+    unsigned int count, i;
+    long int sk_offset;
 
     /* fseek back to start of sk. */
     fseek(keypair_file, -((long int)XMSS_OID_LEN), SEEK_CUR);
+    sk_offset = ftell(keypair_file);
     fseek(m_file, 0, SEEK_SET);
     fread(sk, 1, XMSS_OID_LEN + params.sk_bytes, keypair_file);
     fread(m, 1, mlen, m_file);
+    memcpy(sk_before, sk, XMSS_OID_LEN + params.sk_bytes);
 
     XMSS_SIGN(sk, sm, &smlen, m, mlen);
 
-    fseek(keypair_file, -((long int)params.sk_bytes), SEEK_CUR);
-    fwrite(sk + XMSS_OID_LEN, 1, params.sk_bytes, keypair_file);
+    /* Only write back the parts of the state that have changed. */
+    count = xmss_sk_diff(ranges, XMSS_SK_RANGES, sk_before, sk,
+                         XMSS_OID_LEN + params.sk_bytes);
+    for (i = 0; i < count; i++) {
+        fseek(keypair_file, sk_offset + (long int)ranges[i].offset, SEEK_SET);
+        fwrite(sk + ranges[i].offset, 1, ranges[i].len, keypair_file);
+    }
     fwrite(sm, 1, smlen, stdout);
 
     fclose(keypair_file);
@@ -1,3 +1,6 @@
+#include <stddef.h>
+#include <stdint.h>
+
 #include "utils.h"
 
 /**
@@ -28,3 +31,31 @@ unsigned long long bytes_to_ull(const unsigned char *in, unsigned int inlen)
     }
     return retval;
 }
+
+unsigned long long xmss_ws_round(unsigned long long bytes)
+{
+    return (bytes + XMSS_WS_ALIGN - 1) & ~(unsigned long long)(XMSS_WS_ALIGN - 1);
+}
+
+void xmss_ws_init(xmss_workspace *ws, void *buf, unsigned long long size)
+{
+    unsigned long long skip = (XMSS_WS_ALIGN - (uintptr_t)buf % XMSS_WS_ALIGN)
+                              % XMSS_WS_ALIGN;
+
+    ws->base = (unsigned char *)buf + skip;
+    ws->size = size > skip ? size - skip : 0;
+    ws->used = 0;
+}
+
+void *xmss_ws_alloc(xmss_workspace *ws, unsigned long long bytes)
+{
+    void *block;
+
+    bytes = xmss_ws_round(bytes);
+    if (bytes > ws->size - ws->used) {
+        return NULL;
+    }
+    block = ws->base + ws->used;
+    ws->used += bytes;
+    return block;
+}
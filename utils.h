@@ -12,4 +12,37 @@ void ull_to_bytes(unsigned char *out, unsigned int outlen,
  */
 unsigned long long bytes_to_ull(const unsigned char *in, unsigned int inlen);
 
+/* Workspace allocations are aligned to this many bytes, i.e. a cache line. */
+#define XMSS_WS_ALIGN 64
+
+/* A caller-owned scratch arena. The *_ws variants of operations take their
+   temporary buffers from it rather than from the stack, so that they can run
+   on threads with small stacks, and do not allocate at all. The matching
+   *_workspace_size functions return how many bytes they need, counted from
+   an aligned start; a buffer that is not aligned to XMSS_WS_ALIGN needs up to
+   XMSS_WS_ALIGN - 1 bytes more. A workspace must not be used by two calls at
+   the same time. */
+typedef struct {
+    unsigned char *base;
+    unsigned long long size;
+    unsigned long long used;
+} xmss_workspace;
+
+/**
+ * Rounds a number of bytes up to a multiple of XMSS_WS_ALIGN.
+ */
+unsigned long long xmss_ws_round(unsigned long long bytes);
+
+/**
+ * Sets up a workspace on the 'size' bytes at buf, from its first aligned byte.
+ */
+void xmss_ws_init(xmss_workspace *ws, void *buf, unsigned long long size);
+
+/**
+ * Takes an aligned block of 'bytes' bytes from the workspace, or returns NULL
+ * if not enough is left. Blocks are released by restoring ws->used to the
+ * value it had before they were taken.
+ */
+void *xmss_ws_alloc(xmss_workspace *ws, unsigned long long bytes);
+
 #endif
@@ -52,6 +52,25 @@ static void gen_chain(const xmss_params *params,
     }
 }
 
+/**
+ * Computes the chaining function for all len chains; chain i (n bytes at
+ * in + i*n, written to out + i*n) is interpreted as the start[i]-th value of
+ * its chain, and advanced by steps[i]. out may equal in.
+ */
+static void gen_chains(const xmss_params *params,
+                       unsigned char *out, const unsigned char *in,
+                       const int *start, const int *steps,
+                       const unsigned char *pub_seed, uint32_t addr[8])
+{
+    uint32_t i;
+
+    for (i = 0; i < params->wots_len; i++) {
+        set_chain_addr(addr, i);
+        gen_chain(params, out + i*params->n, in + i*params->n,
+                  start[i], steps[i], pub_seed, addr);
+    }
+}
+
 /**
  * base_w algorithm as described in draft.
  * Interprets an array of bytes as integers in base w.
@@ -99,8 +118,8 @@ static void wots_checksum(const xmss_params *params,
 }
 
 /* Takes a message and derives the matching chain lengths. */
-static void chain_lengths(const xmss_params *params,
-                          int *lengths, const unsigned char *msg)
+void wots_chain_lengths(const xmss_params *params,
+                        int *lengths, const unsigned char *msg)
 {
     base_w(params, lengths, params->wots_len1, msg);
     wots_checksum(params, lengths + params->wots_len1, lengths);
@@ -118,16 +137,44 @@ void wots_pkgen(const xmss_params *params,
                 unsigned char *pk, const unsigned char *seed,
                 const unsigned char *pub_seed, uint32_t addr[8])
 {
+    unsigned char buf[wots_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    wots_pkgen_ws(params, pk, seed, pub_seed, addr, &ws);
+}
+
+unsigned long long wots_workspace_size(const xmss_params *params)
+{
+    return 2 * xmss_ws_round(params->wots_len * sizeof(int));
+}
+
+int wots_pkgen_ws(const xmss_params *params,
+                  unsigned char *pk, const unsigned char *seed,
+                  const unsigned char *pub_seed, uint32_t addr[8],
+                  xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    int *start, *steps;
     uint32_t i;
 
-    /* The WOTS+ private key is derived from the seed. */
-    expand_seed(params, pk, seed, pub_seed, addr);
+    if (ws->size - ws->used < wots_workspace_size(params)) {
+        return -1;
+    }
+    start = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
+    steps = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
 
     for (i = 0; i < params->wots_len; i++) {
-        set_chain_addr(addr, i);
-        gen_chain(params, pk + i*params->n, pk + i*params->n,
-                  0, params->wots_w - 1, pub_seed, addr);
+        start[i] = 0;
+        steps[i] = params->wots_w - 1;
     }
+
+    /* The WOTS+ private key is derived from the seed. */
+    expand_seed(params, pk, seed, pub_seed, addr);
+
+    gen_chains(params, pk, pk, start, steps, pub_seed, addr);
+    ws->used = mark;
+    return 0;
 }
 
 /**
@@ -139,19 +186,39 @@ void wots_sign(const xmss_params *params,
                const unsigned char *seed, const unsigned char *pub_seed,
                uint32_t addr[8])
 {
-    int lengths[params->wots_len];
+    unsigned char buf[wots_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    wots_sign_ws(params, sig, msg, seed, pub_seed, addr, &ws);
+}
+
+int wots_sign_ws(const xmss_params *params,
+                 unsigned char *sig, const unsigned char *msg,
+                 const unsigned char *seed, const unsigned char *pub_seed,
+                 uint32_t addr[8], xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    int *lengths, *start;
     uint32_t i;
 
-    chain_lengths(params, lengths, msg);
+    if (ws->size - ws->used < wots_workspace_size(params)) {
+        return -1;
+    }
+    lengths = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
+    start = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
+
+    wots_chain_lengths(params, lengths, msg);
+    for (i = 0; i < params->wots_len; i++) {
+        start[i] = 0;
+    }
 
     /* The WOTS+ private key is derived from the seed. */
     expand_seed(params, sig, seed, pub_seed, addr);
 
-    for (i = 0; i < params->wots_len; i++) {
-        set_chain_addr(addr, i);
-        gen_chain(params, sig + i*params->n, sig + i*params->n,
-                  0, lengths[i], pub_seed, addr);
-    }
+    gen_chains(params, sig, sig, start, lengths, pub_seed, addr);
+    ws->used = mark;
+    return 0;
 }
 
 /**
@@ -163,14 +230,133 @@ void wots_pk_from_sig(const xmss_params *params, unsigned char *pk,
                       const unsigned char *sig, const unsigned char *msg,
                       const unsigned char *pub_seed, uint32_t addr[8])
 {
-    int lengths[params->wots_len];
+    unsigned char buf[wots_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    wots_pk_from_sig_ws(params, pk, sig, msg, pub_seed, addr, &ws);
+}
+
+int wots_pk_from_sig_ws(const xmss_params *params, unsigned char *pk,
+                        const unsigned char *sig, const unsigned char *msg,
+                        const unsigned char *pub_seed, uint32_t addr[8],
+                        xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    int *lengths, *steps;
     uint32_t i;
 
-    chain_lengths(params, lengths, msg);
+    if (ws->size - ws->used < wots_workspace_size(params)) {
+        return -1;
+    }
+    lengths = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
+    steps = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
 
+    wots_chain_lengths(params, lengths, msg);
     for (i = 0; i < params->wots_len; i++) {
+        steps[i] = params->wots_w - 1 - lengths[i];
+    }
+
+    gen_chains(params, pk, sig, lengths, steps, pub_seed, addr);
+    ws->used = mark;
+    return 0;
+}
+
+/**
+ * Takes the value of chain i in a WOTS signature, at position 'length' (as
+ * derived by wots_chain_lengths), and computes the end of the chain; i.e.
+ * n bytes of the public key that wots_pk_from_sig computes.
+ */
+void wots_chain_from_sig(const xmss_params *params, unsigned char *out,
+                         const unsigned char *sig, uint32_t i, int length,
+                         const unsigned char *pub_seed, uint32_t addr[8])
+{
+    set_chain_addr(addr, i);
+    gen_chain(params, out, sig + i*params->n,
+              length, params->wots_w - 1 - length, pub_seed, addr);
+}
+
+/**
+ * Computes all w values of each of the len chains of the WOTS key pair at
+ * addr; i.e. the private key, every intermediate value and the public key.
+ * Value j of chain i is written to chains + (i*w + j)*n, so chains has to
+ * be an array of len * w * n bytes.
+ */
+void wots_chains_gen(const xmss_params *params,
+                     unsigned char *chains, const unsigned char *seed,
+                     const unsigned char *pub_seed, uint32_t addr[8])
+{
+    wots_chains_gen_range(params, chains, 0, params->wots_len,
+                          seed, pub_seed, addr);
+}
+
+/**
+ * As wots_chains_gen, but only computes the chains first .. first+count-1.
+ * This allows spreading the computation of a table over several calls.
+ */
+void wots_chains_gen_range(const xmss_params *params,
+                           unsigned char *chains,
+                           unsigned int first, unsigned int count,
+                           const unsigned char *seed,
+                           const unsigned char *pub_seed, uint32_t addr[8])
+{
+    unsigned char buf[params->n + 32];
+    unsigned char *chain;
+    uint32_t i, j;
+
+    memcpy(buf, pub_seed, params->n);
+    for (i = first; i < first + count && i < params->wots_len; i++) {
+        chain = chains + i * params->wots_w * params->n;
+
+        /* The private key of this chain is derived as in expand_seed. */
         set_chain_addr(addr, i);
-        gen_chain(params, pk + i*params->n, sig + i*params->n,
-                  lengths[i], params->wots_w - 1 - lengths[i], pub_seed, addr);
+        set_hash_addr(addr, 0);
+        set_key_and_mask(addr, 0);
+        addr_to_bytes(buf + params->n, addr);
+        prf_keygen(params, chain, buf, seed);
+
+        for (j = 1; j < params->wots_w; j++) {
+            gen_chain(params, chain + j*params->n, chain + (j-1)*params->n,
+                      j - 1, 1, pub_seed, addr);
+        }
+    }
+}
+
+/**
+ * Takes a n-byte message and the chains computed by wots_chains_gen to
+ * produce the same signature as wots_sign, by only copying chain values.
+ */
+void wots_sign_from_chains(const xmss_params *params,
+                           unsigned char *sig, const unsigned char *msg,
+                           const unsigned char *chains)
+{
+    unsigned char buf[wots_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    wots_sign_from_chains_ws(params, sig, msg, chains, &ws);
+}
+
+int wots_sign_from_chains_ws(const xmss_params *params,
+                             unsigned char *sig, const unsigned char *msg,
+                             const unsigned char *chains, xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    int *lengths;
+    uint32_t i;
+
+    if (ws->size - ws->used < wots_workspace_size(params)) {
+        return -1;
+    }
+    lengths = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
+
+    wots_chain_lengths(params, lengths, msg);
+
+    for (i = 0; i < params->wots_len; i++) {
+        memcpy(sig + i*params->n,
+               chains + (i*params->wots_w + lengths[i])*params->n,
+               params->n);
     }
+    ws->used = mark;
+    return 0;
 }
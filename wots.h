@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "params.h"
+#include "utils.h"
 
 /**
  * WOTS key generation. Takes a 32 byte seed for the private key, expands it to
@@ -34,4 +35,85 @@ void wots_pk_from_sig(const xmss_params *params, unsigned char *pk,
                       const unsigned char *sig, const unsigned char *msg,
                       const unsigned char *pub_seed, uint32_t addr[8]);
 
+/**
+ * Returns the size of the workspace that the _ws variants below take.
+ */
+unsigned long long wots_workspace_size(const xmss_params *params);
+
+/**
+ * As wots_pkgen, wots_sign and wots_pk_from_sig, with their temporary buffers
+ * taken from ws (of at least wots_workspace_size bytes) instead of the stack.
+ * Return -1 without computing anything if less than that is left in ws, and
+ * 0 otherwise.
+ */
+int wots_pkgen_ws(const xmss_params *params,
+                  unsigned char *pk, const unsigned char *seed,
+                  const unsigned char *pub_seed, uint32_t addr[8],
+                  xmss_workspace *ws);
+
+int wots_sign_ws(const xmss_params *params,
+                 unsigned char *sig, const unsigned char *msg,
+                 const unsigned char *seed, const unsigned char *pub_seed,
+                 uint32_t addr[8], xmss_workspace *ws);
+
+int wots_pk_from_sig_ws(const xmss_params *params, unsigned char *pk,
+                        const unsigned char *sig, const unsigned char *msg,
+                        const unsigned char *pub_seed, uint32_t addr[8],
+                        xmss_workspace *ws);
+
+/**
+ * Derives the positions of the values of a WOTS signature on the n-byte
+ * message msg in their chains, including those of the checksum.
+ * lengths has to hold wots_len integers.
+ */
+void wots_chain_lengths(const xmss_params *params,
+                        int *lengths, const unsigned char *msg);
+
+/**
+ * Computes the end of chain i from a WOTS signature, where length is the
+ * position of its value in the chain (see wots_chain_lengths). Calling this
+ * for all chains yields the public key that wots_pk_from_sig computes, one
+ * node at a time.
+ */
+void wots_chain_from_sig(const xmss_params *params, unsigned char *out,
+                         const unsigned char *sig, uint32_t i, int length,
+                         const unsigned char *pub_seed, uint32_t addr[8]);
+
+/**
+ * Computes all w values of each of the len chains of the WOTS key pair at
+ * addr; value j of chain i is written to chains + (i*w + j)*n.
+ * This allows signing ahead of knowing the message (see
+ * wots_sign_from_chains), at the cost of len * w * n bytes of storage.
+ */
+void wots_chains_gen(const xmss_params *params,
+                     unsigned char *chains, const unsigned char *seed,
+                     const unsigned char *pub_seed, uint32_t addr[8]);
+
+/**
+ * As wots_chains_gen, but only computes the chains first .. first+count-1,
+ * so that the table can be filled over several calls.
+ */
+void wots_chains_gen_range(const xmss_params *params,
+                           unsigned char *chains,
+                           unsigned int first, unsigned int count,
+                           const unsigned char *seed,
+                           const unsigned char *pub_seed, uint32_t addr[8]);
+
+/**
+ * Takes a n-byte message and the chains computed by wots_chains_gen, and
+ * places the signature at 'sig'. The result is identical to wots_sign.
+ */
+void wots_sign_from_chains(const xmss_params *params,
+                           unsigned char *sig, const unsigned char *msg,
+                           const unsigned char *chains);
+
+/**
+ * As wots_sign_from_chains, with its temporary buffer taken from ws (of at
+ * least wots_workspace_size bytes) instead of the stack. Returns -1 without
+ * signing if less than that is left in ws, and 0 otherwise.
+ */
+int wots_sign_from_chains_ws(const xmss_params *params,
+                             unsigned char *sig, const unsigned char *msg,
+                             const unsigned char *chains, xmss_workspace *ws);
+
 #endif
@@ -1,12 +1,30 @@
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "params.h"
+#include "xmss.h"
 #include "xmss_core.h"
+#include "xmss_commons.h"
+#include "threadpool.h"
+#include "utils.h"
 
 /* This file provides wrapper functions that take keys that include OIDs to
 identify the parameter set to be used. After setting the parameters accordingly
 it falls back to the regular XMSS core functions. */
 
+/* Reads the OID at the start of a pk or sk. */
+static uint32_t key_oid(const unsigned char *key)
+{
+    uint32_t oid = 0;
+    unsigned int i;
+
+    for (i = 0; i < XMSS_OID_LEN; i++) {
+        oid |= key[XMSS_OID_LEN - i - 1] << (i * 8);
+    }
+    return oid;
+}
+
 int xmss_keypair(unsigned char *pk, unsigned char *sk, const uint32_t oid)
 {
     xmss_params params;
@@ -30,12 +48,8 @@ int xmss_sign(unsigned char *sk,
               const unsigned char *m, unsigned long long mlen)
 {
     xmss_params params;
-    uint32_t oid = 0;
-    unsigned int i;
+    uint32_t oid = key_oid(sk);
 
-    for (i = 0; i < XMSS_OID_LEN; i++) {
-        oid |= sk[XMSS_OID_LEN - i - 1] << (i * 8);
-    }
     if (xmss_parse_oid(&params, oid)) {
         return -1;
     }
@@ -47,16 +61,84 @@ int xmss_sign_open(unsigned char *m, unsigned long long *mlen,
                    const unsigned char *pk)
 {
     xmss_params params;
-    uint32_t oid = 0;
+    uint32_t oid = key_oid(pk);
+
+    if (xmss_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmss_core_sign_open(&params, m, mlen, sm, smlen, pk + XMSS_OID_LEN);
+}
+
+int xmss_sign_batch(unsigned char *sk, unsigned char *sigs,
+                    const unsigned char * const *m,
+                    const unsigned long long *mlen, unsigned int count)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(sk);
+
+    if (xmss_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_sign_batch(&params, sk + XMSS_OID_LEN, sigs, m, mlen, count);
+}
+
+int xmss_sign_open_batch(const unsigned char *sig, unsigned long long siglen,
+                         const unsigned char *m, unsigned long long mlen,
+                         const unsigned char *pk)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(pk);
+
+    if (xmss_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_sign_open_batch(&params, sig, siglen, m, mlen, pk + XMSS_OID_LEN);
+}
+
+int xmss_verify_batch(int *status, const unsigned char * const *sm,
+                      const unsigned long long *smlen, unsigned int count,
+                      const unsigned char *pk, int parallel)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(pk);
     unsigned int i;
 
-    for (i = 0; i < XMSS_OID_LEN; i++) {
-        oid |= pk[XMSS_OID_LEN - i - 1] << (i * 8);
+    if (xmss_parse_oid(&params, oid)) {
+        for (i = 0; i < count; i++) {
+            status[i] = -1;
+        }
+        return -1;
     }
+    /* In parallel, the batch runs on the shared pool, rather than on threads
+       started for every batch. */
+    return xmssmt_core_verify_batch(&params, status, sm, smlen, count, pk + XMSS_OID_LEN,
+                                    parallel ? threadpool_shared() : NULL);
+}
+
+int xmss_subkey(unsigned char *subkey, unsigned char *sk,
+                unsigned long long start, unsigned long long end)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(sk);
+
     if (xmss_parse_oid(&params, oid)) {
         return -1;
     }
-    return xmss_core_sign_open(&params, m, mlen, sm, smlen, pk + XMSS_OID_LEN);
+    memcpy(subkey, sk, XMSS_OID_LEN);
+    return xmssmt_core_subkey(&params, subkey + XMSS_OID_LEN, sk + XMSS_OID_LEN, start, end);
+}
+
+int xmss_subkey_sign(unsigned char *subkey,
+                     unsigned char *sm, unsigned long long *smlen,
+                     const unsigned char *m, unsigned long long mlen)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(subkey);
+
+    if (xmss_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_subkey_sign(&params, subkey + XMSS_OID_LEN, sm, smlen, m, mlen);
 }
 
 int xmssmt_keypair(unsigned char *pk, unsigned char *sk, const uint32_t oid)
@@ -79,12 +161,8 @@ int xmssmt_sign(unsigned char *sk,
                 const unsigned char *m, unsigned long long mlen)
 {
     xmss_params params;
-    uint32_t oid = 0;
-    unsigned int i;
+    uint32_t oid = key_oid(sk);
 
-    for (i = 0; i < XMSS_OID_LEN; i++) {
-        oid |= sk[XMSS_OID_LEN - i - 1] << (i * 8);
-    }
     if (xmssmt_parse_oid(&params, oid)) {
         return -1;
     }
@@ -96,14 +174,191 @@ int xmssmt_sign_open(unsigned char *m, unsigned long long *mlen,
                      const unsigned char *pk)
 {
     xmss_params params;
-    uint32_t oid = 0;
+    uint32_t oid = key_oid(pk);
+
+    if (xmssmt_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_sign_open(&params, m, mlen, sm, smlen, pk + XMSS_OID_LEN);
+}
+
+int xmssmt_sign_batch(unsigned char *sk, unsigned char *sigs,
+                      const unsigned char * const *m,
+                      const unsigned long long *mlen, unsigned int count)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(sk);
+
+    if (xmssmt_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_sign_batch(&params, sk + XMSS_OID_LEN, sigs, m, mlen, count);
+}
+
+int xmssmt_sign_open_batch(const unsigned char *sig, unsigned long long siglen,
+                           const unsigned char *m, unsigned long long mlen,
+                           const unsigned char *pk)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(pk);
+
+    if (xmssmt_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_sign_open_batch(&params, sig, siglen, m, mlen, pk + XMSS_OID_LEN);
+}
+
+int xmssmt_verify_batch(int *status, const unsigned char * const *sm,
+                        const unsigned long long *smlen, unsigned int count,
+                        const unsigned char *pk, int parallel)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(pk);
     unsigned int i;
 
-    for (i = 0; i < XMSS_OID_LEN; i++) {
-        oid |= pk[XMSS_OID_LEN - i - 1] << (i * 8);
+    if (xmssmt_parse_oid(&params, oid)) {
+        for (i = 0; i < count; i++) {
+            status[i] = -1;
+        }
+        return -1;
     }
+    /* In parallel, the batch runs on the shared pool, rather than on threads
+       started for every batch. */
+    return xmssmt_core_verify_batch(&params, status, sm, smlen, count, pk + XMSS_OID_LEN,
+                                    parallel ? threadpool_shared() : NULL);
+}
+
+int xmssmt_subkey(unsigned char *subkey, unsigned char *sk,
+                  unsigned long long start, unsigned long long end)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(sk);
+
     if (xmssmt_parse_oid(&params, oid)) {
         return -1;
     }
-    return xmssmt_core_sign_open(&params, m, mlen, sm, smlen, pk + XMSS_OID_LEN);
+    memcpy(subkey, sk, XMSS_OID_LEN);
+    return xmssmt_core_subkey(&params, subkey + XMSS_OID_LEN, sk + XMSS_OID_LEN, start, end);
+}
+
+int xmssmt_subkey_sign(unsigned char *subkey,
+                       unsigned char *sm, unsigned long long *smlen,
+                       const unsigned char *m, unsigned long long mlen)
+{
+    xmss_params params;
+    uint32_t oid = key_oid(subkey);
+
+    if (xmssmt_parse_oid(&params, oid)) {
+        return -1;
+    }
+    return xmssmt_core_subkey_sign(&params, subkey + XMSS_OID_LEN, sm, smlen, m, mlen);
+}
+
+struct xmss_key {
+    xmss_params params;
+    /* The pk (with OID), or NULL. */
+    unsigned char *pk;
+    /* The caller's sk (with OID), or NULL. */
+    unsigned char *sk;
+    unsigned char *ws_buf;
+    unsigned long long ws_size;
+    xmss_workspace ws;
+};
+
+static xmss_key *key_create(const unsigned char *pk, unsigned char *sk,
+                            int xmssmt)
+{
+    xmss_key *key;
+    xmss_params params;
+    uint32_t oid;
+    unsigned long long size = 0;
+
+    if (pk == NULL && sk == NULL) {
+        return NULL;
+    }
+    oid = key_oid(pk != NULL ? pk : sk);
+    if ((sk != NULL && key_oid(sk) != oid) ||
+        (xmssmt ? xmssmt_parse_oid(&params, oid) :
+                  xmss_parse_oid(&params, oid))) {
+        return NULL;
+    }
+
+    key = calloc(1, sizeof(xmss_key));
+    if (key == NULL) {
+        return NULL;
+    }
+    key->params = params;
+    key->sk = sk;
+    if (sk != NULL) {
+        size = xmssmt_core_sign_workspace_size(&params);
+    }
+    if (pk != NULL) {
+        if (xmssmt_core_sign_open_workspace_size(&params) > size) {
+            size = xmssmt_core_sign_open_workspace_size(&params);
+        }
+        key->pk = malloc(XMSS_OID_LEN + params.pk_bytes);
+    }
+    key->ws_size = size + XMSS_WS_ALIGN;
+    key->ws_buf = malloc(key->ws_size);
+    if (key->ws_buf == NULL || (pk != NULL && key->pk == NULL)) {
+        xmss_key_free(key);
+        return NULL;
+    }
+    if (pk != NULL) {
+        memcpy(key->pk, pk, XMSS_OID_LEN + params.pk_bytes);
+    }
+    xmss_ws_init(&key->ws, key->ws_buf, key->ws_size);
+    return key;
+}
+
+xmss_key *xmss_key_create(const unsigned char *pk, unsigned char *sk)
+{
+    return key_create(pk, sk, 0);
+}
+
+xmss_key *xmssmt_key_create(const unsigned char *pk, unsigned char *sk)
+{
+    return key_create(pk, sk, 1);
+}
+
+const xmss_params *xmss_key_params(const xmss_key *key)
+{
+    return &key->params;
+}
+
+int xmss_key_sign(xmss_key *key,
+                  unsigned char *sm, unsigned long long *smlen,
+                  const unsigned char *m, unsigned long long mlen)
+{
+    if (key->sk == NULL) {
+        return -1;
+    }
+    /* For XMSS, xmss_core_sign is xmssmt_core_sign as well. */
+    return xmssmt_core_sign_ws(&key->params, key->sk + XMSS_OID_LEN,
+                               sm, smlen, m, mlen, &key->ws);
+}
+
+int xmss_key_sign_open(xmss_key *key,
+                       unsigned char *m, unsigned long long *mlen,
+                       const unsigned char *sm, unsigned long long smlen)
+{
+    if (key->pk == NULL) {
+        return -1;
+    }
+    return xmssmt_core_sign_open_ws(&key->params, m, mlen, sm, smlen,
+                                    key->pk + XMSS_OID_LEN, &key->ws);
+}
+
+void xmss_key_free(xmss_key *key)
+{
+    if (key == NULL) {
+        return;
+    }
+    /* Signing leaves WOTS chain values of the sk in the workspace. */
+    if (key->ws_buf != NULL) {
+        memset(key->ws_buf, 0, key->ws_size);
+    }
+    free(key->ws_buf);
+    free(key->pk);
+    free(key);
 }
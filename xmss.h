@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "params.h"
+
 /**
  * Generates a XMSS key pair for a given parameter set.
  * Format sk: [OID || (32bit) idx || SK_SEED || SK_PRF || PUB_SEED || root]
@@ -31,6 +33,59 @@ int xmss_sign_open(unsigned char *m, unsigned long long *mlen,
                    const unsigned char *sm, unsigned long long smlen,
                    const unsigned char *pk);
 
+/**
+ * Signs count messages using a single one-time key of an XMSS secret key,
+ * by signing the root of a Merkle tree over the randomized message hashes.
+ * For each message j, writes a detached signature (i.e. without the message)
+ * to sigs + j * xmss_batch_sig_bytes(params, count), where params are those
+ * of the key's OID (see xmss_commons.h).
+ * Updates the secret key, as xmss_sign does.
+ */
+int xmss_sign_batch(unsigned char *sk, unsigned char *sigs,
+                    const unsigned char * const *m,
+                    const unsigned long long *mlen, unsigned int count);
+
+/**
+ * Verifies a signature produced by xmss_sign_batch for message m.
+ * Returns 0 if the signature is valid, -1 otherwise.
+ */
+int xmss_sign_open_batch(const unsigned char *sig, unsigned long long siglen,
+                         const unsigned char *m, unsigned long long mlen,
+                         const unsigned char *pk);
+
+/**
+ * Verifies count signed messages under the same public key. If parallel is
+ * not 0, the signatures are verified on the shared pool (see threadpool.h),
+ * whose size sets the number of threads; otherwise, one after another on the
+ * calling thread. No threads are started per call; to use a pool of its own,
+ * a caller uses xmssmt_core_verify_batch. Writes 0 to status[j] if sm[j] (of
+ * smlen[j] bytes) is valid and -1 otherwise. The OID of pk is only parsed
+ * once for the batch.
+ * Returns 0 if all signatures are valid, -1 otherwise.
+ */
+int xmss_verify_batch(int *status, const unsigned char * const *sm,
+                      const unsigned long long *smlen, unsigned int count,
+                      const unsigned char *pk, int parallel);
+
+/**
+ * Derives a sub-key for the one-time keys start .. end-1 of an XMSS secret
+ * key, which can sign independently of sk and of other sub-keys. The sub-key
+ * has XMSS_OID_LEN + xmss_subkey_bytes(params) bytes (see xmss_commons.h) and
+ * verifies under the public key of sk. The index of sk is advanced to end, so
+ * that it does not sign in the range; store sk before using the sub-key.
+ * Returns -1 if the range is not available.
+ */
+int xmss_subkey(unsigned char *subkey, unsigned char *sk,
+                unsigned long long start, unsigned long long end);
+
+/**
+ * Signs a message using a sub-key, as xmss_sign does with a secret key.
+ * Returns -2 if all one-time keys of the sub-key have been used.
+ */
+int xmss_subkey_sign(unsigned char *subkey,
+                     unsigned char *sm, unsigned long long *smlen,
+                     const unsigned char *m, unsigned long long mlen);
+
 /*
  * Generates a XMSSMT key pair for a given parameter set.
  * Format sk: [OID || (ceil(h/8) bit) idx || SK_SEED || SK_PRF || PUB_SEED || root]
@@ -58,4 +113,105 @@ int xmssmt_sign(unsigned char *sk,
 int xmssmt_sign_open(unsigned char *m, unsigned long long *mlen,
                      const unsigned char *sm, unsigned long long smlen,
                      const unsigned char *pk);
+
+/**
+ * Signs count messages using a single one-time key of an XMSSMT secret key,
+ * by signing the root of a Merkle tree over the randomized message hashes.
+ * For each message j, writes a detached signature (i.e. without the message)
+ * to sigs + j * xmss_batch_sig_bytes(params, count), where params are those
+ * of the key's OID (see xmss_commons.h).
+ * Updates the secret key, as xmssmt_sign does.
+ */
+int xmssmt_sign_batch(unsigned char *sk, unsigned char *sigs,
+                      const unsigned char * const *m,
+                      const unsigned long long *mlen, unsigned int count);
+
+/**
+ * Verifies a signature produced by xmssmt_sign_batch for message m.
+ * Returns 0 if the signature is valid, -1 otherwise.
+ */
+int xmssmt_sign_open_batch(const unsigned char *sig, unsigned long long siglen,
+                           const unsigned char *m, unsigned long long mlen,
+                           const unsigned char *pk);
+
+/**
+ * Verifies count signed messages under the same public key. If parallel is
+ * not 0, the signatures are verified on the shared pool (see threadpool.h),
+ * whose size sets the number of threads; otherwise, one after another on the
+ * calling thread. No threads are started per call; to use a pool of its own,
+ * a caller uses xmssmt_core_verify_batch. Writes 0 to status[j] if sm[j] (of
+ * smlen[j] bytes) is valid and -1 otherwise. The OID of pk is only parsed
+ * once for the batch.
+ * Returns 0 if all signatures are valid, -1 otherwise.
+ */
+int xmssmt_verify_batch(int *status, const unsigned char * const *sm,
+                        const unsigned long long *smlen, unsigned int count,
+                        const unsigned char *pk, int parallel);
+
+/**
+ * Derives a sub-key for the one-time keys start .. end-1 of an XMSSMT secret
+ * key, which can sign independently of sk and of other sub-keys. The sub-key
+ * has XMSS_OID_LEN + xmss_subkey_bytes(params) bytes (see xmss_commons.h) and
+ * verifies under the public key of sk. The index of sk is advanced to end, so
+ * that it does not sign in the range; store sk before using the sub-key.
+ * Returns -1 if the range is not available.
+ */
+int xmssmt_subkey(unsigned char *subkey, unsigned char *sk,
+                  unsigned long long start, unsigned long long end);
+
+/**
+ * Signs a message using a sub-key, as xmssmt_sign does with a secret key.
+ * Returns -2 if all one-time keys of the sub-key have been used.
+ */
+int xmssmt_subkey_sign(unsigned char *subkey,
+                       unsigned char *sm, unsigned long long *smlen,
+                       const unsigned char *m, unsigned long long mlen);
+
+/* A key handle holds the parameters of a key's OID, parsed and validated
+   once, and the scratch memory for signing and verifying with the key. Calls
+   through a handle neither parse the OID nor derive any sizes, and do not
+   put buffers that depend on the parameters on the stack. A handle works for
+   both XMSS and XMSSMT keys, and is not thread-safe; use one per thread. */
+
+typedef struct xmss_key xmss_key;
+
+/**
+ * Creates a handle for an XMSS key pair, or for one half of it if the other
+ * is NULL. pk (with OID) is copied. sk (with OID) is not: signing through
+ * the handle updates it in place, as xmss_sign does, so it has to remain
+ * valid until the handle is freed. If both are given, their OIDs must match.
+ * Returns NULL if the OID is unknown or memory could not be allocated.
+ */
+xmss_key *xmss_key_create(const unsigned char *pk, unsigned char *sk);
+
+/**
+ * Creates a handle for an XMSSMT key pair, as xmss_key_create does.
+ */
+xmss_key *xmssmt_key_create(const unsigned char *pk, unsigned char *sk);
+
+/**
+ * Returns the parameters of the key, e.g. for params->sig_bytes.
+ */
+const xmss_params *xmss_key_params(const xmss_key *key);
+
+/**
+ * Signs a message as xmss[mt]_sign does with the sk of the handle.
+ * Returns -1 if the handle has no sk.
+ */
+int xmss_key_sign(xmss_key *key,
+                  unsigned char *sm, unsigned long long *smlen,
+                  const unsigned char *m, unsigned long long mlen);
+
+/**
+ * Verifies a signed message as xmss[mt]_sign_open does with the pk of the
+ * handle. Returns -1 if the signature is invalid or the handle has no pk.
+ */
+int xmss_key_sign_open(xmss_key *key,
+                       unsigned char *m, unsigned long long *mlen,
+                       const unsigned char *sm, unsigned long long smlen);
+
+/**
+ * Erases the scratch memory and releases the handle (but not its sk).
+ */
+void xmss_key_free(xmss_key *key);
 #endif
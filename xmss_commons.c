@@ -8,6 +8,7 @@
 #include "wots.h"
 #include "utils.h"
 #include "xmss_commons.h"
+#include "xmss_core.h"
 
 /**
  * Computes a leaf node from a WOTS public key using an L-tree.
@@ -19,19 +20,16 @@ static void l_tree(const xmss_params *params,
 {
     unsigned int l = params->wots_len;
     unsigned int parent_nodes;
-    uint32_t i;
     uint32_t height = 0;
 
     set_tree_height(addr, height);
 
     while (l > 1) {
         parent_nodes = l >> 1;
-        for (i = 0; i < parent_nodes; i++) {
-            set_tree_index(addr, i);
-            /* Hashes the nodes at (i*2)*params->n and (i*2)*params->n + 1 */
-            thash_h(params, wots_pk + i*params->n,
-                           wots_pk + (i*2)*params->n, pub_seed, addr);
-        }
+        /* Hashes the nodes at (i*2)*params->n and (i*2)*params->n + 1 into
+           node i, for all pairs of the level at once. */
+        set_tree_index(addr, 0);
+        thash_h_batch(params, wots_pk, wots_pk, parent_nodes, pub_seed, addr);
         /* If the row contained an odd number of nodes, the last node was not
            hashed. Instead, we pull it up to the next layer. */
         if (l & 1) {
@@ -49,15 +47,121 @@ static void l_tree(const xmss_params *params,
 }
 
 /**
- * Computes a root node given a leaf and an auth path
+ * Returns the number of levels of an L-tree, i.e. ceil(log2(wots_len)).
+ */
+static unsigned int ltree_levels(const xmss_params *params)
+{
+    unsigned int width = params->wots_len;
+    unsigned int levels = 0;
+
+    while (width > 1) {
+        width = (width + 1) >> 1;
+        levels++;
+    }
+    return levels;
+}
+
+/**
+ * Returns where node idx on level j of an L-tree with the given number of
+ * levels goes in leaf_from_sig: the leaf, or the slot next to its sibling.
+ */
+static unsigned char *ltree_slot(const xmss_params *params,
+                                 unsigned char *leaf, unsigned char *pending,
+                                 unsigned int levels,
+                                 unsigned int j, uint32_t idx)
+{
+    if (j == levels) {
+        return leaf;
+    }
+    return pending + (2*j + (idx & 1))*params->n;
+}
+
+/**
+ * Computes the leaf node of a WOTS key pair from a signature on msg, as
+ * wots_pk_from_sig followed by l_tree does, but without the buffer for the
+ * public key: every chain end is hashed into the L-tree as soon as its
+ * sibling is known. This keeps one pair of nodes per level of the L-tree
+ * (ceil(log2(wots_len)) levels), rather than wots_len nodes.
+ */
+static void leaf_from_sig(const xmss_params *params, unsigned char *leaf,
+                          const unsigned char *sig, const unsigned char *msg,
+                          const unsigned char *pub_seed,
+                          uint32_t ots_addr[8], uint32_t ltree_addr[8],
+                          xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    const unsigned int levels = ltree_levels(params);
+    int *lengths = xmss_ws_alloc(ws, params->wots_len * sizeof(int));
+    unsigned int *widths = xmss_ws_alloc(ws, (levels + 1) * sizeof(unsigned int));
+    /* The left and right child of the pending parent on each level. */
+    unsigned char *pending = xmss_ws_alloc(ws, (2*levels + 1)*params->n);
+    unsigned char *parent;
+    uint32_t i, idx;
+    unsigned int j;
+
+    /* The number of nodes on each level; an odd one out is pulled up. */
+    widths[0] = params->wots_len;
+    for (j = 0; j < levels; j++) {
+        widths[j + 1] = (widths[j] + 1) >> 1;
+    }
+
+    wots_chain_lengths(params, lengths, msg);
+
+    for (i = 0; i < params->wots_len; i++) {
+        wots_chain_from_sig(params, ltree_slot(params, leaf, pending, levels,
+                                               0, i),
+                            sig, i, lengths[i], pub_seed, ots_addr);
+
+        /* Move the new node up for as long as its parent is complete. */
+        for (j = 0, idx = i; j < levels; j++, idx >>= 1) {
+            parent = ltree_slot(params, leaf, pending, levels, j + 1, idx >> 1);
+            if (idx & 1) {
+                set_tree_height(ltree_addr, j);
+                set_tree_index(ltree_addr, idx >> 1);
+                thash_h(params, parent, pending + 2*j*params->n,
+                        pub_seed, ltree_addr);
+            }
+            else if (idx == widths[j] - 1) {
+                memcpy(parent, pending + 2*j*params->n, params->n);
+            }
+            else {
+                break;
+            }
+        }
+    }
+    ws->used = mark;
+}
+
+/* The workspace that leaf_from_sig takes. */
+static unsigned long long leaf_from_sig_workspace_size(const xmss_params *params)
+{
+    const unsigned int levels = ltree_levels(params);
+
+    return xmss_ws_round(params->wots_len * sizeof(int)) +
+           xmss_ws_round((levels + 1) * sizeof(unsigned int)) +
+           xmss_ws_round((2*levels + 1)*params->n);
+}
+
+/**
+ * Computes the node at the given height above a leaf from the leaf and the
+ * first 'height' nodes of its auth path. For height = tree_height, this is
+ * the root of the tree.
  */
 static void compute_root(const xmss_params *params, unsigned char *root,
                          const unsigned char *leaf, unsigned long leafidx,
-                         const unsigned char *auth_path,
-                         const unsigned char *pub_seed, uint32_t addr[8])
+                         const unsigned char *auth_path, unsigned int height,
+                         const unsigned char *pub_seed, uint32_t addr[8],
+                         xmss_workspace *ws)
 {
+    const unsigned long long mark = ws->used;
     uint32_t i;
-    unsigned char buffer[2*params->n];
+    unsigned char *buffer;
+
+    if (height == 0) {
+        memcpy(root, leaf, params->n);
+        return;
+    }
+    buffer = xmss_ws_alloc(ws, 2*params->n);
 
     /* If leafidx is odd (last bit = 1), current path element is a right child
        and auth_path has to go left. Otherwise it is the other way around. */
@@ -71,7 +175,7 @@ static void compute_root(const xmss_params *params, unsigned char *root,
     }
     auth_path += params->n;
 
-    for (i = 0; i < params->tree_height - 1; i++) {
+    for (i = 0; i < height - 1; i++) {
         set_tree_height(addr, i);
         leafidx >>= 1;
         set_tree_index(addr, leafidx);
@@ -89,13 +193,13 @@ static void compute_root(const xmss_params *params, unsigned char *root,
     }
 
     /* The last iteration is exceptional; we do not copy an auth_path node. */
-    set_tree_height(addr, params->tree_height - 1);
+    set_tree_height(addr, height - 1);
     leafidx >>= 1;
     set_tree_index(addr, leafidx);
     thash_h(params, root, buffer, pub_seed, addr);
+    ws->used = mark;
 }
 
-
 /**
  * Computes the leaf at a given address. First generates the WOTS key pair,
  * then computes leaf using l_tree. As this happens position independent, we
@@ -105,11 +209,225 @@ void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
                    const unsigned char *sk_seed, const unsigned char *pub_seed,
                    uint32_t ltree_addr[8], uint32_t ots_addr[8])
 {
-    unsigned char pk[params->wots_sig_bytes];
+    unsigned char buf[xmss_leaf_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    gen_leaf_wots_ws(params, leaf, sk_seed, pub_seed, ltree_addr, ots_addr, &ws);
+}
+
+unsigned long long xmss_leaf_workspace_size(const xmss_params *params)
+{
+    return xmss_ws_round(params->wots_sig_bytes) + wots_workspace_size(params);
+}
 
-    wots_pkgen(params, pk, sk_seed, pub_seed, ots_addr);
+int gen_leaf_wots_ws(const xmss_params *params, unsigned char *leaf,
+                     const unsigned char *sk_seed,
+                     const unsigned char *pub_seed,
+                     uint32_t ltree_addr[8], uint32_t ots_addr[8],
+                     xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    unsigned char *pk;
+
+    if (ws->size - ws->used < xmss_leaf_workspace_size(params)) {
+        return -1;
+    }
+    pk = xmss_ws_alloc(ws, params->wots_sig_bytes);
+
+    wots_pkgen_ws(params, pk, sk_seed, pub_seed, ots_addr, ws);
 
     l_tree(params, leaf, pk, pub_seed, ltree_addr);
+    ws->used = mark;
+    return 0;
+}
+
+/* The leaves of a window that are computed concurrently on a pool. */
+typedef struct {
+    const xmss_params *params;
+    unsigned char *nodes;
+    const unsigned char *sk_seed;
+    const unsigned char *pub_seed;
+    uint32_t start;
+    const uint32_t *subtree_addr;
+} window_job;
+
+/**
+ * Computes leaf i of a window; called from threadpool_run.
+ */
+static void window_leaf(void *arg, unsigned int i)
+{
+    const window_job *job = arg;
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+
+    copy_subtree_addr(ots_addr, job->subtree_addr);
+    copy_subtree_addr(ltree_addr, job->subtree_addr);
+    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+    set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
+    set_ltree_addr(ltree_addr, job->start + i);
+    set_ots_addr(ots_addr, job->start + i);
+    gen_leaf_wots(job->params, job->nodes + i*job->params->n,
+                  job->sk_seed, job->pub_seed, ltree_addr, ots_addr);
+}
+
+/**
+ * Computes the 2^height leaves of the tree at subtree_addr from leaf 'start'
+ * on (a multiple of 2^height), and hashes them level by level, with one
+ * batched call per level, into the node at that height. The nodes are kept
+ * in 'nodes' (2^height * n bytes); the result is in its first n bytes.
+ * Nodes on the auth path of leaf_idx are copied to auth_path, if not NULL.
+ * The leaves are computed on the shared pool, if there is one.
+ */
+static void treehash_window(const xmss_params *params, unsigned char *nodes,
+                            unsigned char *auth_path, uint32_t leaf_idx,
+                            const unsigned char *sk_seed,
+                            const unsigned char *pub_seed,
+                            uint32_t start, unsigned int height,
+                            const uint32_t subtree_addr[8],
+                            xmss_workspace *ws)
+{
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+    uint32_t node_addr[8] = {0};
+    uint32_t width = (uint32_t)1 << height;
+    uint32_t i, sibling;
+    unsigned int level;
+    threadpool *pool = threadpool_shared();
+
+    copy_subtree_addr(ots_addr, subtree_addr);
+    copy_subtree_addr(ltree_addr, subtree_addr);
+    copy_subtree_addr(node_addr, subtree_addr);
+    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+    set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
+    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
+
+    /* On the shared pool, the leaves are computed concurrently, and the
+       threads use their own stacks rather than ws. */
+    if (pool != NULL) {
+        window_job job = {params, nodes, sk_seed, pub_seed, start, subtree_addr};
+        threadpool_run(pool, window_leaf, &job, width);
+    }
+    else {
+        for (i = 0; i < width; i++) {
+            set_ltree_addr(ltree_addr, start + i);
+            set_ots_addr(ots_addr, start + i);
+            gen_leaf_wots_ws(params, nodes + i*params->n,
+                             sk_seed, pub_seed, ltree_addr, ots_addr, ws);
+        }
+    }
+
+    for (level = 0; ; level++) {
+        /* If a node on this level is needed for the auth path.. */
+        sibling = (leaf_idx >> level) ^ 0x1;
+        if (auth_path != NULL && level < params->tree_height &&
+            sibling >= (start >> level) && sibling < (start >> level) + width) {
+            memcpy(auth_path + level*params->n,
+                   nodes + (sibling - (start >> level))*params->n, params->n);
+        }
+        if (level == height) {
+            break;
+        }
+        width >>= 1;
+        set_tree_height(node_addr, level);
+        set_tree_index(node_addr, start >> (level + 1));
+        thash_h_batch(params, nodes, nodes, width, pub_seed, node_addr);
+    }
+}
+
+/* The height of the windows that xmss_treehash uses for a given height. */
+static unsigned int treehash_window_height(unsigned int height)
+{
+    return height < XMSS_TREEHASH_WINDOW ? height : XMSS_TREEHASH_WINDOW;
+}
+
+void xmss_treehash(const xmss_params *params,
+                   unsigned char *node, unsigned char *auth_path,
+                   uint32_t leaf_idx,
+                   const unsigned char *sk_seed, const unsigned char *pub_seed,
+                   uint32_t start, unsigned int height,
+                   const uint32_t subtree_addr[8])
+{
+    unsigned char buf[xmss_treehash_workspace_size(params, height) +
+                      XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    xmss_treehash_ws(params, node, auth_path, leaf_idx, sk_seed, pub_seed,
+                     start, height, subtree_addr, &ws);
+}
+
+unsigned long long xmss_treehash_workspace_size(const xmss_params *params,
+                                                unsigned int height)
+{
+    const unsigned int window = treehash_window_height(height);
+
+    return xmss_ws_round(((unsigned long long)1 << window)*params->n) +
+           xmss_ws_round((height - window + 1)*params->n) +
+           xmss_ws_round((height - window + 1)*sizeof(unsigned int)) +
+           xmss_leaf_workspace_size(params);
+}
+
+int xmss_treehash_ws(const xmss_params *params,
+                     unsigned char *node, unsigned char *auth_path,
+                     uint32_t leaf_idx,
+                     const unsigned char *sk_seed,
+                     const unsigned char *pub_seed,
+                     uint32_t start, unsigned int height,
+                     const uint32_t subtree_addr[8], xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    const unsigned int window = treehash_window_height(height);
+    unsigned char *nodes, *stack;
+    unsigned int *heights;
+    unsigned int offset = 0;
+    uint32_t node_addr[8] = {0};
+    uint32_t idx, tree_idx;
+
+    if (ws->size - ws->used < xmss_treehash_workspace_size(params, height)) {
+        return -1;
+    }
+    nodes = xmss_ws_alloc(ws, ((unsigned long long)1 << window)*params->n);
+    stack = xmss_ws_alloc(ws, (height - window + 1)*params->n);
+    heights = xmss_ws_alloc(ws, (height - window + 1)*sizeof(unsigned int));
+
+    copy_subtree_addr(node_addr, subtree_addr);
+    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
+
+    for (idx = start; idx < start + ((uint32_t)1 << height);
+         idx += (uint32_t)1 << window) {
+        /* Add the node at the top of the next window to the stack. */
+        treehash_window(params, nodes, auth_path, leaf_idx, sk_seed, pub_seed,
+                        idx, window, subtree_addr, ws);
+        memcpy(stack + offset*params->n, nodes, params->n);
+        heights[offset] = window;
+        offset++;
+
+        /* While the top-most nodes are of equal height.. */
+        while (offset >= 2 && heights[offset - 1] == heights[offset - 2]) {
+            /* Compute index of the new node, in the next layer. */
+            tree_idx = (idx >> (heights[offset - 1] + 1));
+
+            /* Hash the top-most nodes from the stack together. */
+            set_tree_height(node_addr, heights[offset - 1]);
+            set_tree_index(node_addr, tree_idx);
+            thash_h(params, stack + (offset-2)*params->n,
+                           stack + (offset-2)*params->n, pub_seed, node_addr);
+            offset--;
+            /* Note that the top-most node is now one layer higher. */
+            heights[offset - 1]++;
+
+            /* If this is a node we need for the auth path.. */
+            if (auth_path != NULL && heights[offset - 1] < params->tree_height &&
+                ((leaf_idx >> heights[offset - 1]) ^ 0x1) == tree_idx) {
+                memcpy(auth_path + heights[offset - 1]*params->n,
+                       stack + (offset - 1)*params->n, params->n);
+            }
+        }
+    }
+    memcpy(node, stack, params->n);
+    ws->used = mark;
+    return 0;
 }
 
 // void gen_leaf_pots(const xmss_params *params, unsigned char *leaf,
@@ -127,6 +445,69 @@ void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
 // }
 
 
+/**
+ * Computes the node at the given height above leaf 'leaf' of a tree, as
+ * xmss_subtree_root does for the root; the auth path in sig only needs to
+ * hold the first 'height' nodes.
+ */
+static void subtree_node(const xmss_params *params, unsigned char *node,
+                         const unsigned char *sig, const unsigned char *msg,
+                         unsigned int layer, unsigned long long tree,
+                         uint32_t leaf, unsigned int height,
+                         const unsigned char *pub_seed, xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    unsigned char *leaf_node = xmss_ws_alloc(ws, params->n);
+
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+    uint32_t node_addr[8] = {0};
+
+    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+    set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
+    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
+
+    set_layer_addr(ots_addr, layer);
+    set_layer_addr(ltree_addr, layer);
+    set_layer_addr(node_addr, layer);
+
+    set_tree_addr(ltree_addr, tree);
+    set_tree_addr(ots_addr, tree);
+    set_tree_addr(node_addr, tree);
+
+    /* The leaf node is only correct if the WOTS signature was correct. */
+    set_ots_addr(ots_addr, leaf);
+    set_ltree_addr(ltree_addr, leaf);
+    leaf_from_sig(params, leaf_node, sig, msg, pub_seed, ots_addr, ltree_addr,
+                  ws);
+    sig += params->wots_sig_bytes;
+
+    /* Compute the node at the given height of this subtree. */
+    compute_root(params, node, leaf_node, leaf, sig, height, pub_seed,
+                 node_addr, ws);
+    ws->used = mark;
+}
+
+/* The workspace that subtree_node takes. */
+static unsigned long long subtree_node_workspace_size(const xmss_params *params)
+{
+    return xmss_ws_round(params->n) + xmss_ws_round(2*params->n) +
+           leaf_from_sig_workspace_size(params);
+}
+
+void xmss_subtree_root(const xmss_params *params, unsigned char *root,
+                       const unsigned char *sig, const unsigned char *msg,
+                       unsigned int layer, unsigned long long tree,
+                       uint32_t leaf, const unsigned char *pub_seed)
+{
+    unsigned char buf[subtree_node_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    subtree_node(params, root, sig, msg, layer, tree, leaf,
+                 params->tree_height, pub_seed, &ws);
+}
+
 /**
  * Verifies a given message signature pair under a given public key.
  * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
@@ -151,24 +532,51 @@ int xmssmt_core_sign_open(const xmss_params *params,
                           unsigned char *m, unsigned long long *mlen,
                           const unsigned char *sm, unsigned long long smlen,
                           const unsigned char *pk)
+{
+    unsigned char buf[xmssmt_core_sign_open_workspace_size(params) +
+                      XMSS_WS_ALIGN];
+    xmss_workspace ws;
+    xmss_params seeded = *params;
+    xmss_seed_ctx *seed = NULL;
+    int ret;
+
+    /* The hash state of PUB_SEED takes a few allocations, which pay off over
+       the hundreds of keys and masks of a single signature. */
+    if (params->seed_ctx == NULL) {
+        seed = xmss_seed_ctx_create(params, pk + params->n);
+        seeded.seed_ctx = seed;
+    }
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    ret = xmssmt_core_sign_open_ws(&seeded, m, mlen, sm, smlen, pk, &ws);
+    xmss_seed_ctx_free(seed);
+    return ret;
+}
+
+unsigned long long xmssmt_core_sign_open_workspace_size(const xmss_params *params)
+{
+    return xmss_ws_round(params->n) + subtree_node_workspace_size(params);
+}
+
+int xmssmt_core_sign_open_ws(const xmss_params *params,
+                             unsigned char *m, unsigned long long *mlen,
+                             const unsigned char *sm, unsigned long long smlen,
+                             const unsigned char *pk, xmss_workspace *ws)
 {
     const unsigned char *pub_root = pk;
     const unsigned char *pub_seed = pk + params->n;
-    unsigned char wots_pk[params->wots_sig_bytes];
-    unsigned char leaf[params->n];
-    unsigned char root[params->n];
-    unsigned char *mhash = root;
+    const unsigned long long mark = ws->used;
+    unsigned char *root;
+    unsigned char *mhash;
     unsigned long long idx = 0;
     unsigned int i;
     uint32_t idx_leaf;
 
-    uint32_t ots_addr[8] = {0};
-    uint32_t ltree_addr[8] = {0};
-    uint32_t node_addr[8] = {0};
-
-    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
-    set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
-    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
+    if (ws->size - ws->used < xmssmt_core_sign_open_workspace_size(params)) {
+        *mlen = 0;
+        return -1;
+    }
+    root = xmss_ws_alloc(ws, params->n);
+    mhash = root;
 
     *mlen = smlen - params->sig_bytes;
 
@@ -190,28 +598,11 @@ int xmssmt_core_sign_open(const xmss_params *params,
         idx_leaf = (idx & ((1 << params->tree_height)-1));
         idx = idx >> params->tree_height;
 
-        set_layer_addr(ots_addr, i);
-        set_layer_addr(ltree_addr, i);
-        set_layer_addr(node_addr, i);
-
-        set_tree_addr(ltree_addr, idx);
-        set_tree_addr(ots_addr, idx);
-        set_tree_addr(node_addr, idx);
-
-        /* The WOTS public key is only correct if the signature was correct. */
-        set_ots_addr(ots_addr, idx_leaf);
         /* Initially, root = mhash, but on subsequent iterations it is the root
            of the subtree below the currently processed subtree. */
-        wots_pk_from_sig(params, wots_pk, sm, root, pub_seed, ots_addr);
-        sm += params->wots_sig_bytes;
-
-        /* Compute the leaf node using the WOTS public key. */
-        set_ltree_addr(ltree_addr, idx_leaf);
-        l_tree(params, leaf, wots_pk, pub_seed, ltree_addr);
-
-        /* Compute the root node of this subtree. */
-        compute_root(params, root, leaf, idx_leaf, sm, pub_seed, node_addr);
-        sm += params->tree_height*params->n;
+        subtree_node(params, root, sm, root, i, idx, idx_leaf,
+                     params->tree_height, pub_seed, ws);
+        sm += params->wots_sig_bytes + params->tree_height*params->n;
     }
 
     /* Check if the root node equals the root node in the public key. */
@@ -219,11 +610,534 @@ int xmssmt_core_sign_open(const xmss_params *params,
         /* If not, zero the message */
         memset(m, 0, *mlen);
         *mlen = 0;
+        ws->used = mark;
         return -1;
     }
+    ws->used = mark;
 
     /* If verification was successful, copy the message from the signature. */
     memcpy(m, sm, *mlen);
 
     return 0;
 }
+
+/**
+ * Returns the number of levels of the message tree of a batch of count
+ * messages, i.e. the number of nodes in the inclusion path of a message.
+ */
+static unsigned int batch_height(unsigned int count)
+{
+    unsigned int height = 0;
+
+    while ((1ULL << height) < count) {
+        height++;
+    }
+    return height;
+}
+
+unsigned long long xmss_batch_sig_bytes(const xmss_params *params,
+                                        unsigned int count)
+{
+    return params->sig_bytes + 8 + (1 + batch_height(count)) * params->n;
+}
+
+/**
+ * Computes the leaf of the message tree for message j of a batch; i.e. the
+ * randomized message hash H_msg(R || root || j || m). The buffer buf needs
+ * room for the message and the prefix, as described at hash_message.
+ */
+static void batch_leaf(const xmss_params *params, unsigned char *leaf,
+                       const unsigned char *R, const unsigned char *pub_root,
+                       unsigned int j,
+                       const unsigned char *m, unsigned long long mlen,
+                       unsigned char *buf)
+{
+    memcpy(buf + params->padding_len + 3*params->n, m, mlen);
+    hash_message(params, leaf, R, pub_root, j, buf, mlen);
+}
+
+/**
+ * Signs count messages with a single one-time key, by signing the root of a
+ * Merkle tree over their randomized hashes.
+ * Writes xmss_batch_sig_bytes(params, count) bytes for each message to sigs:
+ * [XMSS(MT) signature on (count || root) || count || j || R_j || path_j]
+ * The root is signed in the XMSS_MSG_BATCH_ROOT domain of the message hash,
+ * so the signature is not a regular signature on (count || root).
+ * where the path holds the sibling of the message's node on every level of
+ * the tree (or zero bytes where it has none, as the last node of a level
+ * with an odd number of nodes is pulled up without hashing).
+ * Unlike xmss[mt]_core_sign, the messages are not included in the output.
+ */
+int xmssmt_core_sign_batch(const xmss_params *params, unsigned char *sk,
+                           unsigned char *sigs,
+                           const unsigned char * const *m,
+                           const unsigned long long *mlen,
+                           unsigned int count)
+{
+    const unsigned char *sk_prf = sk + params->index_bytes + params->n;
+    const unsigned char *pub_root = sk + params->index_bytes + 2*params->n;
+    const unsigned char *pub_seed = sk + params->index_bytes + 3*params->n;
+    const unsigned long long sig_bytes = xmss_batch_sig_bytes(params, count);
+    unsigned char prf_in[32];
+    unsigned char batch_root[4 + params->n];
+    unsigned char *nodes, *buf, *sm, *sig;
+    xmss_params root_params;
+    unsigned long long idx, maxlen = 0, smlen;
+    unsigned int i, j, level, width, pos;
+    uint32_t node_addr[8] = {0};
+    int ret;
+
+    if (count == 0) {
+        return -1;
+    }
+    for (j = 0; j < count; j++) {
+        if (mlen[j] > maxlen) {
+            maxlen = mlen[j];
+        }
+    }
+
+    nodes = malloc(count * params->n);
+    buf = malloc(params->padding_len + 3*params->n + maxlen);
+    sm = malloc(params->sig_bytes + sizeof(batch_root));
+    if (nodes == NULL || buf == NULL || sm == NULL) {
+        free(nodes);
+        free(buf);
+        free(sm);
+        return -1;
+    }
+
+    /* The index of the one-time key that will sign the batch. */
+    idx = bytes_to_ull(sk, params->index_bytes);
+
+    for (j = 0; j < count; j++) {
+        sig = sigs + j*sig_bytes;
+        ull_to_bytes(sig + params->sig_bytes, 4, count);
+        ull_to_bytes(sig + params->sig_bytes + 4, 4, j);
+
+        /* R_j = PRF(SK_PRF, 1 || j || idx). The leading 1 separates these
+           from the R of a regular signature, which is PRF(SK_PRF, idx). */
+        ull_to_bytes(prf_in, 8, 1);
+        ull_to_bytes(prf_in + 8, 8, j);
+        ull_to_bytes(prf_in + 16, 16, idx);
+        prf(params, sig + params->sig_bytes + 8, prf_in, sk_prf);
+
+        batch_leaf(params, nodes + j*params->n, sig + params->sig_bytes + 8,
+                   pub_root, j, m[j], mlen[j], buf);
+    }
+
+    set_tree_addr(node_addr, idx);
+    set_type(node_addr, XMSS_ADDR_TYPE_BATCH);
+
+    /* Build the tree level by level, in place, as in l_tree. */
+    width = count;
+    for (level = 0; width > 1; level++) {
+        for (j = 0; j < count; j++) {
+            sig = sigs + j*sig_bytes + params->sig_bytes + 8 + (1 + level)*params->n;
+            pos = (j >> level) ^ 1;
+            if (pos < width) {
+                memcpy(sig, nodes + pos*params->n, params->n);
+            }
+            else {
+                memset(sig, 0, params->n);
+            }
+        }
+
+        set_tree_height(node_addr, level);
+        for (i = 0; i < (width >> 1); i++) {
+            set_tree_index(node_addr, i);
+            thash_h(params, nodes + i*params->n,
+                    nodes + (i*2)*params->n, pub_seed, node_addr);
+        }
+        if (width & 1) {
+            memcpy(nodes + (width >> 1)*params->n,
+                   nodes + (width - 1)*params->n, params->n);
+            width = (width >> 1) + 1;
+        }
+        else {
+            width = width >> 1;
+        }
+    }
+
+    /* The number of messages determines the shape of the tree, so it is
+       signed along with the root, in the message hash domain of batches. */
+    ull_to_bytes(batch_root, 4, count);
+    memcpy(batch_root + 4, nodes, params->n);
+    root_params = *params;
+    root_params.msg_domain = XMSS_MSG_BATCH_ROOT;
+    ret = xmssmt_core_sign(&root_params, sk, sm, &smlen,
+                           batch_root, sizeof(batch_root));
+    if (ret == 0) {
+        for (j = 0; j < count; j++) {
+            memcpy(sigs + j*sig_bytes, sm, params->sig_bytes);
+        }
+    }
+
+    free(nodes);
+    free(buf);
+    free(sm);
+    return ret;
+}
+
+/**
+ * Verifies a signature produced by xmssmt_core_sign_batch for message m.
+ * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
+ */
+int xmssmt_core_sign_open_batch(const xmss_params *params,
+                                const unsigned char *sig,
+                                unsigned long long siglen,
+                                const unsigned char *m,
+                                unsigned long long mlen,
+                                const unsigned char *pk)
+{
+    const unsigned char *pub_root = pk;
+    const unsigned char *pub_seed = pk + params->n;
+    const unsigned char *R, *path;
+    unsigned char buffer[2*params->n];
+    unsigned char node[params->n];
+    unsigned char *buf, *sm;
+    unsigned long long idx, smlen, batch_root_len;
+    unsigned int count, j, level, width, pos;
+    uint32_t node_addr[8] = {0};
+    xmss_params root_params;
+    int ret;
+
+    if (siglen < params->sig_bytes + 8) {
+        return -1;
+    }
+    count = bytes_to_ull(sig + params->sig_bytes, 4);
+    j = bytes_to_ull(sig + params->sig_bytes + 4, 4);
+    if (count == 0 || j >= count ||
+        siglen != xmss_batch_sig_bytes(params, count)) {
+        return -1;
+    }
+    idx = bytes_to_ull(sig, params->index_bytes);
+    R = sig + params->sig_bytes + 8;
+    path = R + params->n;
+
+    buf = malloc(params->padding_len + 3*params->n + mlen);
+    /* Room for [signature || count || root], and for the opened message. */
+    sm = malloc(2 * (params->sig_bytes + 4 + params->n));
+    if (buf == NULL || sm == NULL) {
+        free(buf);
+        free(sm);
+        return -1;
+    }
+    batch_leaf(params, node, R, pub_root, j, m, mlen, buf);
+
+    set_tree_addr(node_addr, idx);
+    set_type(node_addr, XMSS_ADDR_TYPE_BATCH);
+
+    width = count;
+    pos = j;
+    for (level = 0; width > 1; level++) {
+        /* Without a sibling, the node is pulled up to the next level. */
+        if ((pos ^ 1) < width) {
+            if (pos & 1) {
+                memcpy(buffer, path, params->n);
+                memcpy(buffer + params->n, node, params->n);
+            }
+            else {
+                memcpy(buffer, node, params->n);
+                memcpy(buffer + params->n, path, params->n);
+            }
+            set_tree_height(node_addr, level);
+            set_tree_index(node_addr, pos >> 1);
+            thash_h(params, node, buffer, pub_seed, node_addr);
+        }
+        path += params->n;
+        pos >>= 1;
+        width = (width + 1) >> 1;
+    }
+
+    /* Verify the signature on (count || root), as a batch root. */
+    smlen = params->sig_bytes + 4 + params->n;
+    memcpy(sm, sig, params->sig_bytes);
+    ull_to_bytes(sm + params->sig_bytes, 4, count);
+    memcpy(sm + params->sig_bytes + 4, node, params->n);
+    root_params = *params;
+    root_params.msg_domain = XMSS_MSG_BATCH_ROOT;
+    ret = xmssmt_core_sign_open(&root_params, sm + smlen, &batch_root_len,
+                                sm, smlen, pk);
+
+    free(buf);
+    free(sm);
+    return ret;
+}
+
+unsigned long long xmss_subkey_bytes(const xmss_params *params)
+{
+    return params->sk_bytes + params->index_bytes;
+}
+
+/**
+ * Deletes the secret key part of a sub-key, as xmss[mt]_core_sign deletes a
+ * secret key after its last one-time key.
+ */
+static void subkey_wipe(const xmss_params *params, unsigned char *subkey)
+{
+    memset(subkey, 0xFF, params->index_bytes);
+    memset(subkey + params->index_bytes, 0,
+           params->sk_bytes - params->index_bytes);
+}
+
+int xmssmt_core_subkey_sign(const xmss_params *params, unsigned char *subkey,
+                            unsigned char *sm, unsigned long long *smlen,
+                            const unsigned char *m, unsigned long long mlen)
+{
+    unsigned long long idx = bytes_to_ull(subkey, params->index_bytes);
+    unsigned long long end = bytes_to_ull(subkey + params->sk_bytes,
+                                          params->index_bytes);
+    int ret;
+
+    if (idx >= end) {
+        subkey_wipe(params, subkey);
+        return -2;
+    }
+    ret = xmssmt_core_sign(params, subkey, sm, smlen, m, mlen);
+    if (ret == 0 && idx + 1 == end) {
+        /* This was the last one-time key of the range. */
+        subkey_wipe(params, subkey);
+    }
+    return ret;
+}
+
+/* Differences that are at most this many bytes apart are reported as one
+   range; rewriting a few unchanged bytes is cheaper than another write. */
+#define XMSS_SK_DIFF_GAP 16
+
+unsigned int xmss_sk_diff(xmss_sk_range *ranges, unsigned int max,
+                          const unsigned char *before,
+                          const unsigned char *after,
+                          unsigned long long len)
+{
+    unsigned int count = 0;
+    unsigned long long i;
+
+    for (i = 0; i < len; i++) {
+        if (before[i] == after[i]) {
+            continue;
+        }
+        if (count > 0 && (count == max ||
+            i - (ranges[count-1].offset + ranges[count-1].len) <= XMSS_SK_DIFF_GAP)) {
+            ranges[count-1].len = i + 1 - ranges[count-1].offset;
+        }
+        else if (count < max) {
+            ranges[count].offset = i;
+            ranges[count].len = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+typedef struct {
+    const xmss_params *params;
+    int *status;
+    const unsigned char * const *sm;
+    const unsigned long long *smlen;
+    const unsigned char *pk;
+} verify_job;
+
+/**
+ * Verifies signed message i of a verify_job; see threadpool_run.
+ */
+static void verify_one(void *arg, unsigned int i)
+{
+    const verify_job *job = arg;
+    unsigned char *m;
+    unsigned long long mlen;
+
+    job->status[i] = -1;
+    if (job->smlen[i] < job->params->sig_bytes) {
+        return;
+    }
+    /* xmssmt_core_sign_open needs room for the message and its prefix. */
+    m = malloc(job->smlen[i]);
+    if (m == NULL) {
+        return;
+    }
+    job->status[i] = xmssmt_core_sign_open(job->params, m, &mlen,
+                                           job->sm[i], job->smlen[i], job->pk);
+    free(m);
+}
+
+int xmssmt_core_verify_batch(const xmss_params *params, int *status,
+                             const unsigned char * const *sm,
+                             const unsigned long long *smlen,
+                             unsigned int count, const unsigned char *pk,
+                             threadpool *pool)
+{
+    verify_job job = {params, status, sm, smlen, pk};
+    unsigned int i;
+
+    threadpool_run(pool, verify_one, &job, count);
+
+    for (i = 0; i < count; i++) {
+        if (status[i]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+unsigned long long xmss_cap_pk_bytes(const xmss_params *params, unsigned int c)
+{
+    return params->pk_bytes + ((unsigned long long)params->n << c);
+}
+
+unsigned long long xmss_capped_sig_bytes(const xmss_params *params,
+                                         unsigned int c)
+{
+    return params->sig_bytes - (unsigned long long)c * params->n;
+}
+
+int xmssmt_core_cap_pk(const xmss_params *params, unsigned char *xpk,
+                       const unsigned char *sk, unsigned int c)
+{
+    const unsigned char *sk_seed = sk + params->index_bytes;
+    const unsigned char *pub_seed = sk + params->index_bytes + 3*params->n;
+    unsigned int height = params->tree_height - c;
+    uint32_t top_tree_addr[8] = {0};
+    uint32_t i;
+
+    if (c > params->tree_height) {
+        return -1;
+    }
+    /* Copy the public key, i.e. [root || PUB_SEED]. */
+    memcpy(xpk, sk + params->index_bytes + 2*params->n, params->pk_bytes);
+    xpk += params->pk_bytes;
+
+    set_layer_addr(top_tree_addr, params->d - 1);
+    for (i = 0; i < ((uint32_t)1 << c); i++) {
+        xmss_treehash(params, xpk + i*params->n, NULL, 0, sk_seed, pub_seed,
+                      i << height, height, top_tree_addr);
+    }
+    return 0;
+}
+
+int xmssmt_core_cap_check(const xmss_params *params, const unsigned char *xpk,
+                          unsigned int c)
+{
+    const unsigned char *pub_root = xpk;
+    const unsigned char *pub_seed = xpk + params->n;
+    unsigned char *nodes;
+    uint32_t node_addr[8] = {0};
+    uint32_t width, i;
+    unsigned int height;
+    int ret;
+
+    if (c > params->tree_height) {
+        return -1;
+    }
+    nodes = malloc((size_t)params->n << c);
+    if (nodes == NULL) {
+        return -1;
+    }
+    memcpy(nodes, xpk + params->pk_bytes, (size_t)params->n << c);
+
+    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
+    set_layer_addr(node_addr, params->d - 1);
+
+    /* Hash the cap up to the root, one level at a time, in place. */
+    height = params->tree_height - c;
+    for (width = (uint32_t)1 << c; width > 1; width >>= 1) {
+        set_tree_height(node_addr, height);
+        for (i = 0; i < width / 2; i++) {
+            set_tree_index(node_addr, i);
+            thash_h(params, nodes + i*params->n, nodes + 2*i*params->n,
+                    pub_seed, node_addr);
+        }
+        height++;
+    }
+    ret = memcmp(nodes, pub_root, params->n) ? -1 : 0;
+
+    free(nodes);
+    return ret;
+}
+
+int xmssmt_core_cap_strip(const xmss_params *params,
+                          unsigned char *csm, unsigned long long *csmlen,
+                          const unsigned char *sm, unsigned long long smlen,
+                          unsigned int c)
+{
+    const unsigned long long sig_bytes = xmss_capped_sig_bytes(params, c);
+
+    if (c > params->tree_height || smlen < params->sig_bytes) {
+        return -1;
+    }
+    /* The top c auth nodes are the last ones of the signature, so this drops
+       the c*n bytes just in front of the message. */
+    memmove(csm, sm, sig_bytes);
+    memmove(csm + sig_bytes, sm + params->sig_bytes, smlen - params->sig_bytes);
+    *csmlen = smlen - (unsigned long long)c * params->n;
+    return 0;
+}
+
+int xmssmt_core_sign_open_capped(const xmss_params *params,
+                                 unsigned char *m, unsigned long long *mlen,
+                                 const unsigned char *csm,
+                                 unsigned long long csmlen,
+                                 const unsigned char *xpk, unsigned int c)
+{
+    const unsigned long long sig_bytes = xmss_capped_sig_bytes(params, c);
+    const unsigned int height = params->tree_height - c;
+    const unsigned char *pub_seed = xpk + params->n;
+    const unsigned char *cap = xpk + params->pk_bytes;
+    unsigned char buf[subtree_node_workspace_size(params) + XMSS_WS_ALIGN];
+    unsigned char root[params->n];
+    unsigned char *mhash = root;
+    xmss_workspace ws;
+    unsigned long long idx = 0;
+    unsigned int i;
+    uint32_t idx_leaf;
+
+    if (c > params->tree_height || csmlen < sig_bytes) {
+        *mlen = 0;
+        return -1;
+    }
+    *mlen = csmlen - sig_bytes;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+
+    /* Convert the index bytes from the signature to an integer. */
+    idx = bytes_to_ull(csm, params->index_bytes);
+
+    /* Put the message at the end of the m buffer (of at least csmlen bytes),
+       so that we can prepend the required other inputs for the hash. */
+    memcpy(m + sig_bytes, csm + sig_bytes, *mlen);
+
+    /* Compute the message hash. */
+    hash_message(params, mhash, csm + params->index_bytes, xpk, idx,
+                 m + sig_bytes - params->padding_len - 3*params->n, *mlen);
+    csm += params->index_bytes + params->n;
+
+    /* The layers below the top one are verified as usual.. */
+    for (i = 0; i < params->d - 1; i++) {
+        idx_leaf = (idx & ((1 << params->tree_height)-1));
+        idx = idx >> params->tree_height;
+        subtree_node(params, root, csm, root, i, idx, idx_leaf,
+                     params->tree_height, pub_seed, &ws);
+        csm += params->wots_sig_bytes + params->tree_height*params->n;
+    }
+
+    /* ..while the top tree is only hashed up to the cap, which holds the
+       nodes at that height that were authenticated by xmssmt_core_cap_check. */
+    idx_leaf = (idx & ((1 << params->tree_height)-1));
+    idx = idx >> params->tree_height;
+    if (idx == 0) {
+        subtree_node(params, root, csm, root, params->d - 1, 0, idx_leaf,
+                     height, pub_seed, &ws);
+    }
+    if (idx != 0 || memcmp(root, cap + (idx_leaf >> height)*params->n,
+                           params->n)) {
+        memset(m, 0, *mlen);
+        *mlen = 0;
+        return -1;
+    }
+    csm += params->wots_sig_bytes + height*params->n;
+
+    /* If verification was successful, copy the message from the signature. */
+    memcpy(m, csm, *mlen);
+
+    return 0;
+}
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include "params.h"
+#include "threadpool.h"
+#include "utils.h"
 
 /**
  * Computes the leaf at a given address. First generates the WOTS key pair,
@@ -13,6 +15,76 @@ void gen_leaf_wots(const xmss_params *params, unsigned char *leaf,
                    const unsigned char *sk_seed, const unsigned char *pub_seed,
                    uint32_t ltree_addr[8], uint32_t ots_addr[8]);
 
+/**
+ * Returns the size of the workspace that gen_leaf_wots_ws takes.
+ */
+unsigned long long xmss_leaf_workspace_size(const xmss_params *params);
+
+/**
+ * As gen_leaf_wots, with the WOTS public key (and the buffers for computing
+ * it) taken from ws rather than the stack.
+ * Returns -1 without computing the leaf if ws has less than
+ * xmss_leaf_workspace_size bytes left, 0 otherwise.
+ */
+int gen_leaf_wots_ws(const xmss_params *params, unsigned char *leaf,
+                     const unsigned char *sk_seed,
+                     const unsigned char *pub_seed,
+                     uint32_t ltree_addr[8], uint32_t ots_addr[8],
+                     xmss_workspace *ws);
+
+/* The height of the windows of leaves that xmss_treehash hashes level by
+   level, i.e. with a batch of up to 2^(XMSS_TREEHASH_WINDOW - 1) pairs. */
+#define XMSS_TREEHASH_WINDOW 3
+
+/**
+ * Computes the node at the given height of the tree at subtree_addr (of which
+ * the layer and tree parts are used) above the leaves from 'start' on, a
+ * multiple of 2^height, using Merkle's TreeHash algorithm. The leaves are
+ * computed and merged in windows of 2^XMSS_TREEHASH_WINDOW at a time; the
+ * leaves of a window are computed concurrently on the shared pool, if any.
+ * If auth_path is not NULL, the nodes below it on the auth path of leaf_idx
+ * are written to it; for start = 0 and height = tree_height, this is the
+ * full auth path and node is the root.
+ */
+void xmss_treehash(const xmss_params *params,
+                   unsigned char *node, unsigned char *auth_path,
+                   uint32_t leaf_idx,
+                   const unsigned char *sk_seed, const unsigned char *pub_seed,
+                   uint32_t start, unsigned int height,
+                   const uint32_t subtree_addr[8]);
+
+/**
+ * Returns the size of the workspace that xmss_treehash_ws takes for a node at
+ * the given height.
+ */
+unsigned long long xmss_treehash_workspace_size(const xmss_params *params,
+                                                unsigned int height);
+
+/**
+ * As xmss_treehash, with its buffers taken from ws rather than the stack.
+ * Returns -1 without computing anything if ws has less than
+ * xmss_treehash_workspace_size bytes left, 0 otherwise.
+ */
+int xmss_treehash_ws(const xmss_params *params,
+                     unsigned char *node, unsigned char *auth_path,
+                     uint32_t leaf_idx,
+                     const unsigned char *sk_seed,
+                     const unsigned char *pub_seed,
+                     uint32_t start, unsigned int height,
+                     const uint32_t subtree_addr[8], xmss_workspace *ws);
+
+/**
+ * Computes the root of tree 'tree' on the given layer from the part of a
+ * signature that belongs to that layer; i.e. the WOTS signature of leaf
+ * 'leaf' on msg (n bytes), followed by the auth path of that leaf. msg is
+ * the message hash on the bottom layer, and the root of the tree below it on
+ * the other layers. root and msg may overlap.
+ */
+void xmss_subtree_root(const xmss_params *params, unsigned char *root,
+                       const unsigned char *sig, const unsigned char *msg,
+                       unsigned int layer, unsigned long long tree,
+                       uint32_t leaf, const unsigned char *pub_seed);
+
 /**
  * Verifies a given message signature pair under a given public key.
  * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
@@ -30,4 +102,161 @@ int xmssmt_core_sign_open(const xmss_params *params,
                           unsigned char *m, unsigned long long *mlen,
                           const unsigned char *sm, unsigned long long smlen,
                           const unsigned char *pk);
+
+/**
+ * Returns the size of the workspace that xmssmt_core_sign_open_ws takes.
+ * This is the same for XMSS and XMSSMT parameter sets.
+ */
+unsigned long long xmssmt_core_sign_open_workspace_size(const xmss_params *params);
+
+/**
+ * As xmssmt_core_sign_open (which works for XMSS too), with all buffers that
+ * depend on the parameters taken from ws rather than the stack.
+ * Returns -1 if ws has less than xmssmt_core_sign_open_workspace_size bytes
+ * left, or if the signature is invalid.
+ */
+int xmssmt_core_sign_open_ws(const xmss_params *params,
+                             unsigned char *m, unsigned long long *mlen,
+                             const unsigned char *sm, unsigned long long smlen,
+                             const unsigned char *pk, xmss_workspace *ws);
+
+/**
+ * Returns the size of each of the signatures that xmssmt_core_sign_batch
+ * produces for a batch of count messages.
+ */
+unsigned long long xmss_batch_sig_bytes(const xmss_params *params,
+                                        unsigned int count);
+
+/**
+ * Signs count messages using a single one-time key, by signing the root of a
+ * Merkle tree over their randomized hashes. For each message, writes a
+ * signature of xmss_batch_sig_bytes(params, count) bytes to sigs; these do
+ * not include the message. This works for both XMSS and XMSSMT. The root is
+ * signed in its own message hash domain (XMSS_MSG_BATCH_ROOT), so that batch
+ * and regular signatures cannot be passed off as each other.
+ * Returns -2 if all one-time keys have been used, -1 on other errors.
+ */
+int xmssmt_core_sign_batch(const xmss_params *params, unsigned char *sk,
+                           unsigned char *sigs,
+                           const unsigned char * const *m,
+                           const unsigned long long *mlen,
+                           unsigned int count);
+
+/**
+ * Verifies a signature produced by xmssmt_core_sign_batch for message m.
+ * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
+ * Returns 0 if the signature is valid, -1 otherwise.
+ */
+int xmssmt_core_sign_open_batch(const xmss_params *params,
+                                const unsigned char *sig,
+                                unsigned long long siglen,
+                                const unsigned char *m,
+                                unsigned long long mlen,
+                                const unsigned char *pk);
+
+/**
+ * Returns the size of a sub-key as produced by xmssmt_core_subkey; i.e. the
+ * secret key followed by the end of its range.
+ */
+unsigned long long xmss_subkey_bytes(const xmss_params *params);
+
+/**
+ * Signs a message using a sub-key, as xmss[mt]_core_sign does with a secret
+ * key. This works for both XMSS and XMSSMT.
+ * Returns -2 if all one-time keys of the sub-key's range have been used.
+ */
+int xmssmt_core_subkey_sign(const xmss_params *params, unsigned char *subkey,
+                            unsigned char *sm, unsigned long long *smlen,
+                            const unsigned char *m, unsigned long long mlen);
+
+/* A range of bytes of a secret key (see xmss_sk_diff). */
+typedef struct {
+    unsigned long long offset;
+    unsigned long long len;
+} xmss_sk_range;
+
+/**
+ * Finds the byte ranges in which the secret keys 'before' and 'after' (len
+ * bytes each) differ, and writes up to max of them to ranges, in order.
+ * Ranges that are only a few bytes apart are merged. If there would be more
+ * than max ranges, the last one is extended to cover the remaining ones;
+ * max must be at least 1. Returns the number of ranges; 0 if the keys are identical.
+ */
+unsigned int xmss_sk_diff(xmss_sk_range *ranges, unsigned int max,
+                          const unsigned char *before,
+                          const unsigned char *after,
+                          unsigned long long len);
+
+/**
+ * Verifies count signed messages (as produced by xmss[mt]_core_sign, with the
+ * message appended) under the same public key, distributed over the threads
+ * of pool, or one after another if pool is NULL. Writes 0 to status[j] if
+ * signed message j is valid, and -1 otherwise. The messages are not copied
+ * out. Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
+ * Returns 0 if all signatures are valid, -1 otherwise.
+ */
+int xmssmt_core_verify_batch(const xmss_params *params, int *status,
+                             const unsigned char * const *sm,
+                             const unsigned long long *smlen,
+                             unsigned int count, const unsigned char *pk,
+                             threadpool *pool);
+
+/* A Merkle cap of height c holds the 2^c nodes at height tree_height - c of
+   the top tree (the only tree for XMSS). An extended public key is the public
+   key followed by its cap, i.e. [root || PUB_SEED || cap]; once the cap has
+   been checked against the root, signatures can omit the top c nodes of the
+   top auth path, and their verification stops at the cap. The trees of the
+   lower layers of XMSSMT are not covered, as the public key cannot hold the
+   nodes of all of them. */
+
+/**
+ * Returns the size of an extended public key (without OID) with a cap of
+ * height c.
+ */
+unsigned long long xmss_cap_pk_bytes(const xmss_params *params, unsigned int c);
+
+/**
+ * Returns the size of a signature with the top c auth nodes omitted.
+ */
+unsigned long long xmss_capped_sig_bytes(const xmss_params *params,
+                                         unsigned int c);
+
+/**
+ * Computes the extended public key with a cap of height c (at most
+ * tree_height) from a secret key, by computing the leaves of the top tree.
+ * This works for both cores, and for both XMSS and XMSSMT.
+ * Returns -1 if c is too large, 0 otherwise.
+ */
+int xmssmt_core_cap_pk(const xmss_params *params, unsigned char *xpk,
+                       const unsigned char *sk, unsigned int c);
+
+/**
+ * Checks that the cap of an extended public key hashes to its root. This
+ * has to be done once, before the key is used by xmssmt_core_sign_open_capped.
+ * Returns 0 if the cap is valid, -1 otherwise.
+ */
+int xmssmt_core_cap_check(const xmss_params *params, const unsigned char *xpk,
+                          unsigned int c);
+
+/**
+ * Converts a signed message as produced by xmss[mt]_core_sign into one with
+ * the top c auth nodes omitted. csm and sm may be the same buffer.
+ * Returns -1 if sm is too short or c is too large, 0 otherwise.
+ */
+int xmssmt_core_cap_strip(const xmss_params *params,
+                          unsigned char *csm, unsigned long long *csmlen,
+                          const unsigned char *sm, unsigned long long smlen,
+                          unsigned int c);
+
+/**
+ * Verifies a signed message with the top c auth nodes omitted under an
+ * extended public key with a cap of height c, which must have been checked
+ * with xmssmt_core_cap_check. m must have room for csmlen bytes.
+ * Returns 0 if the signature is valid, -1 otherwise.
+ */
+int xmssmt_core_sign_open_capped(const xmss_params *params,
+                                 unsigned char *m, unsigned long long *mlen,
+                                 const unsigned char *csm,
+                                 unsigned long long csmlen,
+                                 const unsigned char *xpk, unsigned int c);
 #endif
@@ -0,0 +1,376 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "hash_address.h"
+#include "params.h"
+#include "utils.h"
+#include "wots.h"
+#include "xmss_commons.h"
+#include "xmss_concurrent.h"
+
+/* The number of trees that every layer keeps; the current one and the one
+   before it, for signatures that reserved their index just before the
+   boundary and are still being computed. */
+#define XMSS_CONCURRENT_SLOTS 2
+
+typedef struct {
+    unsigned long long tree;
+    int valid;
+    /* All nodes of the tree, level by level, starting with the leaves. */
+    unsigned char *nodes;
+    /* The WOTS signature on the root of this tree by the layer above (not
+       used for the top layer). */
+    unsigned char *sig;
+} tree_slot;
+
+typedef struct {
+    /* Protects the slots; held for reading while copying from them. */
+    pthread_rwlock_t lock;
+    /* Held while computing a tree for this layer, so that threads that need
+       the same tree wait for it rather than computing it as well. */
+    pthread_mutex_t build;
+    tree_slot slots[XMSS_CONCURRENT_SLOTS];
+} layer_cache;
+
+struct xmss_concurrent {
+    xmss_params params;
+    /* [SK_SEED || SK_PRF || root || PUB_SEED] */
+    unsigned char *keys;
+    _Atomic unsigned long long next;
+    /* Serializes persist calls, so that the index they write only grows. */
+    pthread_mutex_t persist;
+    layer_cache *layers;
+};
+
+/* The number of bytes of the node table of a single tree. */
+static unsigned long long nodes_bytes(const xmss_params *params)
+{
+    return ((2ULL << params->tree_height) - 1) * params->n;
+}
+
+/**
+ * Computes all nodes of tree 'tree' on the given layer, and (below the top
+ * layer) the WOTS signature on its root by the layer above.
+ */
+static void tree_compute(const xmss_params *params,
+                         unsigned char *nodes, unsigned char *sig,
+                         const unsigned char *keys,
+                         unsigned int layer, unsigned long long tree)
+{
+    const unsigned char *sk_seed = keys;
+    const unsigned char *pub_seed = keys + 3*params->n;
+    unsigned char *level = nodes;
+    unsigned char *parent;
+    uint32_t width = 1 << params->tree_height;
+    uint32_t i, height;
+
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+    uint32_t node_addr[8] = {0};
+
+    set_layer_addr(ots_addr, layer);
+    set_tree_addr(ots_addr, tree);
+    copy_subtree_addr(ltree_addr, ots_addr);
+    copy_subtree_addr(node_addr, ots_addr);
+    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+    set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
+    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
+
+    for (i = 0; i < width; i++) {
+        set_ltree_addr(ltree_addr, i);
+        set_ots_addr(ots_addr, i);
+        gen_leaf_wots(params, nodes + i*params->n,
+                      sk_seed, pub_seed, ltree_addr, ots_addr);
+    }
+
+    for (height = 0; width > 1; height++) {
+        parent = level + width*params->n;
+        set_tree_height(node_addr, height);
+        for (i = 0; i < (width >> 1); i++) {
+            set_tree_index(node_addr, i);
+            thash_h(params, parent + i*params->n,
+                    level + 2*i*params->n, pub_seed, node_addr);
+        }
+        level = parent;
+        width >>= 1;
+    }
+
+    if (layer + 1 < params->d) {
+        set_layer_addr(ots_addr, layer + 1);
+        set_tree_addr(ots_addr, tree >> params->tree_height);
+        set_ots_addr(ots_addr, tree & ((1 << params->tree_height) - 1));
+        wots_sign(params, sig, level, sk_seed, pub_seed, ots_addr);
+    }
+}
+
+/**
+ * Copies the auth path of a leaf out of a node table.
+ */
+static void auth_path_from_nodes(const xmss_params *params,
+                                 unsigned char *auth_path,
+                                 const unsigned char *nodes, uint32_t leaf)
+{
+    uint32_t width = 1 << params->tree_height;
+    uint32_t height;
+
+    for (height = 0; height < params->tree_height; height++) {
+        memcpy(auth_path + height*params->n,
+               nodes + (leaf ^ 1)*params->n, params->n);
+        nodes += width*params->n;
+        width >>= 1;
+        leaf >>= 1;
+    }
+}
+
+static tree_slot *slot_find(layer_cache *cache, unsigned long long tree)
+{
+    unsigned int i;
+
+    for (i = 0; i < XMSS_CONCURRENT_SLOTS; i++) {
+        if (cache->slots[i].valid && cache->slots[i].tree == tree) {
+            return &cache->slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Returns the slot to replace by a newer tree, or NULL if all slots hold
+ * trees that are newer than 'tree'.
+ */
+static tree_slot *slot_victim(layer_cache *cache, unsigned long long tree)
+{
+    tree_slot *victim = NULL;
+    unsigned int i;
+
+    for (i = 0; i < XMSS_CONCURRENT_SLOTS; i++) {
+        if (!cache->slots[i].valid) {
+            return &cache->slots[i];
+        }
+        if (cache->slots[i].tree < tree &&
+            (victim == NULL || cache->slots[i].tree < victim->tree)) {
+            victim = &cache->slots[i];
+        }
+    }
+    return victim;
+}
+
+/**
+ * Copies the auth path of 'leaf' in tree 'tree' of the given layer, and the
+ * WOTS signature on the root of that tree, into the signature.
+ * Computes the tree if it is not cached.
+ */
+static int tree_lookup(xmss_concurrent *signer, unsigned int layer,
+                       unsigned long long tree, uint32_t leaf,
+                       unsigned char *auth_path, unsigned char *root_sig)
+{
+    const xmss_params *params = &signer->params;
+    layer_cache *cache = &signer->layers[layer];
+    tree_slot *slot;
+    unsigned char *nodes, *sig;
+
+    for (;;) {
+        pthread_rwlock_rdlock(&cache->lock);
+        slot = slot_find(cache, tree);
+        if (slot != NULL) {
+            auth_path_from_nodes(params, auth_path, slot->nodes, leaf);
+            if (root_sig != NULL) {
+                memcpy(root_sig, slot->sig, params->wots_sig_bytes);
+            }
+            pthread_rwlock_unlock(&cache->lock);
+            return 0;
+        }
+        pthread_rwlock_unlock(&cache->lock);
+
+        pthread_mutex_lock(&cache->build);
+        pthread_rwlock_rdlock(&cache->lock);
+        slot = slot_find(cache, tree);
+        pthread_rwlock_unlock(&cache->lock);
+        if (slot != NULL) {
+            /* Another thread has just computed it. */
+            pthread_mutex_unlock(&cache->build);
+            continue;
+        }
+
+        nodes = malloc(nodes_bytes(params));
+        sig = malloc(params->wots_sig_bytes);
+        if (nodes == NULL || sig == NULL) {
+            pthread_mutex_unlock(&cache->build);
+            free(nodes);
+            free(sig);
+            return -1;
+        }
+        tree_compute(params, nodes, sig, signer->keys, layer, tree);
+
+        pthread_rwlock_wrlock(&cache->lock);
+        slot = slot_victim(cache, tree);
+        if (slot == NULL) {
+            /* A straggler; all cached trees are newer, so use the tree once
+               rather than evicting one that other signatures still need. */
+            pthread_rwlock_unlock(&cache->lock);
+            pthread_mutex_unlock(&cache->build);
+            auth_path_from_nodes(params, auth_path, nodes, leaf);
+            if (root_sig != NULL) {
+                memcpy(root_sig, sig, params->wots_sig_bytes);
+            }
+            free(nodes);
+            free(sig);
+            return 0;
+        }
+        free(slot->nodes);
+        free(slot->sig);
+        slot->nodes = nodes;
+        slot->sig = sig;
+        slot->tree = tree;
+        slot->valid = 1;
+        pthread_rwlock_unlock(&cache->lock);
+        pthread_mutex_unlock(&cache->build);
+    }
+}
+
+xmss_concurrent *xmss_concurrent_load(const xmss_params *params,
+                                      const unsigned char *sk)
+{
+    xmss_concurrent *signer;
+    unsigned int i;
+
+    signer = calloc(1, sizeof(xmss_concurrent));
+    if (signer == NULL) {
+        return NULL;
+    }
+    signer->params = *params;
+    signer->keys = malloc(4 * params->n);
+    signer->layers = calloc(params->d, sizeof(layer_cache));
+    if (signer->keys == NULL || signer->layers == NULL) {
+        free(signer->keys);
+        free(signer->layers);
+        free(signer);
+        return NULL;
+    }
+    memcpy(signer->keys, sk + params->index_bytes, 4 * params->n);
+    atomic_init(&signer->next, bytes_to_ull(sk, params->index_bytes));
+
+    pthread_mutex_init(&signer->persist, NULL);
+    for (i = 0; i < params->d; i++) {
+        pthread_rwlock_init(&signer->layers[i].lock, NULL);
+        pthread_mutex_init(&signer->layers[i].build, NULL);
+    }
+    return signer;
+}
+
+int xmss_concurrent_sign(xmss_concurrent *signer,
+                         unsigned char *sm, unsigned long long *smlen,
+                         const unsigned char *m, unsigned long long mlen)
+{
+    const xmss_params *params = &signer->params;
+    const unsigned char *sk_seed = signer->keys;
+    const unsigned char *sk_prf = signer->keys + params->n;
+    const unsigned char *pub_root = signer->keys + 2*params->n;
+    const unsigned char *pub_seed = signer->keys + 3*params->n;
+
+    unsigned char mhash[params->n];
+    unsigned char idx_bytes_32[32];
+    unsigned long long idx, tree;
+    unsigned int i;
+    uint32_t idx_leaf;
+
+    uint32_t ots_addr[8] = {0};
+
+    /* Reserve an index; no other signature will use it. */
+    idx = atomic_fetch_add(&signer->next, 1);
+
+    /* See xmssmt_core_sign for the treatment of the last index. */
+    if ((idx > ((1ULL << params->full_height) - 1)) ||
+        ((params->full_height == 64) && (idx == ((1ULL << params->full_height) - 1)))) {
+        return -2;
+    }
+
+    /* The message is hashed in place, as in xmssmt_core_sign. */
+    memcpy(sm + params->sig_bytes, m, mlen);
+    *smlen = params->sig_bytes + mlen;
+
+    ull_to_bytes(sm, params->index_bytes, idx);
+    ull_to_bytes(idx_bytes_32, 32, idx);
+    prf(params, sm + params->index_bytes, idx_bytes_32, sk_prf);
+    hash_message(params, mhash, sm + params->index_bytes, pub_root, idx,
+                 sm + params->sig_bytes - params->padding_len - 3*params->n,
+                 mlen);
+    sm += params->index_bytes + params->n;
+
+    /* The bottom-most WOTS signature is the only per-message work. */
+    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
+    set_tree_addr(ots_addr, idx >> params->tree_height);
+    set_ots_addr(ots_addr, idx & ((1 << params->tree_height) - 1));
+    wots_sign(params, sm, mhash, sk_seed, pub_seed, ots_addr);
+
+    for (i = 0; i < params->d; i++) {
+        idx_leaf = (idx >> (i * params->tree_height)) & ((1 << params->tree_height) - 1);
+        tree = (i + 1) * params->tree_height >= 64 ? 0 : idx >> ((i + 1) * params->tree_height);
+
+        /* The WOTS signature of the next layer signs this tree's root. */
+        if (tree_lookup(signer, i, tree, idx_leaf,
+                        sm + params->wots_sig_bytes,
+                        i + 1 < params->d ? sm + params->wots_sig_bytes + params->tree_height*params->n : NULL)) {
+            return -1;
+        }
+        sm += params->wots_sig_bytes + params->tree_height*params->n;
+    }
+
+    return 0;
+}
+
+void xmss_concurrent_persist(xmss_concurrent *signer, unsigned char *sk)
+{
+    const xmss_params *params = &signer->params;
+    unsigned long long next;
+
+    pthread_mutex_lock(&signer->persist);
+    next = atomic_load(&signer->next);
+    if (next > ((1ULL << params->full_height) - 1)) {
+        /* All one-time keys have been used. */
+        memset(sk, 0xFF, params->index_bytes);
+        memset(sk + params->index_bytes, 0,
+               params->sk_bytes - params->index_bytes);
+    }
+    else if (next > bytes_to_ull(sk, params->index_bytes)) {
+        ull_to_bytes(sk, params->index_bytes, next);
+    }
+    pthread_mutex_unlock(&signer->persist);
+}
+
+unsigned long long xmss_concurrent_index(xmss_concurrent *signer)
+{
+    return atomic_load(&signer->next);
+}
+
+void xmss_concurrent_free(xmss_concurrent *signer)
+{
+    const xmss_params *params;
+    unsigned int i, j;
+
+    if (signer == NULL) {
+        return;
+    }
+    params = &signer->params;
+    for (i = 0; i < params->d; i++) {
+        for (j = 0; j < XMSS_CONCURRENT_SLOTS; j++) {
+            if (signer->layers[i].slots[j].sig != NULL) {
+                memset(signer->layers[i].slots[j].sig, 0,
+                       params->wots_sig_bytes);
+            }
+            free(signer->layers[i].slots[j].nodes);
+            free(signer->layers[i].slots[j].sig);
+        }
+        pthread_rwlock_destroy(&signer->layers[i].lock);
+        pthread_mutex_destroy(&signer->layers[i].build);
+    }
+    pthread_mutex_destroy(&signer->persist);
+    memset(signer->keys, 0, 4 * params->n);
+    free(signer->keys);
+    free(signer->layers);
+    free(signer);
+}
@@ -0,0 +1,58 @@
+#ifndef XMSS_CONCURRENT_H
+#define XMSS_CONCURRENT_H
+
+#include "params.h"
+
+/* A concurrent signer lets any number of threads sign with the same XMSS or
+   XMSSMT key at the same time. Each signature reserves the next index with an
+   atomic increment; the WOTS signature is then computed by the calling thread
+   in parallel with the others. Auth paths come from full node tables of the
+   current trees of every layer, which are computed once (by the first thread
+   that needs them) and shared. A signature for an index whose tree has
+   already been evicted from this cache computes its tree on its own.
+
+   Signatures are identical to those of xmss[mt]_core_sign for the same
+   index. Only the index part of the secret key is used and updated, as in
+   the stateless core (xmss_core.c); the BDS state of a fast-core sk is not
+   advanced, so such an sk should not be passed to the fast core again. */
+
+typedef struct xmss_concurrent xmss_concurrent;
+
+/**
+ * Creates a concurrent signer from a secret key without OID. The sk is
+ * copied; it is not modified. Returns NULL if memory could not be allocated.
+ * Every layer caches up to two trees of 2^(h/d + 1) - 1 nodes each.
+ */
+xmss_concurrent *xmss_concurrent_load(const xmss_params *params,
+                                      const unsigned char *sk);
+
+/**
+ * Signs a message using the next unreserved index. This may be called by
+ * several threads at once. The output has the same format as
+ * xmss[mt]_core_sign. Returns -2 if all one-time keys have been used.
+ */
+int xmss_concurrent_sign(xmss_concurrent *signer,
+                         unsigned char *sm, unsigned long long *smlen,
+                         const unsigned char *m, unsigned long long mlen);
+
+/**
+ * Writes the index after the highest one that has been reserved so far into
+ * the index of sk (params->sk_bytes, without OID), unless sk already holds a
+ * higher one; i.e. the persisted index only moves forward. Once all indices
+ * have been reserved, the secret key is erased as xmss[mt]_core_sign does.
+ * This may be called while other threads are signing.
+ */
+void xmss_concurrent_persist(xmss_concurrent *signer, unsigned char *sk);
+
+/**
+ * Returns the next index that will be reserved.
+ */
+unsigned long long xmss_concurrent_index(xmss_concurrent *signer);
+
+/**
+ * Erases the secret key material and releases the signer. No other thread
+ * may be using the signer at this point.
+ */
+void xmss_concurrent_free(xmss_concurrent *signer);
+
+#endif
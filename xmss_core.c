@@ -22,67 +22,8 @@ static void treehash(const xmss_params *params,
                      const unsigned char *pub_seed,
                      uint32_t leaf_idx, const uint32_t subtree_addr[8])
 {
-    unsigned char stack[(params->tree_height+1)*params->n];
-    unsigned int heights[params->tree_height+1];
-    unsigned int offset = 0;
-
-    /* The subtree has at most 2^20 leafs, so uint32_t suffices. */
-    uint32_t idx;
-    uint32_t tree_idx;
-
-    /* We need all three types of addresses in parallel. */
-    uint32_t ots_addr[8] = {0};
-    uint32_t ltree_addr[8] = {0};
-    uint32_t node_addr[8] = {0};
-
-    /* Select the required subtree. */
-    copy_subtree_addr(ots_addr, subtree_addr);
-    copy_subtree_addr(ltree_addr, subtree_addr);
-    copy_subtree_addr(node_addr, subtree_addr);
-
-    set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
-    set_type(ltree_addr, XMSS_ADDR_TYPE_LTREE);
-    set_type(node_addr, XMSS_ADDR_TYPE_HASHTREE);
-
-    for (idx = 0; idx < (uint32_t)(1 << params->tree_height); idx++) {
-        /* Add the next leaf node to the stack. */
-        set_ltree_addr(ltree_addr, idx);
-        set_ots_addr(ots_addr, idx);
-        gen_leaf_wots(params, stack + offset*params->n,
-                      sk_seed, pub_seed, ltree_addr, ots_addr);
-        offset++;
-        heights[offset - 1] = 0;
-
-        /* If this is a node we need for the auth path.. */
-        if ((leaf_idx ^ 0x1) == idx) {
-            memcpy(auth_path, stack + (offset - 1)*params->n, params->n);
-        }
-
-        /* While the top-most nodes are of equal height.. */
-        while (offset >= 2 && heights[offset - 1] == heights[offset - 2]) {
-            /* Compute index of the new node, in the next layer. */
-            tree_idx = (idx >> (heights[offset - 1] + 1));
-
-            /* Hash the top-most nodes from the stack together. */
-            /* Note that tree height is the 'lower' layer, even though we use
-               the index of the new node on the 'higher' layer. This follows
-               from the fact that we address the hash function calls. */
-            set_tree_height(node_addr, heights[offset - 1]);
-            set_tree_index(node_addr, tree_idx);
-            thash_h(params, stack + (offset-2)*params->n,
-                           stack + (offset-2)*params->n, pub_seed, node_addr);
-            offset--;
-            /* Note that the top-most node is now one layer higher. */
-            heights[offset - 1]++;
-
-            /* If this is a node we need for the auth path.. */
-            if (((leaf_idx >> heights[offset - 1]) ^ 0x1) == tree_idx) {
-                memcpy(auth_path + heights[offset - 1]*params->n,
-                       stack + (offset - 1)*params->n, params->n);
-            }
-        }
-    }
-    memcpy(root, stack, params->n);
+    xmss_treehash(params, root, auth_path, leaf_idx, sk_seed, pub_seed,
+                  0, params->tree_height, subtree_addr);
 }
 
 /**
@@ -176,6 +117,32 @@ int xmssmt_core_keypair(const xmss_params *params,
     return 0;
 }
 
+/*
+ * Derives a sub-key for the one-time keys start .. end-1 of sk. As the state
+ * of this core is just the index, this only sets the indices of both keys.
+ * Format subkey: [sk (params->sk_bytes, index = start) || (ceil(h/8) bit) end]
+ */
+int xmssmt_core_subkey(const xmss_params *params, unsigned char *subkey,
+                       unsigned char *sk,
+                       unsigned long long start, unsigned long long end)
+{
+    /* The range must be non-empty, exist, and not have been used yet. */
+    if (start >= end || end - 1 > (1ULL << params->full_height) - 1 ||
+        start < bytes_to_ull(sk, params->index_bytes)) {
+        return -1;
+    }
+
+    ull_to_bytes(subkey, params->index_bytes, start);
+    memcpy(subkey + params->index_bytes, sk + params->index_bytes,
+           params->sk_bytes - params->index_bytes);
+    ull_to_bytes(subkey + params->sk_bytes, params->index_bytes, end);
+    /* sk continues after the range; past the last one-time key, it refuses
+       to sign. */
+    ull_to_bytes(sk, params->index_bytes, end);
+
+    return 0;
+}
+
 /**
  * Signs a message. Returns an array containing the signature followed by the
  * message and an updated secret key.
@@ -184,14 +151,37 @@ int xmssmt_core_sign(const xmss_params *params,
                      unsigned char *sk,
                      unsigned char *sm, unsigned long long *smlen,
                      const unsigned char *m, unsigned long long mlen)
+{
+    unsigned char buf[xmssmt_core_sign_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    return xmssmt_core_sign_ws(params, sk, sm, smlen, m, mlen, &ws);
+}
+
+unsigned long long xmssmt_core_sign_workspace_size(const xmss_params *params)
+{
+    unsigned long long wots = wots_workspace_size(params);
+    unsigned long long tree = xmss_treehash_workspace_size(params,
+                                                           params->tree_height);
+
+    return xmss_ws_round(params->n) + (wots > tree ? wots : tree);
+}
+
+int xmssmt_core_sign_ws(const xmss_params *params,
+                        unsigned char *sk,
+                        unsigned char *sm, unsigned long long *smlen,
+                        const unsigned char *m, unsigned long long mlen,
+                        xmss_workspace *ws)
 {
     const unsigned char *sk_seed = sk + params->index_bytes;
     const unsigned char *sk_prf = sk + params->index_bytes + params->n;
     const unsigned char *pub_root = sk + params->index_bytes + 2*params->n;
     const unsigned char *pub_seed = sk + params->index_bytes + 3*params->n;
 
-    unsigned char root[params->n];
-    unsigned char *mhash = root;
+    const unsigned long long mark = ws->used;
+    unsigned char *root;
+    unsigned char *mhash;
     unsigned long long idx;
     unsigned char idx_bytes_32[32];
     unsigned int i;
@@ -200,6 +190,12 @@ int xmssmt_core_sign(const xmss_params *params,
     uint32_t ots_addr[8] = {0};
     set_type(ots_addr, XMSS_ADDR_TYPE_OTS);
 
+    if (ws->size - ws->used < xmssmt_core_sign_workspace_size(params)) {
+        return -1;
+    }
+    root = xmss_ws_alloc(ws, params->n);
+    mhash = root;
+
     /* Already put the message in the right place, to make it easier to prepend
      * things when computing the hash over the message. */
     memcpy(sm + params->sig_bytes, m, mlen);
@@ -261,13 +257,15 @@ int xmssmt_core_sign(const xmss_params *params,
         /* Compute a WOTS signature. */
         /* Initially, root = mhash, but on subsequent iterations it is the root
            of the subtree below the currently processed subtree. */
-        wots_sign(params, sm, root, sk_seed, pub_seed, ots_addr);
+        wots_sign_ws(params, sm, root, sk_seed, pub_seed, ots_addr, ws);
         sm += params->wots_sig_bytes;
 
         /* Compute the authentication path for the used WOTS leaf. */
-        treehash(params, root, sm, sk_seed, pub_seed, idx_leaf, ots_addr);
+        xmss_treehash_ws(params, root, sm, idx_leaf, sk_seed, pub_seed,
+                         0, params->tree_height, ots_addr, ws);
         sm += params->tree_height*params->n;
     }
 
+    ws->used = mark;
     return 0;
 }
@@ -2,6 +2,7 @@
 #define XMSS_CORE_H
 
 #include "params.h"
+#include "utils.h"
 
 /**
  * Given a set of parameters, this function returns the size of the secret key.
@@ -65,6 +66,39 @@ int xmssmt_core_sign(const xmss_params *params,
                      unsigned char *sm, unsigned long long *smlen,
                      const unsigned char *m, unsigned long long mlen);
 
+/**
+ * Returns the size of the workspace that xmssmt_core_sign_ws takes, which
+ * depends on the core that is linked in.
+ */
+unsigned long long xmssmt_core_sign_workspace_size(const xmss_params *params);
+
+/**
+ * As xmssmt_core_sign (which works for XMSS too), with all buffers that
+ * depend on the parameters taken from ws rather than the stack.
+ * Returns -1 if ws has less than xmssmt_core_sign_workspace_size bytes left.
+ */
+int xmssmt_core_sign_ws(const xmss_params *params,
+                        unsigned char *sk,
+                        unsigned char *sm, unsigned long long *smlen,
+                        const unsigned char *m, unsigned long long mlen,
+                        xmss_workspace *ws);
+
+/**
+ * Derives a sub-key from sk that signs with the one-time keys start .. end-1
+ * only. Sub-keys of disjoint ranges share the public key of sk, but have
+ * their own state, so that they can sign independently (on other threads or
+ * machines). The index of sk is advanced to end (skipping any one-time keys
+ * before start), so that neither sk nor a later sub-key of it can sign in the
+ * range; sk has to be stored before the sub-key is handed out.
+ * The sub-key has xmss_subkey_bytes(params) bytes; sign with it using
+ * xmssmt_core_subkey_sign.
+ * Returns -1 if the range is empty, exceeds the key, or starts before the
+ * index of sk.
+ */
+int xmssmt_core_subkey(const xmss_params *params, unsigned char *subkey,
+                       unsigned char *sk,
+                       unsigned long long start, unsigned long long end);
+
 /**
  * Verifies a given message signature pair under a given public key.
  * Note that this assumes a pk without an OID, i.e. [root || PUB_SEED]
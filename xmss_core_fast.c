@@ -1,42 +1,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
 
 #include "hash.h"
 #include "hash_address.h"
 #include "params.h"
 #include "randombytes.h"
+#include "threadpool.h"
 #include "wots.h"
 #include "utils.h"
 #include "xmss_commons.h"
 #include "xmss_core.h"
-
-typedef struct{
-    unsigned char h;
-    unsigned long next_idx;
-    unsigned char stackusage;
-    unsigned char completed;
-    unsigned char *node;
-} treehash_inst;
-
-typedef struct {
-    unsigned char *stack;
-    unsigned int stackoffset;
-    unsigned char *stacklevels;
-    unsigned char *auth;
-    unsigned char *keep;
-    treehash_inst *treehash;
-    unsigned char *retain;
-    unsigned int next_leaf;
-} bds_state;
+#include "xmss_core_fast.h"
+#include "xmss_keygen.h"
 
 /* These serialization functions provide a transition between the current
    way of storing the state in an exposed struct, and storing it as part of the
    byte array that is the secret key.
    They will probably be refactored in a non-backwards-compatible way, soon. */
 
-static void xmssmt_serialize_state(const xmss_params *params,
-                                   unsigned char *sk, bds_state *states)
+void xmssmt_serialize_state(const xmss_params *params,
+                            unsigned char *sk, bds_state *states)
 {
     unsigned int i, j;
 
@@ -77,10 +64,10 @@ static void xmssmt_serialize_state(const xmss_params *params,
     }
 }
 
-static void xmssmt_deserialize_state(const xmss_params *params,
-                                     bds_state *states,
-                                     unsigned char **wots_sigs,
-                                     unsigned char *sk)
+void xmssmt_deserialize_state(const xmss_params *params,
+                              bds_state *states,
+                              unsigned char **wots_sigs,
+                              unsigned char *sk)
 {
     unsigned int i, j;
 
@@ -135,6 +122,61 @@ static void xmssmt_deserialize_state(const xmss_params *params,
     }
 }
 
+void xmssmt_export_state(const xmss_params *params, unsigned char *sk,
+                         const bds_state *states,
+                         const unsigned char *wots_sigs)
+{
+    unsigned int i, j;
+
+    /* Skip past the 'regular' sk */
+    sk += params->index_bytes + 4*params->n;
+
+    for (i = 0; i < 2*params->d - 1; i++) {
+        memcpy(sk, states[i].stack, (params->tree_height + 1) * params->n);
+        sk += (params->tree_height + 1) * params->n;
+
+        ull_to_bytes(sk, 4, states[i].stackoffset);
+        sk += 4;
+
+        memcpy(sk, states[i].stacklevels, params->tree_height + 1);
+        sk += params->tree_height + 1;
+
+        memcpy(sk, states[i].auth, params->tree_height * params->n);
+        sk += params->tree_height * params->n;
+
+        memcpy(sk, states[i].keep, (params->tree_height >> 1) * params->n);
+        sk += (params->tree_height >> 1) * params->n;
+
+        for (j = 0; j < params->tree_height - params->bds_k; j++) {
+            ull_to_bytes(sk, 1, states[i].treehash[j].h);
+            sk += 1;
+
+            ull_to_bytes(sk, 4, states[i].treehash[j].next_idx);
+            sk += 4;
+
+            ull_to_bytes(sk, 1, states[i].treehash[j].stackusage);
+            sk += 1;
+
+            ull_to_bytes(sk, 1, states[i].treehash[j].completed);
+            sk += 1;
+
+            memcpy(sk, states[i].treehash[j].node, params->n);
+            sk += params->n;
+        }
+
+        memcpy(sk, states[i].retain,
+               ((1 << params->bds_k) - params->bds_k - 1) * params->n);
+        sk += ((1 << params->bds_k) - params->bds_k - 1) * params->n;
+
+        ull_to_bytes(sk, 4, states[i].next_leaf);
+        sk += 4;
+    }
+
+    if (params->d > 1) {
+        memcpy(sk, wots_sigs, (params->d - 1) * params->wots_sig_bytes);
+    }
+}
+
 static void xmss_serialize_state(const xmss_params *params,
                                  unsigned char *sk, bds_state *state)
 {
@@ -161,9 +203,7 @@ static void memswap(void *a, void *b, void *t, unsigned long long len)
  * it is now necessary to make swaps 'real swaps'. This could be done in the
  * serialization function as well, but that causes more overhead
  */
-// TODO this should not be necessary if we keep better track of the states
-static void deep_state_swap(const xmss_params *params,
-                            bds_state *a, bds_state *b)
+void deep_state_swap(const xmss_params *params, bds_state *a, bds_state *b)
 {
     // TODO this is extremely ugly and should be refactored
     // TODO right now, this ensures that both 'stack' and 'retain' fit
@@ -192,8 +232,24 @@ static void deep_state_swap(const xmss_params *params,
     memswap(&a->next_leaf, &b->next_leaf, t, sizeof(a->next_leaf));
 }
 
+/**
+ * Swaps the content of two bds_state objects by exchanging the pointers.
+ * This is only valid for states that are not mapped onto the secret key, such
+ * as the ones held by an xmss_signer; those get written back using
+ * xmssmt_export_state instead.
+ */
+void bds_state_swap(const xmss_params *params, bds_state *a, bds_state *b)
+{
+    bds_state t = *a;
+
+    (void)params;
+    *a = *b;
+    *b = t;
+}
+
+#ifdef BDS_LINEAR_SCAN
 static int treehash_minheight_on_stack(const xmss_params *params,
-                                       bds_state *state,
+                                       const bds_state *state,
                                        const treehash_inst *treehash)
 {
     unsigned int r = params->tree_height, i;
@@ -207,187 +263,327 @@ static int treehash_minheight_on_stack(const xmss_params *params,
 }
 
 /**
- * Merkle's TreeHash algorithm. The address only needs to initialize the first 78 bits of addr. Everything else will be set by treehash.
- * Currently only used for key generation.
- *
+ * Returns the key by which bds_treehash_update orders treehash instance i;
+ * the instance with the lowest key (and then the lowest index) goes first.
  */
-static void treehash_init(const xmss_params *params,
-                          unsigned char *node, int height, int index,
-                          bds_state *state, const unsigned char *sk_seed,
-                          const unsigned char *pub_seed, const uint32_t addr[8])
+static unsigned int treehash_key(const xmss_params *params,
+                                 const bds_state *state, unsigned int i)
 {
-    unsigned int idx = index;
-    // use three different addresses because at this point we use all three formats in parallel
-    uint32_t ots_addr[8] = {0};
-    uint32_t ltree_addr[8] = {0};
-    uint32_t node_addr[8] = {0};
-    // only copy layer and tree address parts
-    copy_subtree_addr(ots_addr, addr);
-    // type = ots
-    set_type(ots_addr, 0);
-    copy_subtree_addr(ltree_addr, addr);
-    set_type(ltree_addr, 1);
-    copy_subtree_addr(node_addr, addr);
-    set_type(node_addr, 2);
+    if (state->treehash[i].completed) {
+        return params->tree_height;
+    }
+    if (state->treehash[i].stackusage == 0) {
+        return i;
+    }
+    return treehash_minheight_on_stack(params, state, &(state->treehash[i]));
+}
+#else
+/* Marks a treehash instance that is not in the schedule heap. */
+#define BDS_HEAP_NONE 0xFF
 
-    uint32_t lastnode, i;
-    unsigned char stack[(height+1)*params->n];
-    unsigned int stacklevels[height+1];
-    unsigned int stackoffset=0;
-    unsigned int nodeh;
+/*
+ * The heights on the stack fall from bottom to top: an instance only starts
+ * while another one has nodes on the stack if its own nodes are lower than
+ * all of those, and it then has the lower index. So the lowest node of every
+ * instance with nodes on the stack is the top of the stack, and of those
+ * instances, the one with the lowest index (which owns the top) always goes
+ * first. Only that instance is kept in the heap, keyed by the top height;
+ * a waiting instance is keyed by its index. Keys are cached in the
+ * instances, and an update only moves the instances it changed.
+ */
 
-    lastnode = idx+(1<<height);
+/**
+ * Returns the instance with nodes on the stack that has the lowest index, or
+ * h - k if there is none.
+ */
+static unsigned int treehash_top_active(const xmss_params *params,
+                                        const bds_state *state)
+{
+    unsigned long long active = state->heapactive;
+    unsigned int i = 0;
 
-    for (i = 0; i < params->tree_height-params->bds_k; i++) {
-        state->treehash[i].h = i;
-        state->treehash[i].completed = 1;
-        state->treehash[i].stackusage = 0;
+    if (active == 0) {
+        return params->tree_height - params->bds_k;
+    }
+#ifdef __GNUC__
+    i = __builtin_ctzll(active);
+#else
+    while (!(active & 1)) {
+        active >>= 1;
+        i++;
     }
+#endif
+    return i;
+}
 
-    i = 0;
-    for (; idx < lastnode; idx++) {
-        set_ltree_addr(ltree_addr, idx);
-        set_ots_addr(ots_addr, idx);
-        gen_leaf_wots(params, stack+stackoffset*params->n, sk_seed, pub_seed, ltree_addr, ots_addr);
-        stacklevels[stackoffset] = 0;
-        stackoffset++;
-        if (params->tree_height - params->bds_k > 0 && i == 3) {
-            memcpy(state->treehash[0].node, stack+stackoffset*params->n, params->n);
+static int heap_before(const bds_state *state, unsigned int a, unsigned int b)
+{
+    return state->treehash[a].heapkey < state->treehash[b].heapkey ||
+           (state->treehash[a].heapkey == state->treehash[b].heapkey && a < b);
+}
+
+static void heap_place(bds_state *state, unsigned int pos, unsigned int i)
+{
+    state->heap[pos] = i;
+    state->treehash[i].heappos = pos;
+}
+
+/**
+ * Moves the instance at position pos up or down to where it belongs.
+ */
+static void heap_sift(bds_state *state, unsigned int pos)
+{
+    unsigned int i = state->heap[pos];
+    unsigned int child;
+
+    while (pos > 0 && heap_before(state, i, state->heap[(pos - 1) >> 1])) {
+        heap_place(state, pos, state->heap[(pos - 1) >> 1]);
+        pos = (pos - 1) >> 1;
+    }
+    for (;;) {
+        child = 2*pos + 1;
+        if (child >= state->heapsize) {
+            break;
         }
-        while (stackoffset>1 && stacklevels[stackoffset-1] == stacklevels[stackoffset-2]) {
-            nodeh = stacklevels[stackoffset-1];
-            if (i >> nodeh == 1) {
-                memcpy(state->auth + nodeh*params->n, stack+(stackoffset-1)*params->n, params->n);
-            }
-            else {
-                if (nodeh < params->tree_height - params->bds_k && i >> nodeh == 3) {
-                    memcpy(state->treehash[nodeh].node, stack+(stackoffset-1)*params->n, params->n);
-                }
-                else if (nodeh >= params->tree_height - params->bds_k) {
-                    memcpy(state->retain + ((1 << (params->tree_height - 1 - nodeh)) + nodeh - params->tree_height + (((i >> nodeh) - 3) >> 1)) * params->n, stack+(stackoffset-1)*params->n, params->n);
-                }
-            }
-            set_tree_height(node_addr, stacklevels[stackoffset-1]);
-            set_tree_index(node_addr, (idx >> (stacklevels[stackoffset-1]+1)));
-            thash_h(params, stack+(stackoffset-2)*params->n, stack+(stackoffset-2)*params->n, pub_seed, node_addr);
-            stacklevels[stackoffset-2]++;
-            stackoffset--;
+        if (child + 1 < state->heapsize &&
+            heap_before(state, state->heap[child + 1], state->heap[child])) {
+            child++;
         }
-        i++;
+        if (!heap_before(state, state->heap[child], i)) {
+            break;
+        }
+        heap_place(state, pos, state->heap[child]);
+        pos = child;
     }
+    heap_place(state, pos, i);
+}
 
-    for (i = 0; i < params->n; i++) {
-        node[i] = stack[i];
+/**
+ * Takes treehash instance i out of the schedule heap, if it is in it.
+ */
+static void heap_remove(bds_state *state, unsigned int i)
+{
+    unsigned int pos = state->treehash[i].heappos;
+
+    if (pos == BDS_HEAP_NONE) {
+        return;
+    }
+    state->treehash[i].heappos = BDS_HEAP_NONE;
+    state->heapsize--;
+    if (pos < state->heapsize) {
+        heap_place(state, pos, state->heap[state->heapsize]);
+        heap_sift(state, pos);
     }
 }
 
-static void treehash_update(const xmss_params *params,
-                            treehash_inst *treehash, bds_state *state,
-                            const unsigned char *sk_seed,
-                            const unsigned char *pub_seed,
-                            const uint32_t addr[8])
+/**
+ * Puts treehash instance i into the schedule heap with the given key, or
+ * moves it to where that key belongs.
+ */
+static void heap_set(bds_state *state, unsigned int i, unsigned int key)
 {
-    uint32_t ots_addr[8] = {0};
-    uint32_t ltree_addr[8] = {0};
-    uint32_t node_addr[8] = {0};
-    // only copy layer and tree address parts
-    copy_subtree_addr(ots_addr, addr);
-    // type = ots
-    set_type(ots_addr, 0);
-    copy_subtree_addr(ltree_addr, addr);
-    set_type(ltree_addr, 1);
-    copy_subtree_addr(node_addr, addr);
-    set_type(node_addr, 2);
+    state->treehash[i].heapkey = key;
+    if (state->treehash[i].heappos == BDS_HEAP_NONE) {
+        heap_place(state, state->heapsize, i);
+        state->heapsize++;
+    }
+    heap_sift(state, state->treehash[i].heappos);
+}
+#endif
 
-    set_ltree_addr(ltree_addr, treehash->next_idx);
-    set_ots_addr(ots_addr, treehash->next_idx);
+unsigned int bds_treehash_select(const xmss_params *params,
+                                 const bds_state *state)
+{
+#ifdef BDS_LINEAR_SCAN
+    unsigned int i, level, l_min, low;
 
-    unsigned char nodebuffer[2 * params->n];
-    unsigned int nodeheight = 0;
-    gen_leaf_wots(params, nodebuffer, sk_seed, pub_seed, ltree_addr, ots_addr);
-    while (treehash->stackusage > 0 && state->stacklevels[state->stackoffset-1] == nodeheight) {
-        memcpy(nodebuffer + params->n, nodebuffer, params->n);
-        memcpy(nodebuffer, state->stack + (state->stackoffset-1)*params->n, params->n);
-        set_tree_height(node_addr, nodeheight);
-        set_tree_index(node_addr, (treehash->next_idx >> (nodeheight+1)));
-        thash_h(params, nodebuffer, nodebuffer, pub_seed, node_addr);
-        nodeheight++;
-        treehash->stackusage--;
-        state->stackoffset--;
+    l_min = params->tree_height;
+    level = params->tree_height - params->bds_k;
+    for (i = 0; i < params->tree_height - params->bds_k; i++) {
+        low = treehash_key(params, state, i);
+        if (low < l_min) {
+            level = i;
+            l_min = low;
+        }
     }
-    if (nodeheight == treehash->h) { // this also implies stackusage == 0
-        memcpy(treehash->node, nodebuffer, params->n);
-        treehash->completed = 1;
+    return level;
+#else
+    if (state->heapsize == 0) {
+        return params->tree_height - params->bds_k;
+    }
+    return state->heap[0];
+#endif
+}
+
+void bds_treehash_reschedule(const xmss_params *params,
+                             bds_state *state, unsigned int i)
+{
+#ifdef BDS_LINEAR_SCAN
+    (void)params;
+    (void)state;
+    (void)i;
+#else
+    const unsigned int instances = params->tree_height - params->bds_k;
+    const treehash_inst *treehash = &(state->treehash[i]);
+    unsigned int old_top = treehash_top_active(params, state);
+    unsigned int top;
+
+    if (!treehash->completed && treehash->stackusage > 0) {
+        state->heapactive |= 1ULL << i;
     }
     else {
-        memcpy(state->stack + state->stackoffset*params->n, nodebuffer, params->n);
-        treehash->stackusage++;
-        state->stacklevels[state->stackoffset] = nodeheight;
-        state->stackoffset++;
-        treehash->next_idx++;
+        state->heapactive &= ~(1ULL << i);
+    }
+    top = treehash_top_active(params, state);
+
+    if (treehash->completed || (treehash->stackusage > 0 && i != top)) {
+        heap_remove(state, i);
+    }
+    else {
+        heap_set(state, i, treehash->stackusage > 0 ?
+                 state->stacklevels[state->stackoffset - 1] : i);
+    }
+    /* A new top buries the instance that held the top before; when i is
+       done, the instance below it takes over the (changed) top. */
+    if (old_top != top && old_top != i && old_top < instances) {
+        heap_remove(state, old_top);
+    }
+    if (top != i && top < instances) {
+        heap_set(state, top, state->stacklevels[state->stackoffset - 1]);
+    }
+#endif
+}
+
+void bds_treehash_schedule_init(const xmss_params *params, bds_state *state)
+{
+#ifdef BDS_LINEAR_SCAN
+    (void)params;
+    (void)state;
+#else
+    const unsigned int instances = params->tree_height - params->bds_k;
+    unsigned int i;
+
+    state->heapsize = 0;
+    state->heapactive = 0;
+    for (i = 0; i < instances; i++) {
+        state->treehash[i].heappos = BDS_HEAP_NONE;
+        if (!state->treehash[i].completed && state->treehash[i].stackusage > 0) {
+            state->heapactive |= 1ULL << i;
+        }
+    }
+    for (i = 0; i < instances; i++) {
+        bds_treehash_reschedule(params, state, i);
+    }
+#endif
+}
+
+/* The progress of treehash_init through a tree: the number of leaves that
+   have been added, and the stack of nodes that have not been merged yet. This
+   is all that a key generation has to keep (apart from the sk that the BDS
+   state is mapped onto) to continue later; see xmss_keygen.h. */
+typedef struct {
+    uint32_t leaf;
+    unsigned int stackoffset;
+    unsigned char *stacklevels;
+    unsigned char *stack;
+} treehash_cursor;
+
+/**
+ * Resets the treehash instances of state, before treehash_init_leaves fills
+ * in the BDS state of a tree.
+ */
+static void treehash_init_start(const xmss_params *params, bds_state *state)
+{
+    unsigned int i;
+
+    for (i = 0; i < params->tree_height-params->bds_k; i++) {
+        state->treehash[i].h = i;
+        state->treehash[i].completed = 1;
+        state->treehash[i].stackusage = 0;
     }
+    bds_treehash_schedule_init(params, state);
 }
 
 /**
- * Performs treehash updates on the instance that needs it the most.
- * Returns the updated number of available updates.
- **/
-static char bds_treehash_update(const xmss_params *params,
-                                bds_state *state, unsigned int updates,
-                                const unsigned char *sk_seed,
-                                unsigned char *pub_seed,
-                                const uint32_t addr[8])
+ * Adds the leaf at the top of the stack of the cursor, i.e. leaf cursor->leaf
+ * of the tree starting at index, and merges it with the nodes below it. The
+ * nodes that the BDS state keeps are stored in state along the way.
+ */
+static void treehash_init_push(const xmss_params *params,
+                               treehash_cursor *cursor, int index,
+                               bds_state *state, const unsigned char *pub_seed,
+                               uint32_t node_addr[8])
 {
-    uint32_t i, j;
-    unsigned int level, l_min, low;
-    unsigned int used = 0;
+    unsigned char *stack = cursor->stack;
+    unsigned char *stacklevels = cursor->stacklevels;
+    unsigned int stackoffset = cursor->stackoffset;
+    unsigned int nodeh;
+    uint32_t i = cursor->leaf;
+    uint32_t idx = index + i;
 
-    for (j = 0; j < updates; j++) {
-        l_min = params->tree_height;
-        level = params->tree_height - params->bds_k;
-        for (i = 0; i < params->tree_height - params->bds_k; i++) {
-            if (state->treehash[i].completed) {
-                low = params->tree_height;
-            }
-            else if (state->treehash[i].stackusage == 0) {
-                low = i;
-            }
-            else {
-                low = treehash_minheight_on_stack(params, state, &(state->treehash[i]));
+    stacklevels[stackoffset] = 0;
+    stackoffset++;
+    if (params->tree_height - params->bds_k > 0 && i == 3) {
+        memcpy(state->treehash[0].node, stack+stackoffset*params->n, params->n);
+    }
+    while (stackoffset>1 && stacklevels[stackoffset-1] == stacklevels[stackoffset-2]) {
+        nodeh = stacklevels[stackoffset-1];
+        if (i >> nodeh == 1) {
+            memcpy(state->auth + nodeh*params->n, stack+(stackoffset-1)*params->n, params->n);
+        }
+        else {
+            if (nodeh < params->tree_height - params->bds_k && i >> nodeh == 3) {
+                memcpy(state->treehash[nodeh].node, stack+(stackoffset-1)*params->n, params->n);
             }
-            if (low < l_min) {
-                level = i;
-                l_min = low;
+            else if (nodeh >= params->tree_height - params->bds_k) {
+                memcpy(state->retain + ((1 << (params->tree_height - 1 - nodeh)) + nodeh - params->tree_height + (((i >> nodeh) - 3) >> 1)) * params->n, stack+(stackoffset-1)*params->n, params->n);
             }
         }
-        if (level == params->tree_height - params->bds_k) {
-            break;
-        }
-        treehash_update(params, &(state->treehash[level]), state, sk_seed, pub_seed, addr);
-        used++;
+        set_tree_height(node_addr, stacklevels[stackoffset-1]);
+        set_tree_index(node_addr, (idx >> (stacklevels[stackoffset-1]+1)));
+        thash_h(params, stack+(stackoffset-2)*params->n, stack+(stackoffset-2)*params->n, pub_seed, node_addr);
+        stacklevels[stackoffset-2]++;
+        stackoffset--;
     }
-    return updates - used;
+
+    cursor->leaf = i + 1;
+    cursor->stackoffset = stackoffset;
 }
 
 /**
- * Updates the state (typically NEXT_i) by adding a leaf and updating the stack
- * Returns -1 if all leaf nodes have already been processed
- **/
-static char bds_state_update(const xmss_params *params,
-                             bds_state *state, const unsigned char *sk_seed,
-                             const unsigned char *pub_seed,
-                             const uint32_t addr[8])
+ * Returns the index one past the last leaf of the next 'count' leaves of the
+ * tree of 2^height leaves from index on, as continued at cursor.
+ */
+static uint32_t treehash_init_end(const treehash_cursor *cursor,
+                                  uint32_t count, int height, int index)
 {
-    uint32_t ltree_addr[8] = {0};
-    uint32_t node_addr[8] = {0};
-    uint32_t ots_addr[8] = {0};
+    uint32_t lastnode = index + cursor->leaf + count;
 
-    unsigned int nodeh;
-    int idx = state->next_leaf;
-    if (idx == 1 << params->tree_height) {
-        return -1;
+    if (lastnode > (uint32_t)index + (1 << height)) {
+        lastnode = index + (1 << height);
     }
+    return lastnode;
+}
 
+/**
+ * Merkle's TreeHash algorithm, continued at cursor for the next 'count'
+ * leaves (of the 2^height leaves from index on). Once all leaves have been
+ * added, the root is at the bottom of the stack of the cursor.
+ * The address only needs to initialize the first 78 bits of addr. Everything
+ * else will be set by treehash.
+ * Currently only used for key generation.
+ */
+static void treehash_init_leaves(const xmss_params *params,
+                                 treehash_cursor *cursor, uint32_t count,
+                                 int height, int index, bds_state *state,
+                                 const unsigned char *sk_seed,
+                                 const unsigned char *pub_seed,
+                                 const uint32_t addr[8])
+{
+    // use three different addresses because at this point we use all three formats in parallel
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+    uint32_t node_addr[8] = {0};
     // only copy layer and tree address parts
     copy_subtree_addr(ots_addr, addr);
     // type = ots
@@ -397,12 +593,420 @@ static char bds_state_update(const xmss_params *params,
     copy_subtree_addr(node_addr, addr);
     set_type(node_addr, 2);
 
-    set_ots_addr(ots_addr, idx);
-    set_ltree_addr(ltree_addr, idx);
+    uint32_t idx, lastnode;
 
-    gen_leaf_wots(params, state->stack+state->stackoffset*params->n, sk_seed, pub_seed, ltree_addr, ots_addr);
+    lastnode = treehash_init_end(cursor, count, height, index);
+    for (idx = index + cursor->leaf; idx < lastnode; idx++) {
+        set_ltree_addr(ltree_addr, idx);
+        set_ots_addr(ots_addr, idx);
+        gen_leaf_wots(params, cursor->stack+cursor->stackoffset*params->n, sk_seed, pub_seed, ltree_addr, ots_addr);
+        treehash_init_push(params, cursor, index, state, pub_seed, node_addr);
+    }
+}
 
-    state->stacklevels[state->stackoffset] = 0;
+/* Leaves that a thread of a keygen pipeline claims at once. */
+#define KEYGEN_BLOCK 16
+
+/* A pipeline that computes the leaves of a tree for key generation on a
+   pool: every thread claims blocks of consecutive leaves and computes them
+   into a ring of slots, and whichever thread holds the merge role adds the
+   leaves that are ready to the tree, in order. The ring is bounded by the
+   merging; a slot is only filled once the leaf that was in it has been
+   merged. No thread waits for a call that may not have started yet, so this
+   also works while the threads of the pool are busy with other loops. */
+typedef struct {
+    const xmss_params *params;
+    const unsigned char *sk_seed;
+    const unsigned char *pub_seed;
+    const uint32_t *addr;
+    treehash_cursor *cursor;
+    bds_state *state;
+    int index;
+    /* The leaves first .. end-1 of the tree are computed. */
+    uint32_t first;
+    uint32_t end;
+    /* slots leaves of n bytes; ready[s] is 1 + the leaf in slot s. */
+    unsigned char *ring;
+    atomic_uint *ready;
+    unsigned int slots;
+    /* The next leaf to be claimed, and the first one not yet merged. */
+    atomic_uint next;
+    atomic_uint merged;
+    /* Set while a thread merges; it owns the cursor and state meanwhile. */
+    atomic_flag merging;
+} keygen_pipeline;
+
+/**
+ * Returns the number of slots of the ring of a pipeline with 'threads'
+ * threads: a power of two that fits two blocks per thread.
+ */
+static unsigned int keygen_pipeline_slots(unsigned int threads)
+{
+    unsigned int slots = KEYGEN_BLOCK;
+
+    while (slots < 2 * KEYGEN_BLOCK * threads) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+/**
+ * Adds the leaves that are ready to the tree, in order, unless another thread
+ * is already doing so.
+ */
+static void keygen_merge(keygen_pipeline *pipe)
+{
+    const xmss_params *params = pipe->params;
+    treehash_cursor *cursor = pipe->cursor;
+    uint32_t node_addr[8] = {0};
+    uint32_t idx;
+    unsigned int slot;
+
+    if (atomic_flag_test_and_set_explicit(&pipe->merging, memory_order_acquire)) {
+        return;
+    }
+    copy_subtree_addr(node_addr, pipe->addr);
+    set_type(node_addr, 2);
+
+    for (idx = atomic_load_explicit(&pipe->merged, memory_order_relaxed);
+         idx < pipe->end; idx++) {
+        slot = idx & (pipe->slots - 1);
+        if (atomic_load_explicit(&pipe->ready[slot], memory_order_acquire) != idx + 1) {
+            break;
+        }
+        memcpy(cursor->stack + cursor->stackoffset*params->n,
+               pipe->ring + slot*params->n, params->n);
+        atomic_store_explicit(&pipe->merged, idx + 1, memory_order_release);
+        treehash_init_push(params, cursor, pipe->index, pipe->state,
+                           pipe->pub_seed, node_addr);
+    }
+    atomic_flag_clear_explicit(&pipe->merging, memory_order_release);
+}
+
+/**
+ * Runs one thread of the pipeline; called from threadpool_run. Computes the
+ * leaves of the blocks that it claims, merging whenever the ring is full,
+ * and returns once all leaves have been merged. The leaf that is merged next
+ * has been claimed by a running thread, and is at most a block ahead of the
+ * merged ones, so that thread can always compute it.
+ */
+static void keygen_pipeline_run(void *arg, unsigned int i)
+{
+    keygen_pipeline *pipe = arg;
+    const xmss_params *params = pipe->params;
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+    uint32_t idx, block, end;
+    unsigned int slot;
+    (void)i;
+
+    copy_subtree_addr(ots_addr, pipe->addr);
+    set_type(ots_addr, 0);
+    copy_subtree_addr(ltree_addr, pipe->addr);
+    set_type(ltree_addr, 1);
+
+    for (;;) {
+        block = atomic_fetch_add(&pipe->next, KEYGEN_BLOCK);
+        if (block >= pipe->end) {
+            break;
+        }
+        end = block + KEYGEN_BLOCK < pipe->end ? block + KEYGEN_BLOCK : pipe->end;
+        for (idx = block; idx < end; idx++) {
+            while (idx - atomic_load_explicit(&pipe->merged, memory_order_acquire) >= pipe->slots) {
+                keygen_merge(pipe);
+                sched_yield();
+            }
+            slot = idx & (pipe->slots - 1);
+            set_ltree_addr(ltree_addr, pipe->index + idx);
+            set_ots_addr(ots_addr, pipe->index + idx);
+            gen_leaf_wots(params, pipe->ring + slot*params->n, pipe->sk_seed,
+                          pipe->pub_seed, ltree_addr, ots_addr);
+            atomic_store_explicit(&pipe->ready[slot], idx + 1, memory_order_release);
+        }
+        keygen_merge(pipe);
+    }
+    while (atomic_load_explicit(&pipe->merged, memory_order_acquire) < pipe->end) {
+        keygen_merge(pipe);
+        sched_yield();
+    }
+}
+
+/**
+ * Continues treehash_init_leaves at cursor for the next 'count' leaves, but
+ * computes the leaves on the threads of pool, in a pipeline with a ring of
+ * keygen_pipeline_slots(threadpool_size(pool)) slots of ring and ready.
+ * The result is identical to that of treehash_init_leaves.
+ */
+static void treehash_init_pipelined(const xmss_params *params,
+                                    treehash_cursor *cursor, uint32_t count,
+                                    int height, int index, bds_state *state,
+                                    const unsigned char *sk_seed,
+                                    const unsigned char *pub_seed,
+                                    const uint32_t addr[8], threadpool *pool,
+                                    unsigned char *ring, atomic_uint *ready)
+{
+    keygen_pipeline pipe;
+    unsigned int i;
+
+    pipe.params = params;
+    pipe.sk_seed = sk_seed;
+    pipe.pub_seed = pub_seed;
+    pipe.addr = addr;
+    pipe.cursor = cursor;
+    pipe.state = state;
+    pipe.index = index;
+    pipe.first = cursor->leaf;
+    pipe.end = treehash_init_end(cursor, count, height, index) - index;
+    pipe.ring = ring;
+    pipe.ready = ready;
+    pipe.slots = keygen_pipeline_slots(threadpool_size(pool));
+    /* Slots that were used for other leaves before must not look ready. */
+    for (i = 0; i < pipe.slots; i++) {
+        atomic_init(&ready[i], 0);
+    }
+    atomic_init(&pipe.next, pipe.first);
+    atomic_init(&pipe.merged, pipe.first);
+    atomic_flag_clear(&pipe.merging);
+
+    threadpool_run(pool, keygen_pipeline_run, &pipe, threadpool_size(pool));
+}
+
+/**
+ * Merkle's TreeHash algorithm. The address only needs to initialize the first 78 bits of addr. Everything else will be set by treehash.
+ * Currently only used for key generation.
+ *
+ */
+static void treehash_init(const xmss_params *params,
+                          unsigned char *node, int height, int index,
+                          bds_state *state, const unsigned char *sk_seed,
+                          const unsigned char *pub_seed, const uint32_t addr[8])
+{
+    unsigned char stack[(height+1)*params->n];
+    unsigned char stacklevels[height+1];
+    treehash_cursor cursor = {0, 0, stacklevels, stack};
+
+    treehash_init_start(params, state);
+    treehash_init_leaves(params, &cursor, 1 << height, height, index, state,
+                         sk_seed, pub_seed, addr);
+    memcpy(node, stack, params->n);
+}
+
+/**
+ * Adds the leaf treehash->next_idx, which the caller has computed, to the
+ * treehash instance, merging it with the nodes of the instance on the stack.
+ */
+static void treehash_update(const xmss_params *params,
+                            treehash_inst *treehash, bds_state *state,
+                            const unsigned char *leaf,
+                            const unsigned char *pub_seed,
+                            const uint32_t addr[8])
+{
+    uint32_t node_addr[8] = {0};
+    // only copy layer and tree address parts
+    copy_subtree_addr(node_addr, addr);
+    set_type(node_addr, 2);
+
+    unsigned char nodebuffer[2 * params->n];
+    unsigned int nodeheight = 0;
+    memcpy(nodebuffer, leaf, params->n);
+    while (treehash->stackusage > 0 && state->stacklevels[state->stackoffset-1] == nodeheight) {
+        memcpy(nodebuffer + params->n, nodebuffer, params->n);
+        memcpy(nodebuffer, state->stack + (state->stackoffset-1)*params->n, params->n);
+        set_tree_height(node_addr, nodeheight);
+        set_tree_index(node_addr, (treehash->next_idx >> (nodeheight+1)));
+        thash_h(params, nodebuffer, nodebuffer, pub_seed, node_addr);
+        nodeheight++;
+        treehash->stackusage--;
+        state->stackoffset--;
+    }
+    if (nodeheight == treehash->h) { // this also implies stackusage == 0
+        memcpy(treehash->node, nodebuffer, params->n);
+        treehash->completed = 1;
+    }
+    else {
+        memcpy(state->stack + state->stackoffset*params->n, nodebuffer, params->n);
+        treehash->stackusage++;
+        state->stacklevels[state->stackoffset] = nodeheight;
+        state->stackoffset++;
+        treehash->next_idx++;
+    }
+}
+
+/**
+ * Applies the effect of treehash_update to the heights and counters only.
+ * As the choice of instances does not depend on any node values, this allows
+ * planning the updates (and thus the leaves they need) ahead of time.
+ */
+static void treehash_plan_update(treehash_inst *treehash, bds_state *state)
+{
+    unsigned int nodeheight = 0;
+
+    while (treehash->stackusage > 0 && state->stacklevels[state->stackoffset-1] == nodeheight) {
+        nodeheight++;
+        treehash->stackusage--;
+        state->stackoffset--;
+    }
+    if (nodeheight == treehash->h) {
+        treehash->completed = 1;
+    }
+    else {
+        treehash->stackusage++;
+        state->stacklevels[state->stackoffset] = nodeheight;
+        state->stackoffset++;
+        treehash->next_idx++;
+    }
+}
+
+/* The leaves for a batch of planned treehash updates, see treehash_leaf. */
+typedef struct {
+    const xmss_params *params;
+    const unsigned char *sk_seed;
+    const unsigned char *pub_seed;
+    const uint32_t *addr;
+    const unsigned long *leaf_idx;
+    unsigned char *leaves;
+    /* The workspace for computing the leaves, if they are computed on the
+       calling thread; NULL if they are computed on a pool. */
+    xmss_workspace *ws;
+} treehash_leaves;
+
+/**
+ * Computes leaf i of a batch; called from threadpool_run.
+ */
+static void treehash_leaf(void *arg, unsigned int i)
+{
+    const treehash_leaves *job = arg;
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+
+    copy_subtree_addr(ots_addr, job->addr);
+    set_type(ots_addr, 0);
+    copy_subtree_addr(ltree_addr, job->addr);
+    set_type(ltree_addr, 1);
+
+    set_ltree_addr(ltree_addr, job->leaf_idx[i]);
+    set_ots_addr(ots_addr, job->leaf_idx[i]);
+    if (job->ws != NULL) {
+        gen_leaf_wots_ws(job->params, job->leaves + i*job->params->n,
+                         job->sk_seed, job->pub_seed, ltree_addr, ots_addr,
+                         job->ws);
+    }
+    else {
+        gen_leaf_wots(job->params, job->leaves + i*job->params->n,
+                      job->sk_seed, job->pub_seed, ltree_addr, ots_addr);
+    }
+}
+
+/**
+ * Performs treehash updates on the instance that needs it the most.
+ * The updates are planned first, so that the leaves they need can be
+ * computed concurrently on the pool (if not NULL); the resulting nodes are
+ * then merged in order, exactly as if the updates were done one by one.
+ * Returns the updated number of available updates.
+ **/
+static char bds_treehash_update(const xmss_params *params,
+                                bds_state *state, unsigned int updates,
+                                const unsigned char *sk_seed,
+                                const unsigned char *pub_seed,
+                                const uint32_t addr[8], threadpool *pool,
+                                xmss_workspace *ws)
+{
+    const unsigned int instances = params->tree_height - params->bds_k;
+    const unsigned long long mark = ws->used;
+    uint32_t j;
+    unsigned int level;
+    unsigned int used = 0;
+
+    /* Plan on a copy of the heights and counters of the state. */
+    bds_state plan = *state;
+    treehash_inst *plan_treehash = xmss_ws_alloc(ws, (instances + 1) * sizeof(treehash_inst));
+    unsigned char *plan_heap = xmss_ws_alloc(ws, instances + 1);
+    unsigned char *plan_stacklevels = xmss_ws_alloc(ws, params->tree_height + 1);
+    unsigned int *levels = xmss_ws_alloc(ws, (updates + 1) * sizeof(unsigned int));
+    unsigned long *leaf_idx = xmss_ws_alloc(ws, (updates + 1) * sizeof(unsigned long));
+    unsigned char *leaves = xmss_ws_alloc(ws, (updates + 1) * params->n);
+    treehash_leaves job = {params, sk_seed, pub_seed, addr, leaf_idx, leaves,
+                           pool == NULL ? ws : NULL};
+
+    memcpy(plan_treehash, state->treehash, instances * sizeof(treehash_inst));
+    memcpy(plan_heap, state->heap, instances);
+    memcpy(plan_stacklevels, state->stacklevels, params->tree_height + 1);
+    plan.treehash = plan_treehash;
+    plan.heap = plan_heap;
+    plan.stacklevels = plan_stacklevels;
+
+    for (j = 0; j < updates; j++) {
+        level = bds_treehash_select(params, &plan);
+        if (level == instances) {
+            break;
+        }
+        levels[used] = level;
+        leaf_idx[used] = plan.treehash[level].next_idx;
+        treehash_plan_update(&(plan.treehash[level]), &plan);
+        bds_treehash_reschedule(params, &plan, level);
+        used++;
+    }
+
+    threadpool_run(pool, treehash_leaf, &job, used);
+
+    for (j = 0; j < used; j++) {
+        treehash_update(params, &(state->treehash[levels[j]]), state,
+                        leaves + j*params->n, pub_seed, addr);
+        bds_treehash_reschedule(params, state, levels[j]);
+    }
+    ws->used = mark;
+    return updates - used;
+}
+
+/* The workspace that bds_treehash_update takes. */
+static unsigned long long bds_treehash_update_workspace_size(const xmss_params *params)
+{
+    const unsigned int instances = params->tree_height - params->bds_k;
+    const unsigned int updates = (params->tree_height - params->bds_k) >> 1;
+
+    return xmss_ws_round((instances + 1) * sizeof(treehash_inst)) +
+           xmss_ws_round(instances + 1) +
+           xmss_ws_round(params->tree_height + 1) +
+           xmss_ws_round((updates + 1) * sizeof(unsigned int)) +
+           xmss_ws_round((updates + 1) * sizeof(unsigned long)) +
+           xmss_ws_round((updates + 1) * params->n) +
+           xmss_leaf_workspace_size(params);
+}
+
+/**
+ * Updates the state (typically NEXT_i) by adding a leaf and updating the stack
+ * Returns -1 if all leaf nodes have already been processed
+ **/
+static char bds_state_update(const xmss_params *params,
+                             bds_state *state, const unsigned char *sk_seed,
+                             const unsigned char *pub_seed,
+                             const uint32_t addr[8], xmss_workspace *ws)
+{
+    uint32_t ltree_addr[8] = {0};
+    uint32_t node_addr[8] = {0};
+    uint32_t ots_addr[8] = {0};
+
+    unsigned int nodeh;
+    int idx = state->next_leaf;
+    if (idx == 1 << params->tree_height) {
+        return -1;
+    }
+
+    // only copy layer and tree address parts
+    copy_subtree_addr(ots_addr, addr);
+    // type = ots
+    set_type(ots_addr, 0);
+    copy_subtree_addr(ltree_addr, addr);
+    set_type(ltree_addr, 1);
+    copy_subtree_addr(node_addr, addr);
+    set_type(node_addr, 2);
+
+    set_ots_addr(ots_addr, idx);
+    set_ltree_addr(ltree_addr, idx);
+
+    gen_leaf_wots_ws(params, state->stack+state->stackoffset*params->n, sk_seed, pub_seed, ltree_addr, ots_addr, ws);
+
+    state->stacklevels[state->stackoffset] = 0;
     state->stackoffset++;
     if (params->tree_height - params->bds_k > 0 && idx == 3) {
         memcpy(state->treehash[0].node, state->stack+state->stackoffset*params->n, params->n);
@@ -439,13 +1043,15 @@ static char bds_state_update(const xmss_params *params,
 static void bds_round(const xmss_params *params,
                       bds_state *state, const unsigned long leaf_idx,
                       const unsigned char *sk_seed,
-                      const unsigned char *pub_seed, uint32_t addr[8])
+                      const unsigned char *pub_seed, uint32_t addr[8],
+                      xmss_workspace *ws)
 {
+    const unsigned long long mark = ws->used;
     unsigned int i;
     unsigned int tau = params->tree_height;
     unsigned int startidx;
     unsigned int offset, rowidx;
-    unsigned char buf[2 * params->n];
+    unsigned char *buf = xmss_ws_alloc(ws, 2 * params->n);
 
     uint32_t ots_addr[8] = {0};
     uint32_t ltree_addr[8] = {0};
@@ -478,7 +1084,7 @@ static void bds_round(const xmss_params *params,
     if (tau == 0) {
         set_ltree_addr(ltree_addr, leaf_idx);
         set_ots_addr(ots_addr, leaf_idx);
-        gen_leaf_wots(params, state->auth, sk_seed, pub_seed, ltree_addr, ots_addr);
+        gen_leaf_wots_ws(params, state->auth, sk_seed, pub_seed, ltree_addr, ots_addr, ws);
     }
     else {
         set_tree_height(node_addr, (tau-1));
@@ -502,66 +1108,371 @@ static void bds_round(const xmss_params *params,
                 state->treehash[i].next_idx = startidx;
                 state->treehash[i].completed = 0;
                 state->treehash[i].stackusage = 0;
+                bds_treehash_reschedule(params, state, i);
             }
         }
     }
+    ws->used = mark;
 }
 
 /**
- * Given a set of parameters, this function returns the size of the secret key.
- * This is implementation specific, as varying choices in tree traversal will
- * result in varying requirements for state storage.
- *
- * This function handles both XMSS and XMSSMT parameter sets.
+ * Produces the signature for leaf idx: the index, R, the bottom-most WOTS
+ * signature and the auth paths (and upper-layer WOTS signatures) that are
+ * currently held in the BDS states. The message is appended.
+ * keys points to [SK_SEED || SK_PRF || root || PUB_SEED].
+ * If chains is not NULL, it holds the output of wots_chains_gen for leaf idx
+ * and the bottom-most WOTS signature is looked up rather than computed.
  */
-unsigned long long xmss_xmssmt_core_sk_bytes(const xmss_params *params)
+int bds_sign_leaf(const xmss_params *params,
+                  unsigned char *sm, unsigned long long *smlen,
+                  const unsigned char *m, unsigned long long mlen,
+                  unsigned long long idx, const unsigned char *keys,
+                  const bds_state *states, const unsigned char *wots_sigs,
+                  const unsigned char *chains, xmss_workspace *ws)
 {
-    return params->index_bytes + 4 * params->n
-        + (2 * params->d - 1) * (
-            (params->tree_height + 1) * params->n
-            + 4
-            + params->tree_height + 1
-            + params->tree_height * params->n
-            + (params->tree_height >> 1) * params->n
-            + (params->tree_height - params->bds_k) * (7 + params->n)
-            + ((1 << params->bds_k) - params->bds_k - 1) * params->n
-            + 4
-         )
-        + (params->d - 1) * params->wots_sig_bytes;
-}
+    const unsigned char *sk_seed = keys;
+    const unsigned char *sk_prf = keys + params->n;
+    const unsigned char *pub_root = keys + 2*params->n;
+    const unsigned char *pub_seed = keys + 3*params->n;
 
-/*
- * Generates a XMSS key pair for a given parameter set.
- * Format sk: [(32bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
- * Format pk: [root || PUB_SEED] omitting algo oid.
- */
-int xmss_core_keypair(const xmss_params *params,
-                      unsigned char *pk, unsigned char *sk)
-{
-    uint32_t addr[8] = {0};
+    uint64_t idx_tree;
+    uint32_t idx_leaf;
+    uint64_t i;
 
-    // TODO refactor BDS state not to need separate treehash instances
-    bds_state state;
-    treehash_inst treehash[params->tree_height - params->bds_k];
-    state.treehash = treehash;
+    // Init working params
+    const unsigned long long mark = ws->used;
+    unsigned char *R;
+    unsigned char *msg_h;
+    uint32_t ots_addr[8] = {0};
+    unsigned char idx_bytes_32[32];
 
-    xmss_deserialize_state(params, &state, sk);
+    if (ws->size - ws->used < bds_workspace_size(params)) {
+        return -1;
+    }
+    R = xmss_ws_alloc(ws, params->n);
+    msg_h = xmss_ws_alloc(ws, params->n);
 
-    state.stackoffset = 0;
-    state.next_leaf = 0;
+    // ---------------------------------
+    // Message Hashing
+    // ---------------------------------
 
-    // Set idx = 0
-    sk[0] = 0;
-    sk[1] = 0;
-    sk[2] = 0;
-    sk[3] = 0;
-    // Init SK_SEED (n byte) and SK_PRF (n byte)
-    randombytes(sk + params->index_bytes, 2*params->n);
+    // Message Hash:
+    // First compute pseudorandom value
+    ull_to_bytes(idx_bytes_32, 32, idx);
+    prf(params, R, idx_bytes_32, sk_prf);
 
-    // Init PUB_SEED (n byte)
-    randombytes(sk + params->index_bytes + 3*params->n, params->n);
-    // Copy PUB_SEED to public key
-    memcpy(pk + params->n, sk + params->index_bytes + 3*params->n, params->n);
+    /* Already put the message in the right place, to make it easier to prepend
+     * things when computing the hash over the message. */
+    memcpy(sm + params->sig_bytes, m, mlen);
+
+    /* Compute the message hash. */
+    hash_message(params, msg_h, R, pub_root, idx,
+                 sm + params->sig_bytes - params->padding_len - 3*params->n,
+                 mlen);
+
+    // Start collecting signature
+    *smlen = 0;
+
+    // Copy index to signature
+    for (i = 0; i < params->index_bytes; i++) {
+        sm[i] = (idx >> 8*(params->index_bytes - 1 - i)) & 255;
+    }
+
+    sm += params->index_bytes;
+    *smlen += params->index_bytes;
+
+    // Copy R to signature
+    for (i = 0; i < params->n; i++) {
+        sm[i] = R[i];
+    }
+
+    sm += params->n;
+    *smlen += params->n;
+
+    // ----------------------------------
+    // Now we start to "really sign"
+    // ----------------------------------
+
+    // Handle lowest layer separately as it is slightly different...
+
+    // Prepare Address
+    set_type(ots_addr, 0);
+    idx_tree = idx >> params->tree_height;
+    idx_leaf = (idx & ((1 << params->tree_height)-1));
+    set_layer_addr(ots_addr, 0);
+    set_tree_addr(ots_addr, idx_tree);
+    set_ots_addr(ots_addr, idx_leaf);
+
+    // Compute WOTS signature
+    if (chains != NULL) {
+        wots_sign_from_chains_ws(params, sm, msg_h, chains, ws);
+    }
+    else {
+        wots_sign_ws(params, sm, msg_h, sk_seed, pub_seed, ots_addr, ws);
+    }
+
+    sm += params->wots_sig_bytes;
+    *smlen += params->wots_sig_bytes;
+
+    // the auth path was already computed during the previous round
+    memcpy(sm, states[0].auth, params->tree_height*params->n);
+    sm += params->tree_height*params->n;
+    *smlen += params->tree_height*params->n;
+
+    // prepare signature of remaining layers
+    for (i = 1; i < params->d; i++) {
+        // put WOTS signature in place
+        memcpy(sm, wots_sigs + (i-1)*params->wots_sig_bytes, params->wots_sig_bytes);
+
+        sm += params->wots_sig_bytes;
+        *smlen += params->wots_sig_bytes;
+
+        // put AUTH nodes in place
+        memcpy(sm, states[i].auth, params->tree_height*params->n);
+        sm += params->tree_height*params->n;
+        *smlen += params->tree_height*params->n;
+    }
+
+    memcpy(sm, m, mlen);
+    *smlen += mlen;
+    ws->used = mark;
+    return 0;
+}
+
+/* The workspace that bds_build_tree takes. */
+static unsigned long long bds_build_tree_workspace_size(const xmss_params *params)
+{
+    return xmss_ws_round((params->tree_height + 1) * params->n) +
+           xmss_ws_round(params->tree_height + 1) +
+           xmss_leaf_workspace_size(params);
+}
+
+unsigned long long bds_workspace_size(const xmss_params *params)
+{
+    unsigned long long size = bds_treehash_update_workspace_size(params);
+    unsigned long long leaf = xmss_ws_round(2 * params->n) +
+                              xmss_leaf_workspace_size(params);
+    unsigned long long sign = xmss_ws_round(params->n) * 2 +
+                              wots_workspace_size(params);
+    unsigned long long build;
+
+    /* bds_round, bds_state_update and the WOTS signatures. */
+    if (leaf > size) {
+        size = leaf;
+    }
+    /* bds_build_layer keeps a root while building a tree or signing it. */
+    build = bds_build_tree_workspace_size(params);
+    if (wots_workspace_size(params) > build) {
+        build = wots_workspace_size(params);
+    }
+    build += xmss_ws_round(params->n);
+    if (sign > size) {
+        size = sign;
+    }
+    if (build > size) {
+        size = build;
+    }
+    return size;
+}
+
+/**
+ * Computes the share of chains of the layer-(i+1) WOTS key pair that will sign
+ * the next layer-i tree that is due after leaf idx has been used. The chains
+ * are spread evenly over the 2^(h*(i+1)) signatures of the current tree, so
+ * that the table is complete when the tree boundary is reached.
+ */
+static void bds_wots_table_update(const xmss_params *params,
+                                  bds_wots_table *table, unsigned int i,
+                                  unsigned long long idx,
+                                  const unsigned char *keys)
+{
+    const unsigned int height = (i+1) * params->tree_height;
+    const unsigned long long lifetime = 1ULL << height;
+    unsigned long long next_tree = (idx >> height) + 1;
+    unsigned long long target;
+    uint32_t ots_addr[8] = {0};
+
+    /* The last tree of this layer has no successor to sign. */
+    if (next_tree >= (1ULL << (params->full_height - height))) {
+        return;
+    }
+    if (table->tree != next_tree) {
+        table->tree = next_tree;
+        table->done = 0;
+    }
+    target = (params->wots_len + lifetime - 1) / lifetime;
+    target *= (idx & (lifetime - 1)) + 1;
+    if (target > params->wots_len) {
+        target = params->wots_len;
+    }
+    if (table->done >= target) {
+        return;
+    }
+
+    set_type(ots_addr, 0);
+    set_layer_addr(ots_addr, i+1);
+    set_tree_addr(ots_addr, next_tree >> params->tree_height);
+    set_ots_addr(ots_addr, next_tree & ((1 << params->tree_height)-1));
+    wots_chains_gen_range(params, table->chains, table->done,
+                          target - table->done,
+                          keys, keys + 3*params->n, ots_addr);
+    table->done = target;
+}
+
+/**
+ * Advances the BDS states after leaf idx has been used, so that they hold the
+ * auth paths for idx + 1. This does not depend on the signed message.
+ * At tree boundaries, the current and NEXT state are exchanged using swap.
+ */
+int bds_advance(const xmss_params *params,
+                bds_state *states, unsigned char *wots_sigs,
+                unsigned long long idx, const unsigned char *keys,
+                bds_swap_fn swap, bds_wots_table *tables,
+                threadpool *pool, xmss_workspace *ws)
+{
+    const unsigned char *sk_seed = keys;
+    const unsigned char *pub_seed = keys + 3*params->n;
+
+    uint64_t idx_tree;
+    uint32_t idx_leaf;
+    uint64_t i, j;
+    int needswap_upto = -1;
+    unsigned int updates;
+
+    uint32_t addr[8] = {0};
+    uint32_t ots_addr[8] = {0};
+
+    if (ws->size - ws->used < bds_workspace_size(params)) {
+        return -1;
+    }
+
+    set_type(ots_addr, 0);
+    idx_tree = idx >> params->tree_height;
+    idx_leaf = (idx & ((1 << params->tree_height)-1));
+
+    updates = (params->tree_height - params->bds_k) >> 1;
+
+    if (tables != NULL) {
+        for (i = 0; i + 1 < params->d; i++) {
+            bds_wots_table_update(params, &tables[i], i, idx, keys);
+        }
+    }
+
+    set_tree_addr(addr, (idx_tree + 1));
+    // mandatory update for NEXT_0 (does not count towards h-k/2) if NEXT_0 exists
+    if ((1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << params->full_height)) {
+        bds_state_update(params, &states[params->d], sk_seed, pub_seed, addr, ws);
+    }
+
+    for (i = 0; i < params->d; i++) {
+        // check if we're not at the end of a tree
+        if (! (((idx + 1) & ((1ULL << ((i+1)*params->tree_height)) - 1)) == 0)) {
+            idx_leaf = (idx >> (params->tree_height * i)) & ((1 << params->tree_height)-1);
+            idx_tree = (idx >> (params->tree_height * (i+1)));
+            set_layer_addr(addr, i);
+            set_tree_addr(addr, idx_tree);
+            if (i == (unsigned int) (needswap_upto + 1)) {
+                bds_round(params, &states[i], idx_leaf, sk_seed, pub_seed, addr, ws);
+            }
+            updates = bds_treehash_update(params, &states[i], updates, sk_seed, pub_seed, addr, pool, ws);
+            set_tree_addr(addr, (idx_tree + 1));
+            // if a NEXT-tree exists for this level;
+            if ((1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << (params->full_height - params->tree_height * i))) {
+                if (i > 0 && updates > 0 && states[params->d + i].next_leaf < (1ULL << params->full_height)) {
+                    bds_state_update(params, &states[params->d + i], sk_seed, pub_seed, addr, ws);
+                    updates--;
+                }
+            }
+        }
+        else if (idx < (1ULL << params->full_height) - 1) {
+            swap(params, states+params->d + i, states + i);
+
+            set_layer_addr(ots_addr, (i+1));
+            set_tree_addr(ots_addr, ((idx + 1) >> ((i+2) * params->tree_height)));
+            set_ots_addr(ots_addr, (((idx >> ((i+1) * params->tree_height)) + 1) & ((1 << params->tree_height)-1)));
+
+            if (tables != NULL && tables[i].done == params->wots_len &&
+                tables[i].tree == ((idx + 1) >> ((i+1) * params->tree_height))) {
+                wots_sign_from_chains_ws(params, wots_sigs + i*params->wots_sig_bytes, states[i].stack, tables[i].chains, ws);
+                /* The chains contain a WOTS private key; do not keep it. */
+                memset(tables[i].chains, 0, params->wots_len * params->wots_w * params->n);
+                tables[i].done = 0;
+            }
+            else {
+                wots_sign_ws(params, wots_sigs + i*params->wots_sig_bytes, states[i].stack, sk_seed, pub_seed, ots_addr, ws);
+            }
+
+            states[params->d + i].stackoffset = 0;
+            states[params->d + i].next_leaf = 0;
+
+            updates--; // WOTS-signing counts as one update
+            needswap_upto = i;
+            for (j = 0; j < params->tree_height-params->bds_k; j++) {
+                states[i].treehash[j].completed = 1;
+            }
+            bds_treehash_schedule_init(params, &states[i]);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Given a set of parameters, this function returns the size of the secret key.
+ * This is implementation specific, as varying choices in tree traversal will
+ * result in varying requirements for state storage.
+ *
+ * This function handles both XMSS and XMSSMT parameter sets.
+ */
+unsigned long long xmss_xmssmt_core_sk_bytes(const xmss_params *params)
+{
+    return params->index_bytes + 4 * params->n
+        + (2 * params->d - 1) * (
+            (params->tree_height + 1) * params->n
+            + 4
+            + params->tree_height + 1
+            + params->tree_height * params->n
+            + (params->tree_height >> 1) * params->n
+            + (params->tree_height - params->bds_k) * (7 + params->n)
+            + ((1 << params->bds_k) - params->bds_k - 1) * params->n
+            + 4
+         )
+        + (params->d - 1) * params->wots_sig_bytes;
+}
+
+/*
+ * Generates a XMSS key pair for a given parameter set.
+ * Format sk: [(32bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED] omitting algo oid.
+ */
+int xmss_core_keypair(const xmss_params *params,
+                      unsigned char *pk, unsigned char *sk)
+{
+    uint32_t addr[8] = {0};
+
+    // TODO refactor BDS state not to need separate treehash instances
+    bds_state state;
+    treehash_inst treehash[params->tree_height - params->bds_k];
+    unsigned char heap[params->tree_height - params->bds_k + 1];
+    state.treehash = treehash;
+    state.heap = heap;
+
+    xmss_deserialize_state(params, &state, sk);
+
+    state.stackoffset = 0;
+    state.next_leaf = 0;
+
+    // Set idx = 0
+    sk[0] = 0;
+    sk[1] = 0;
+    sk[2] = 0;
+    sk[3] = 0;
+    // Init SK_SEED (n byte) and SK_PRF (n byte)
+    randombytes(sk + params->index_bytes, 2*params->n);
+
+    // Init PUB_SEED (n byte)
+    randombytes(sk + params->index_bytes + 3*params->n, params->n);
+    // Copy PUB_SEED to public key
+    memcpy(pk + params->n, sk + params->index_bytes + 3*params->n, params->n);
 
     // Compute root
     treehash_init(params, pk, params->tree_height, 0, &state, sk + params->index_bytes, sk + params->index_bytes + 3*params->n, addr);
@@ -586,191 +1497,588 @@ int xmss_core_sign(const xmss_params *params,
                    unsigned char *sm, unsigned long long *smlen,
                    const unsigned char *m, unsigned long long mlen)
 {
-    const unsigned char *pub_root = sk + params->index_bytes + 2*params->n;
+    /* XMSS signatures are fundamentally an instance of XMSSMT signatures.
+       For d=1, as is the case with XMSS, the BDS state consists of a single
+       tree without a NEXT state, and the XMSSMT routine reduces to a plain
+       bds_round and treehash update after each signature. */
+    return xmssmt_core_sign(params, sk, sm, smlen, m, mlen);
+}
+
+/*
+ * Generates a XMSSMT key pair for a given parameter set.
+ * Format sk: [(ceil(h/8) bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
+ * Format pk: [root || PUB_SEED] omitting algo oid.
+ */
+int xmssmt_core_keypair(const xmss_params *params,
+                        unsigned char *pk, unsigned char *sk)
+{
+    return xmssmt_core_keypair_resumable(params, pk, sk, NULL, 0, 0,
+                                         NULL, NULL, NULL);
+}
+
+unsigned long long xmssmt_core_lazy_sk_bytes(const xmss_params *params)
+{
+    xmss_params top = *params;
+
+    /* The layout of an sk with only one layer, whose state is the top one. */
+    top.d = 1;
+    return xmss_xmssmt_core_sk_bytes(&top);
+}
 
-    uint16_t i = 0;
+int xmssmt_core_keypair_lazy(const xmss_params *params,
+                             unsigned char *pk, unsigned char *lazy_sk)
+{
+    const unsigned char *sk_seed = lazy_sk + params->index_bytes;
+    const unsigned char *pub_seed = lazy_sk + params->index_bytes + 3*params->n;
+    uint32_t addr[8] = {0};
+    xmss_params top = *params;
 
     // TODO refactor BDS state not to need separate treehash instances
     bds_state state;
     treehash_inst treehash[params->tree_height - params->bds_k];
+    unsigned char heap[params->tree_height - params->bds_k + 1];
     state.treehash = treehash;
+    state.heap = heap;
 
-    /* Load the BDS state from sk. */
-    xmss_deserialize_state(params, &state, sk);
+    top.d = 1;
+    /* Set idx = 0. */
+    memset(lazy_sk, 0, xmssmt_core_lazy_sk_bytes(params));
+    // Init SK_SEED (params->n byte) and SK_PRF (params->n byte)
+    randombytes(lazy_sk + params->index_bytes, 2*params->n);
+    // Init PUB_SEED (params->n byte)
+    randombytes(lazy_sk + params->index_bytes + 3*params->n, params->n);
+    memcpy(pk + params->n, pub_seed, params->n);
 
-    // Extract SK
-    unsigned long idx = ((unsigned long)sk[0] << 24) | ((unsigned long)sk[1] << 16) | ((unsigned long)sk[2] << 8) | sk[3];
-    
-    /* Check if we can still sign with this sk.
-     * If not, return -2
-     * 
-     * If this is the last possible signature (because the max index value 
-     * is reached), production implementations should delete the secret key 
-     * to prevent accidental further use.
-     * 
-     * For the case of total tree height of 64 we do not use the last signature 
-     * to be on the safe side (there is no index value left to indicate that the 
-     * key is finished, hence external handling would be necessary)
-     */ 
-    if (idx >= ((1ULL << params->full_height) - 1)) {
-        // Delete secret key here. We only do this in memory, production code
-        // has to make sure that this happens on disk.
-        memset(sk, 0xFF, params->index_bytes);
-        memset(sk + params->index_bytes, 0, (params->sk_bytes - params->index_bytes));
-        if (idx > ((1ULL << params->full_height) - 1))
-            return -2; // We already used all one-time keys
-        if ((params->full_height == 64) && (idx == ((1ULL << params->full_height) - 1))) 
-                return -2; // We already used all one-time keys
-    }
-    
-    unsigned char sk_seed[params->n];
-    memcpy(sk_seed, sk + params->index_bytes, params->n);
-    unsigned char sk_prf[params->n];
-    memcpy(sk_prf, sk + params->index_bytes + params->n, params->n);
-    unsigned char pub_seed[params->n];
-    memcpy(pub_seed, sk + params->index_bytes + 3*params->n, params->n);
-
-    // index as 32 bytes string
-    unsigned char idx_bytes_32[32];
-    ull_to_bytes(idx_bytes_32, 32, idx);
+    xmssmt_deserialize_state(&top, &state, NULL, lazy_sk);
+    state.stackoffset = 0;
+    state.next_leaf = 0;
 
-    // Update SK
-    sk[0] = ((idx + 1) >> 24) & 255;
-    sk[1] = ((idx + 1) >> 16) & 255;
-    sk[2] = ((idx + 1) >> 8) & 255;
-    sk[3] = (idx + 1) & 255;
-    // Secret key for this non-forward-secure version is now updated.
-    // A production implementation should consider using a file handle instead,
-    //  and write the updated secret key at this point!
+    /* Only the top tree is needed for the root. */
+    set_layer_addr(addr, params->d - 1);
+    treehash_init(params, pk, params->tree_height, 0, &state, sk_seed, pub_seed, addr);
+    memcpy(lazy_sk + params->index_bytes + 2*params->n, pk, params->n);
 
-    // Init working params
-    unsigned char R[params->n];
-    unsigned char msg_h[params->n];
-    uint32_t ots_addr[8] = {0};
+    xmssmt_serialize_state(&top, lazy_sk, &state);
+    return 0;
+}
 
-    // ---------------------------------
-    // Message Hashing
-    // ---------------------------------
+unsigned long long xmss_keygen_checkpoint_bytes(const xmss_params *params)
+{
+    /* layer || leaf || stackoffset || stacklevels || stack || sk */
+    return 1 + 4 + 1 + (params->tree_height + 1) * (params->n + 1) +
+           params->sk_bytes;
+}
 
-    // Message Hash:
-    // First compute pseudorandom value
-    prf(params, R, idx_bytes_32, sk_prf);
+/**
+ * Reads a checkpoint record into sk and the cursor of the tree on 'layer'.
+ * Returns -1 if the record does not describe a key generation in progress.
+ */
+static int keygen_restore(const xmss_params *params, unsigned char *sk,
+                          unsigned int *layer, treehash_cursor *cursor,
+                          const unsigned char *record)
+{
+    *layer = record[0];
+    cursor->leaf = bytes_to_ull(record + 1, 4);
+    cursor->stackoffset = record[5];
+    record += 6;
+    if (*layer >= params->d || cursor->leaf >= (1U << params->tree_height) ||
+        cursor->stackoffset > params->tree_height + 1 ||
+        (cursor->leaf == 0) != (cursor->stackoffset == 0)) {
+        return -1;
+    }
+    memcpy(cursor->stacklevels, record, params->tree_height + 1);
+    record += params->tree_height + 1;
+    memcpy(cursor->stack, record, (params->tree_height + 1) * params->n);
+    record += (params->tree_height + 1) * params->n;
+    memcpy(sk, record, params->sk_bytes);
+    return 0;
+}
 
-    /* Already put the message in the right place, to make it easier to prepend
-     * things when computing the hash over the message. */
-    memcpy(sm + params->sig_bytes, m, mlen);
+static double keygen_seconds(const struct timespec *start)
+{
+    struct timespec now;
 
-    /* Compute the message hash. */
-    hash_message(params, msg_h, R, pub_root, idx,
-                 sm + params->sig_bytes - params->padding_len - 3*params->n,
-                 mlen);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
 
-    // Start collecting signature
-    *smlen = 0;
+/**
+ * Passes the checkpoint of a key generation at the cursor of the tree on
+ * 'layer' to checkpoint, and reports progress.
+ * Returns -1 if checkpoint failed, 0 otherwise.
+ */
+static int keygen_checkpoint(const xmss_params *params, unsigned char *sk,
+                             bds_state *states, unsigned int layer,
+                             const treehash_cursor *cursor,
+                             unsigned long long run, const struct timespec *start,
+                             xmss_keygen_checkpoint_fn checkpoint,
+                             xmss_keygen_progress_fn progress, void *ctx)
+{
+    unsigned char record[xmss_keygen_checkpoint_bytes(params)];
+    unsigned char *p = record;
+    double seconds;
+
+    if (checkpoint != NULL) {
+        /* Bring the scalar fields of the BDS states in the sk up to date. */
+        xmssmt_serialize_state(params, sk, states);
+
+        p[0] = layer;
+        ull_to_bytes(p + 1, 4, cursor->leaf);
+        p[5] = cursor->stackoffset;
+        p += 6;
+        memcpy(p, cursor->stacklevels, params->tree_height + 1);
+        p += params->tree_height + 1;
+        memcpy(p, cursor->stack, (params->tree_height + 1) * params->n);
+        p += (params->tree_height + 1) * params->n;
+        memcpy(p, sk, params->sk_bytes);
+
+        if (checkpoint(ctx, record, sizeof(record))) {
+            return -1;
+        }
+    }
+    if (progress != NULL) {
+        seconds = keygen_seconds(start);
+        progress(ctx, ((unsigned long long)layer << params->tree_height) + cursor->leaf,
+                 (unsigned long long)params->d << params->tree_height,
+                 seconds > 0 ? run / seconds : 0);
+    }
+    return 0;
+}
 
-    // Copy index to signature
-    sm[0] = (idx >> 24) & 255;
-    sm[1] = (idx >> 16) & 255;
-    sm[2] = (idx >> 8) & 255;
-    sm[3] = idx & 255;
+/**
+ * Generates (or resumes) the key pair for xmssmt_core_keypair_resumable,
+ * computing the leaves on pool if it is not NULL, using ring and ready for
+ * the pipeline (see treehash_init_pipelined).
+ */
+static int keygen_layers(const xmss_params *params,
+                         unsigned char *pk, unsigned char *sk,
+                         const unsigned char *resume,
+                         unsigned long long interval, threadpool *pool,
+                         unsigned char *ring, atomic_uint *ready,
+                         xmss_keygen_checkpoint_fn checkpoint,
+                         xmss_keygen_progress_fn progress, void *ctx)
+{
+    const uint32_t leaves = 1 << params->tree_height;
+    const unsigned char *sk_seed = sk + params->index_bytes;
+    const unsigned char *pub_seed = sk + params->index_bytes + 3*params->n;
+    uint32_t addr[8] = {0};
+    unsigned int i, layer = 0;
+    unsigned char *wots_sigs;
+    unsigned long long run = 0;
+    uint32_t count;
+    struct timespec start;
+
+    // TODO refactor BDS state not to need separate treehash instances
+    bds_state states[2*params->d - 1];
+    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
+    unsigned char heap[(2*params->d - 1) * (params->tree_height - params->bds_k) + 1];
+    unsigned char stack[(params->tree_height + 1) * params->n];
+    unsigned char stacklevels[params->tree_height + 1];
+    treehash_cursor cursor = {0, 0, stacklevels, stack};
+    for (i = 0; i < 2*params->d - 1; i++) {
+        states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+        states[i].heap = heap + i * (params->tree_height - params->bds_k);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (resume != NULL) {
+        if (keygen_restore(params, sk, &layer, &cursor, resume)) {
+            return -1;
+        }
+        xmssmt_deserialize_state(params, states, &wots_sigs, sk);
+    }
+    else {
+        /* Set idx = 0, and start from a zeroed state, so that a key that is
+           generated in several runs does not differ in its unused bytes. */
+        memset(sk, 0, params->sk_bytes);
+        // Init SK_SEED (params->n byte) and SK_PRF (params->n byte)
+        randombytes(sk+params->index_bytes, 2*params->n);
+        // Init PUB_SEED (params->n byte)
+        randombytes(sk+params->index_bytes + 3*params->n, params->n);
+
+        xmssmt_deserialize_state(params, states, &wots_sigs, sk);
+        for (i = 0; i < 2 * params->d - 1; i++) {
+            states[i].stackoffset = 0;
+            states[i].next_leaf = 0;
+        }
+    }
+    // Copy PUB_SEED to public key
+    memcpy(pk+params->n, pub_seed, params->n);
+
+    /* Set up the state of each layer, starting with the bottom-most one, and
+       compute the wots signatures for all but the topmost tree root. */
+    for (; layer < params->d; layer++) {
+        set_layer_addr(addr, layer);
+        treehash_init_start(params, &states[layer]);
+
+        while (cursor.leaf < leaves) {
+            count = leaves - cursor.leaf;
+            if (interval > 0 && interval < count) {
+                count = interval;
+            }
+            if (pool != NULL) {
+                treehash_init_pipelined(params, &cursor, count,
+                                        params->tree_height, 0, &states[layer],
+                                        sk_seed, pub_seed, addr, pool,
+                                        ring, ready);
+            }
+            else {
+                treehash_init_leaves(params, &cursor, count, params->tree_height,
+                                     0, &states[layer], sk_seed, pub_seed, addr);
+            }
+            run += count;
+            if (cursor.leaf < leaves &&
+                keygen_checkpoint(params, sk, states, layer, &cursor, run,
+                                  &start, checkpoint, progress, ctx)) {
+                return -1;
+            }
+        }
+        memcpy(pk, stack, params->n);
+        cursor.leaf = 0;
+        cursor.stackoffset = 0;
+
+        if (layer + 1 < params->d) {
+            set_layer_addr(addr, layer + 1);
+            wots_sign(params, wots_sigs + layer*params->wots_sig_bytes, pk, sk_seed, pub_seed, addr);
+            if (keygen_checkpoint(params, sk, states, layer + 1, &cursor, run,
+                                  &start, checkpoint, progress, ctx)) {
+                return -1;
+            }
+        }
+    }
+    memcpy(sk + params->index_bytes + 2*params->n, pk, params->n);
+
+    xmssmt_serialize_state(params, sk, states);
+
+    if (progress != NULL) {
+        keygen_checkpoint(params, sk, states, params->d, &cursor, run,
+                          &start, NULL, progress, ctx);
+    }
+    return 0;
+}
+
+int xmssmt_core_keypair_resumable(const xmss_params *params,
+                                  unsigned char *pk, unsigned char *sk,
+                                  const unsigned char *resume,
+                                  unsigned long long interval,
+                                  unsigned int threads,
+                                  xmss_keygen_checkpoint_fn checkpoint,
+                                  xmss_keygen_progress_fn progress, void *ctx)
+{
+    threadpool *own = threads == 0 ? NULL : threadpool_create(threads);
+    threadpool *pool = threads == 0 ? threadpool_shared() : own;
+    unsigned int slots = keygen_pipeline_slots(threadpool_size(pool));
+    unsigned char *ring = NULL;
+    atomic_uint *ready = NULL;
+    int ret;
+
+    if (pool != NULL) {
+        ring = malloc(slots * params->n);
+        ready = malloc(slots * sizeof(atomic_uint));
+        /* Without room for the ring, the leaves are computed in order. */
+        if (ring == NULL || ready == NULL) {
+            pool = NULL;
+        }
+    }
+    ret = keygen_layers(params, pk, sk, resume, interval, pool, ring, ready,
+                        checkpoint, progress, ctx);
+
+    threadpool_free(own);
+    free(ring);
+    free(ready);
+    return ret;
+}
+
+/**
+ * Stores a node of a tree (at the given height and index) in the parts of
+ * state that hold it while leaf is the next leaf to be used: the auth path of
+ * leaf, the node that bds_round combines with it once leaf's ancestor at this
+ * height has been used up (keep), the next right node that bds_round takes
+ * from the treehash instance at this height, and the right nodes of the top
+ * levels (retain).
+ */
+static void bds_place_node(const xmss_params *params, bds_state *state,
+                           uint32_t leaf, unsigned int height, uint32_t index,
+                           const unsigned char *node)
+{
+    const unsigned int h = params->tree_height;
+    uint32_t next;
+
+    if (index == ((leaf >> height) ^ 1)) {
+        memcpy(state->auth + height*params->n, node, params->n);
+    }
+    if (height + 1 < h && ((leaf >> height) & 3) == 1 && index == leaf >> height) {
+        memcpy(state->keep + (height >> 1)*params->n, node, params->n);
+    }
+    if (height < h - params->bds_k) {
+        /* The right node after the next left one that starts a pair. */
+        next = ((leaf >> (height + 1)) + 1) << 1;
+        if (index == next + 1) {
+            memcpy(state->treehash[height].node, node, params->n);
+        }
+    }
+    else if ((index & 1) && index >= 3) {
+        memcpy(state->retain + ((1 << (h - 1 - height)) + height - h + ((index - 3) >> 1)) * params->n, node, params->n);
+    }
+}
+
+/**
+ * Computes the tree at addr and fills in state as it is when leaf is the next
+ * leaf to be used, in one pass over the leaves; the root is written to root.
+ * All treehash instances are left completed (ahead of what the traversal
+ * would have computed by then), so this costs the same 2^h leaves for every
+ * leaf, rather than replaying the traversal of the leaves before it.
+ */
+static void bds_build_tree(const xmss_params *params, unsigned char *root,
+                           bds_state *state, uint32_t leaf,
+                           const unsigned char *sk_seed,
+                           const unsigned char *pub_seed,
+                           const uint32_t addr[8], xmss_workspace *ws)
+{
+    const unsigned long long mark = ws->used;
+    unsigned char *stack = xmss_ws_alloc(ws, (params->tree_height + 1) * params->n);
+    unsigned char *stacklevels = xmss_ws_alloc(ws, params->tree_height + 1);
+    unsigned int stackoffset = 0;
+    uint32_t ots_addr[8] = {0};
+    uint32_t ltree_addr[8] = {0};
+    uint32_t node_addr[8] = {0};
+    uint32_t idx;
+
+    copy_subtree_addr(ots_addr, addr);
+    set_type(ots_addr, 0);
+    copy_subtree_addr(ltree_addr, addr);
+    set_type(ltree_addr, 1);
+    copy_subtree_addr(node_addr, addr);
+    set_type(node_addr, 2);
 
-    sm += 4;
-    *smlen += 4;
+    treehash_init_start(params, state);
+    state->stackoffset = 0;
 
-    // Copy R to signature
-    for (i = 0; i < params->n; i++) {
-        sm[i] = R[i];
+    for (idx = 0; idx < 1U << params->tree_height; idx++) {
+        set_ltree_addr(ltree_addr, idx);
+        set_ots_addr(ots_addr, idx);
+        gen_leaf_wots_ws(params, stack + stackoffset*params->n, sk_seed, pub_seed, ltree_addr, ots_addr, ws);
+        stacklevels[stackoffset] = 0;
+        stackoffset++;
+        bds_place_node(params, state, leaf, 0, idx, stack + (stackoffset-1)*params->n);
+        while (stackoffset > 1 && stacklevels[stackoffset-1] == stacklevels[stackoffset-2]) {
+            set_tree_height(node_addr, stacklevels[stackoffset-1]);
+            set_tree_index(node_addr, idx >> (stacklevels[stackoffset-1] + 1));
+            thash_h(params, stack + (stackoffset-2)*params->n, stack + (stackoffset-2)*params->n, pub_seed, node_addr);
+            stacklevels[stackoffset-2]++;
+            stackoffset--;
+            if (stacklevels[stackoffset-1] < params->tree_height) {
+                bds_place_node(params, state, leaf, stacklevels[stackoffset-1],
+                               idx >> stacklevels[stackoffset-1],
+                               stack + (stackoffset-1)*params->n);
+            }
+        }
     }
+    memcpy(root, stack, params->n);
+    ws->used = mark;
+}
 
-    sm += params->n;
-    *smlen += params->n;
-
-    // ----------------------------------
-    // Now we start to "really sign"
-    // ----------------------------------
+/**
+ * Builds the state of the tree on 'layer' that leaf idx is in, as it is when
+ * idx is the next leaf to be used (see bds_build_tree). Below the top layer,
+ * the WOTS signature on its root is computed, and if full_next is set (or the
+ * leaf is not the first of its tree), so is the NEXT state, rather than
+ * spreading it over the signatures that follow.
+ */
+static void bds_build_layer(const xmss_params *params, bds_state *states,
+                            unsigned char *wots_sigs, unsigned int layer,
+                            unsigned long long idx,
+                            const unsigned char *sk_seed,
+                            const unsigned char *pub_seed, int full_next,
+                            xmss_workspace *ws)
+{
+    const uint32_t leaf_mask = (1 << params->tree_height) - 1;
+    const unsigned long long mark = ws->used;
+    unsigned char *root = xmss_ws_alloc(ws, params->n);
+    bds_state *next = &states[params->d + layer];
+    uint32_t addr[8] = {0};
+    uint32_t ots_addr[8] = {0};
+    unsigned long long tree;
+    uint32_t leaf;
+
+    leaf = (idx >> (layer * params->tree_height)) & leaf_mask;
+    tree = (layer + 1) * params->tree_height >= 64 ? 0 : idx >> ((layer + 1) * params->tree_height);
+    set_layer_addr(addr, layer);
+    set_tree_addr(addr, tree);
+
+    bds_build_tree(params, root, &states[layer], leaf, sk_seed, pub_seed, addr, ws);
+    states[layer].next_leaf = 0;
+
+    if (layer + 1 < params->d) {
+        set_type(ots_addr, 0);
+        set_layer_addr(ots_addr, layer + 1);
+        set_tree_addr(ots_addr, tree >> params->tree_height);
+        set_ots_addr(ots_addr, tree & leaf_mask);
+        wots_sign_ws(params, wots_sigs + layer*params->wots_sig_bytes, root, sk_seed, pub_seed, ots_addr, ws);
+
+        /* A complete NEXT state holds the root of its tree on the stack, where
+           the tree boundary expects it; further updates to it do nothing. */
+        if ((full_next || leaf > 0) &&
+            tree + 1 < (1ULL << (params->full_height - (layer + 1) * params->tree_height))) {
+            set_tree_addr(addr, tree + 1);
+            bds_build_tree(params, next->stack, next, 0, sk_seed, pub_seed, addr, ws);
+            next->stacklevels[0] = params->tree_height;
+            next->stackoffset = 1;
+            next->next_leaf = 1 << params->tree_height;
+        }
+    }
+    ws->used = mark;
+}
 
-    // Prepare Address
-    set_type(ots_addr, 0);
-    set_ots_addr(ots_addr, idx);
+int bds_build_layers(const xmss_params *params, bds_state *states,
+                     unsigned char *wots_sigs, unsigned long long *layers,
+                     unsigned long long idx, const unsigned char *keys,
+                     xmss_workspace *ws)
+{
+    const unsigned char *sk_seed = keys;
+    const unsigned char *pub_seed = keys + 3*params->n;
+    unsigned int i;
 
-    // Compute WOTS signature
-    wots_sign(params, sm, msg_h, sk_seed, pub_seed, ots_addr);
+    if (ws->size - ws->used < bds_workspace_size(params)) {
+        return -1;
+    }
+    for (i = 0; i < params->d; i++) {
+        if (*layers & (1ULL << i)) {
+            continue;
+        }
+        states[i].stackoffset = 0;
+        states[i].next_leaf = 0;
+        if (i + 1 < params->d) {
+            states[params->d + i].stackoffset = 0;
+            states[params->d + i].next_leaf = 0;
+        }
+        bds_build_layer(params, states, wots_sigs, i, idx, sk_seed, pub_seed,
+                        0, ws);
+        bds_treehash_schedule_init(params, &states[i]);
+        *layers |= 1ULL << i;
+    }
+    return 0;
+}
 
-    sm += params->wots_sig_bytes;
-    *smlen += params->wots_sig_bytes;
+/**
+ * Builds all BDS states and upper-layer WOTS signatures of sk for the index
+ * that it holds, as they would be after signing up to it. The NEXT states are
+ * computed in full, rather than spread over the preceding signatures.
+ */
+static void bds_build_states(const xmss_params *params, unsigned char *sk)
+{
+    const unsigned char *sk_seed = sk + params->index_bytes;
+    const unsigned char *pub_seed = sk + params->index_bytes + 3*params->n;
+    unsigned long long idx = bytes_to_ull(sk, params->index_bytes);
 
-    // the auth path was already computed during the previous round
-    memcpy(sm, state.auth, params->tree_height*params->n);
+    unsigned char *wots_sigs;
+    unsigned int i;
 
-    if (idx < (1U << params->tree_height) - 1) {
-        bds_round(params, &state, idx, sk_seed, pub_seed, ots_addr);
-        bds_treehash_update(params, &state, (params->tree_height - params->bds_k) >> 1, sk_seed, pub_seed, ots_addr);
+    // TODO refactor BDS state not to need separate treehash instances
+    bds_state states[2*params->d - 1];
+    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
+    unsigned char heap[(2*params->d - 1) * (params->tree_height - params->bds_k) + 1];
+    unsigned char buf[bds_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+    for (i = 0; i < 2*params->d - 1; i++) {
+        states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+        states[i].heap = heap + i * (params->tree_height - params->bds_k);
     }
+    xmss_ws_init(&ws, buf, sizeof(buf));
 
-    sm += params->tree_height*params->n;
-    *smlen += params->tree_height*params->n;
+    xmssmt_deserialize_state(params, states, &wots_sigs, sk);
 
-    memcpy(sm, m, mlen);
-    *smlen += mlen;
+    for (i = 0; i < 2 * params->d - 1; i++) {
+        states[i].stackoffset = 0;
+        states[i].next_leaf = 0;
+    }
 
-    /* Write the updated BDS state back into sk. */
-    xmss_serialize_state(params, sk, &state);
+    for (i = 0; i < params->d; i++) {
+        bds_build_layer(params, states, wots_sigs, i, idx, sk_seed, pub_seed,
+                        1, &ws);
+    }
 
-    return 0;
+    xmssmt_serialize_state(params, sk, states);
 }
 
 /*
- * Generates a XMSSMT key pair for a given parameter set.
- * Format sk: [(ceil(h/8) bit) idx || SK_SEED || SK_PRF || root || PUB_SEED]
- * Format pk: [root || PUB_SEED] omitting algo oid.
+ * Expands a key from xmssmt_core_keypair_lazy into an sk that can sign, by
+ * building the states of the layers below the top and the WOTS signatures on
+ * their roots, as xmssmt_core_keypair would have.
+ * Format lazy_sk: [(ceil(h/8) bit) idx = 0 || SK_SEED || SK_PRF || root ||
+ *                  PUB_SEED || BDS state of the top layer]
  */
-int xmssmt_core_keypair(const xmss_params *params,
-                        unsigned char *pk, unsigned char *sk)
+int xmssmt_core_materialize(const xmss_params *params, unsigned char *sk,
+                            const unsigned char *lazy_sk)
 {
-    uint32_t addr[8] = {0};
-    unsigned int i;
+    const unsigned long long keys_bytes = params->index_bytes + 4*params->n;
+    const unsigned long long state_bytes =
+        xmssmt_core_lazy_sk_bytes(params) - keys_bytes;
+    unsigned long long layers = 1ULL << (params->d - 1);
+
     unsigned char *wots_sigs;
+    unsigned int i;
 
     // TODO refactor BDS state not to need separate treehash instances
     bds_state states[2*params->d - 1];
     treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
+    unsigned char heap[(2*params->d - 1) * (params->tree_height - params->bds_k) + 1];
+    unsigned char buf[bds_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
+
+    /* A lazy key cannot sign, so it is always at its first index. */
+    if (bytes_to_ull(lazy_sk, params->index_bytes) != 0) {
+        return -1;
+    }
+
     for (i = 0; i < 2*params->d - 1; i++) {
         states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+        states[i].heap = heap + i * (params->tree_height - params->bds_k);
     }
+    xmss_ws_init(&ws, buf, sizeof(buf));
+
+    /* The NEXT states start out empty, as after xmssmt_core_keypair. */
+    memset(sk, 0, params->sk_bytes);
+    memcpy(sk, lazy_sk, keys_bytes);
+    memcpy(sk + keys_bytes + (params->d - 1) * state_bytes,
+           lazy_sk + keys_bytes, state_bytes);
 
     xmssmt_deserialize_state(params, states, &wots_sigs, sk);
+    bds_build_layers(params, states, wots_sigs, &layers, 0,
+                     sk + params->index_bytes, &ws);
+    xmssmt_serialize_state(params, sk, states);
 
-    for (i = 0; i < 2 * params->d - 1; i++) {
-        states[i].stackoffset = 0;
-        states[i].next_leaf = 0;
-    }
+    return 0;
+}
 
-    // Set idx = 0
-    for (i = 0; i < params->index_bytes; i++) {
-        sk[i] = 0;
+/*
+ * Derives a sub-key for the one-time keys start .. end-1 of sk, and moves sk
+ * on to end. Both get the BDS states for their new index (see
+ * bds_build_states), which costs two tree computations per layer each.
+ * Format subkey: [sk (params->sk_bytes, index = start) || (ceil(h/8) bit) end]
+ */
+int xmssmt_core_subkey(const xmss_params *params, unsigned char *subkey,
+                       unsigned char *sk,
+                       unsigned long long start, unsigned long long end)
+{
+    /* The range must be non-empty, exist, and not have been used yet. */
+    if (start >= end || end - 1 > (1ULL << params->full_height) - 1 ||
+        start < bytes_to_ull(sk, params->index_bytes)) {
+        return -1;
     }
-    // Init SK_SEED (params->n byte) and SK_PRF (params->n byte)
-    randombytes(sk+params->index_bytes, 2*params->n);
 
-    // Init PUB_SEED (params->n byte)
-    randombytes(sk+params->index_bytes + 3*params->n, params->n);
-    // Copy PUB_SEED to public key
-    memcpy(pk+params->n, sk+params->index_bytes+3*params->n, params->n);
-
-    // Start with the bottom-most layer
-    set_layer_addr(addr, 0);
-    // Set up state and compute wots signatures for all but topmost tree root
-    for (i = 0; i < params->d - 1; i++) {
-        // Compute seed for OTS key pair
-        treehash_init(params, pk, params->tree_height, 0, states + i, sk+params->index_bytes, pk+params->n, addr);
-        set_layer_addr(addr, (i+1));
-        wots_sign(params, wots_sigs + i*params->wots_sig_bytes, pk, sk + params->index_bytes, pk+params->n, addr);
-    }
-    // Address now points to the single tree on layer d-1
-    treehash_init(params, pk, params->tree_height, 0, states + i, sk+params->index_bytes, pk+params->n, addr);
-    memcpy(sk + params->index_bytes + 2*params->n, pk, params->n);
+    ull_to_bytes(subkey, params->index_bytes, start);
+    memcpy(subkey + params->index_bytes, sk + params->index_bytes, 4*params->n);
+    ull_to_bytes(subkey + params->sk_bytes, params->index_bytes, end);
+    bds_build_states(params, subkey);
 
-    xmssmt_serialize_state(params, sk, states);
+    /* sk continues after the range; past the last one-time key, it refuses
+       to sign. */
+    ull_to_bytes(sk, params->index_bytes, end);
+    if (end <= (1ULL << params->full_height) - 1) {
+        bds_build_states(params, sk);
+    }
 
     return 0;
 }
@@ -787,40 +2095,60 @@ int xmssmt_core_sign(const xmss_params *params,
                      unsigned char *sm, unsigned long long *smlen,
                      const unsigned char *m, unsigned long long mlen)
 {
-    const unsigned char *pub_root = sk + params->index_bytes + 2*params->n;
+    unsigned char buf[xmssmt_core_sign_workspace_size(params) + XMSS_WS_ALIGN];
+    xmss_workspace ws;
 
-    uint64_t idx_tree;
-    uint32_t idx_leaf;
-    uint64_t i, j;
-    int needswap_upto = -1;
-    unsigned int updates;
+    xmss_ws_init(&ws, buf, sizeof(buf));
+    return xmssmt_core_sign_ws(params, sk, sm, smlen, m, mlen, &ws);
+}
 
-    unsigned char sk_seed[params->n];
-    unsigned char sk_prf[params->n];
-    unsigned char pub_seed[params->n];
-    // Init working params
-    unsigned char R[params->n];
-    unsigned char msg_h[params->n];
-    uint32_t addr[8] = {0};
-    uint32_t ots_addr[8] = {0};
-    unsigned char idx_bytes_32[32];
+unsigned long long xmssmt_core_sign_workspace_size(const xmss_params *params)
+{
+    const unsigned int instances = params->tree_height - params->bds_k;
+
+    return xmss_ws_round((2*params->d - 1) * sizeof(bds_state)) +
+           xmss_ws_round((2*params->d - 1) * instances * sizeof(treehash_inst)) +
+           xmss_ws_round((2*params->d - 1) * instances + 1) +
+           bds_workspace_size(params);
+}
+
+int xmssmt_core_sign_ws(const xmss_params *params,
+                        unsigned char *sk,
+                        unsigned char *sm, unsigned long long *smlen,
+                        const unsigned char *m, unsigned long long mlen,
+                        xmss_workspace *ws)
+{
+    const unsigned int instances = params->tree_height - params->bds_k;
+    const unsigned long long mark = ws->used;
+    unsigned long long idx;
+    unsigned int i;
 
     unsigned char *wots_sigs;
 
     // TODO refactor BDS state not to need separate treehash instances
-    bds_state states[2*params->d - 1];
-    treehash_inst treehash[(2*params->d - 1) * (params->tree_height - params->bds_k)];
+    bds_state *states;
+    treehash_inst *treehash;
+    unsigned char *heap;
+
+    if (ws->size - ws->used < xmssmt_core_sign_workspace_size(params)) {
+        return -1;
+    }
+    states = xmss_ws_alloc(ws, (2*params->d - 1) * sizeof(bds_state));
+    treehash = xmss_ws_alloc(ws, (2*params->d - 1) * instances * sizeof(treehash_inst));
+    heap = xmss_ws_alloc(ws, (2*params->d - 1) * instances + 1);
     for (i = 0; i < 2*params->d - 1; i++) {
         states[i].treehash = treehash + i * (params->tree_height - params->bds_k);
+        states[i].heap = heap + i * (params->tree_height - params->bds_k);
     }
 
     xmssmt_deserialize_state(params, states, &wots_sigs, sk);
+    /* The NEXT states do not use their treehash instances until swapped in. */
+    for (i = 0; i < params->d; i++) {
+        bds_treehash_schedule_init(params, &states[i]);
+    }
 
     // Extract SK
-    unsigned long long idx = 0;
-    for (i = 0; i < params->index_bytes; i++) {
-        idx |= ((unsigned long long)sk[i]) << 8*(params->index_bytes - 1 - i);
-    }
+    idx = bytes_to_ull(sk, params->index_bytes);
 
     /* Check if we can still sign with this sk.
      * If not, return -2
@@ -834,155 +2162,52 @@ int xmssmt_core_sign(const xmss_params *params,
      * key is finished, hence external handling would be necessary)
      */ 
     if (idx >= ((1ULL << params->full_height) - 1)) {
-        // Delete secret key here. We only do this in memory, production code
-        // has to make sure that this happens on disk.
-        memset(sk, 0xFF, params->index_bytes);
-        memset(sk + params->index_bytes, 0, (params->sk_bytes - params->index_bytes));
-        if (idx > ((1ULL << params->full_height) - 1))
+        if ((idx > ((1ULL << params->full_height) - 1)) ||
+            ((params->full_height == 64) && (idx == ((1ULL << params->full_height) - 1)))) {
+            // Delete secret key here. We only do this in memory, production code
+            // has to make sure that this happens on disk.
+            memset(sk, 0xFF, params->index_bytes);
+            memset(sk + params->index_bytes, 0, (params->sk_bytes - params->index_bytes));
+            ws->used = mark;
             return -2; // We already used all one-time keys
-        if ((params->full_height == 64) && (idx == ((1ULL << params->full_height) - 1))) 
-                return -2; // We already used all one-time keys
+        }
     }
-    
-    memcpy(sk_seed, sk+params->index_bytes, params->n);
-    memcpy(sk_prf, sk+params->index_bytes+params->n, params->n);
-    memcpy(pub_seed, sk+params->index_bytes+3*params->n, params->n);
 
     // Update SK
-    for (i = 0; i < params->index_bytes; i++) {
-        sk[i] = ((idx + 1) >> 8*(params->index_bytes - 1 - i)) & 255;
-    }
+    ull_to_bytes(sk, params->index_bytes, idx + 1);
     // Secret key for this non-forward-secure version is now updated.
     // A production implementation should consider using a file handle instead,
     //  and write the updated secret key at this point!
 
-    // ---------------------------------
-    // Message Hashing
-    // ---------------------------------
-
-    // Message Hash:
-    // First compute pseudorandom value
-    ull_to_bytes(idx_bytes_32, 32, idx);
-    prf(params, R, idx_bytes_32, sk_prf);
-
-    /* Already put the message in the right place, to make it easier to prepend
-     * things when computing the hash over the message. */
-    memcpy(sm + params->sig_bytes, m, mlen);
-
-    /* Compute the message hash. */
-    hash_message(params, msg_h, R, pub_root, idx,
-                 sm + params->sig_bytes - params->padding_len - 3*params->n,
-                 mlen);
-
-    // Start collecting signature
-    *smlen = 0;
-
-    // Copy index to signature
-    for (i = 0; i < params->index_bytes; i++) {
-        sm[i] = (idx >> 8*(params->index_bytes - 1 - i)) & 255;
-    }
-
-    sm += params->index_bytes;
-    *smlen += params->index_bytes;
-
-    // Copy R to signature
-    for (i = 0; i < params->n; i++) {
-        sm[i] = R[i];
-    }
-
-    sm += params->n;
-    *smlen += params->n;
-
-    // ----------------------------------
-    // Now we start to "really sign"
-    // ----------------------------------
-
-    // Handle lowest layer separately as it is slightly different...
-
-    // Prepare Address
-    set_type(ots_addr, 0);
-    idx_tree = idx >> params->tree_height;
-    idx_leaf = (idx & ((1 << params->tree_height)-1));
-    set_layer_addr(ots_addr, 0);
-    set_tree_addr(ots_addr, idx_tree);
-    set_ots_addr(ots_addr, idx_leaf);
-
-    // Compute WOTS signature
-    wots_sign(params, sm, msg_h, sk_seed, pub_seed, ots_addr);
-
-    sm += params->wots_sig_bytes;
-    *smlen += params->wots_sig_bytes;
-
-    memcpy(sm, states[0].auth, params->tree_height*params->n);
-    sm += params->tree_height*params->n;
-    *smlen += params->tree_height*params->n;
-
-    // prepare signature of remaining layers
-    for (i = 1; i < params->d; i++) {
-        // put WOTS signature in place
-        memcpy(sm, wots_sigs + (i-1)*params->wots_sig_bytes, params->wots_sig_bytes);
-
-        sm += params->wots_sig_bytes;
-        *smlen += params->wots_sig_bytes;
-
-        // put AUTH nodes in place
-        memcpy(sm, states[i].auth, params->tree_height*params->n);
-        sm += params->tree_height*params->n;
-        *smlen += params->tree_height*params->n;
+    if (bds_sign_leaf(params, sm, smlen, m, mlen, idx, sk + params->index_bytes,
+                      states, wots_sigs, NULL, ws)) {
+        ull_to_bytes(sk, params->index_bytes, idx);
+        ws->used = mark;
+        return -1;
     }
 
-    updates = (params->tree_height - params->bds_k) >> 1;
-
-    set_tree_addr(addr, (idx_tree + 1));
-    // mandatory update for NEXT_0 (does not count towards h-k/2) if NEXT_0 exists
-    if ((1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << params->full_height)) {
-        bds_state_update(params, &states[params->d], sk_seed, pub_seed, addr);
+    if (idx >= ((1ULL << params->full_height) - 1)) {
+        // This was the last one-time key; delete the secret key now that the
+        // signature has been produced. Again, this only happens in memory.
+        memset(sk, 0xFF, params->index_bytes);
+        memset(sk + params->index_bytes, 0, (params->sk_bytes - params->index_bytes));
+        ws->used = mark;
+        return 0;
     }
 
-    for (i = 0; i < params->d; i++) {
-        // check if we're not at the end of a tree
-        if (! (((idx + 1) & ((1ULL << ((i+1)*params->tree_height)) - 1)) == 0)) {
-            idx_leaf = (idx >> (params->tree_height * i)) & ((1 << params->tree_height)-1);
-            idx_tree = (idx >> (params->tree_height * (i+1)));
-            set_layer_addr(addr, i);
-            set_tree_addr(addr, idx_tree);
-            if (i == (unsigned int) (needswap_upto + 1)) {
-                bds_round(params, &states[i], idx_leaf, sk_seed, pub_seed, addr);
-            }
-            updates = bds_treehash_update(params, &states[i], updates, sk_seed, pub_seed, addr);
-            set_tree_addr(addr, (idx_tree + 1));
-            // if a NEXT-tree exists for this level;
-            if ((1 + idx_tree) * (1 << params->tree_height) + idx_leaf < (1ULL << (params->full_height - params->tree_height * i))) {
-                if (i > 0 && updates > 0 && states[params->d + i].next_leaf < (1ULL << params->full_height)) {
-                    bds_state_update(params, &states[params->d + i], sk_seed, pub_seed, addr);
-                    updates--;
-                }
-            }
-        }
-        else if (idx < (1ULL << params->full_height) - 1) {
-            deep_state_swap(params, states+params->d + i, states + i);
-
-            set_layer_addr(ots_addr, (i+1));
-            set_tree_addr(ots_addr, ((idx + 1) >> ((i+2) * params->tree_height)));
-            set_ots_addr(ots_addr, (((idx >> ((i+1) * params->tree_height)) + 1) & ((1 << params->tree_height)-1)));
-
-            wots_sign(params, wots_sigs + i*params->wots_sig_bytes, states[i].stack, sk_seed, pub_seed, ots_addr);
-
-            states[params->d + i].stackoffset = 0;
-            states[params->d + i].next_leaf = 0;
-
-            updates--; // WOTS-signing counts as one update
-            needswap_upto = i;
-            for (j = 0; j < params->tree_height-params->bds_k; j++) {
-                states[i].treehash[j].completed = 1;
-            }
-        }
+    /* If the states cannot be advanced, the sk still holds them for idx;
+       withhold the signature, so that idx is not used up. */
+    if (bds_advance(params, states, wots_sigs, idx, sk + params->index_bytes,
+                    deep_state_swap, NULL, NULL, ws)) {
+        memset(sm, 0, *smlen);
+        *smlen = 0;
+        ull_to_bytes(sk, params->index_bytes, idx);
+        ws->used = mark;
+        return -1;
     }
 
-    memcpy(sm, m, mlen);
-    *smlen += mlen;
-
     xmssmt_serialize_state(params, sk, states);
 
+    ws->used = mark;
     return 0;
 }
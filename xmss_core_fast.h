@@ -0,0 +1,176 @@
+#ifndef XMSS_CORE_FAST_H
+#define XMSS_CORE_FAST_H
+
+#include <stdint.h>
+#include "params.h"
+#include "threadpool.h"
+#include "utils.h"
+
+/* This header exposes the BDS traversal state of the fast core to the other
+   modules that are only linked into fast builds (such as xmss_signer.c).
+   It is not part of the public interface. */
+
+typedef struct{
+    unsigned char h;
+    unsigned long next_idx;
+    unsigned char stackusage;
+    unsigned char completed;
+    unsigned char *node;
+    /* The position of this instance in the schedule heap of its state, and
+       its key there; see bds_treehash_select. */
+    unsigned char heappos;
+    unsigned char heapkey;
+} treehash_inst;
+
+typedef struct {
+    unsigned char *stack;
+    unsigned int stackoffset;
+    unsigned char *stacklevels;
+    unsigned char *auth;
+    unsigned char *keep;
+    treehash_inst *treehash;
+    unsigned char *retain;
+    unsigned int next_leaf;
+    /* Min-heap of the unfinished treehash instances that can go next (h - k
+       bytes): those without nodes on the stack, and the one whose nodes are
+       on top. heapactive holds all instances with nodes on the stack. These
+       are derived from the fields above, and are not part of the serialized
+       state. */
+    unsigned char *heap;
+    unsigned int heapsize;
+    unsigned long long heapactive;
+} bds_state;
+
+/* The WOTS key pair of layer i+1 that will sign the root of the next layer-i
+   tree, computed a few chains at a time (see bds_advance). Once all of its
+   chains are done, the WOTS signature at the tree boundary is a lookup. */
+typedef struct {
+    unsigned char *chains;
+    /* The index of the layer-i tree whose root the key pair will sign. */
+    unsigned long long tree;
+    /* The number of chains that have been computed so far. */
+    unsigned int done;
+} bds_wots_table;
+
+/* Exchanges two BDS states at a tree boundary (current tree <-> NEXT tree). */
+typedef void (*bds_swap_fn)(const xmss_params *params,
+                            bds_state *a, bds_state *b);
+
+/**
+ * Writes the scalar fields of the 2d-1 BDS states into the sk. All buffers
+ * are assumed to already point into that same sk (see deserialize).
+ */
+void xmssmt_serialize_state(const xmss_params *params,
+                            unsigned char *sk, bds_state *states);
+
+/**
+ * Maps the 2d-1 BDS states onto the sk, i.e. points all buffers into it and
+ * reads the scalar fields. For d > 1, wots_sigs is pointed to the cached
+ * WOTS signatures of the upper layers.
+ */
+void xmssmt_deserialize_state(const xmss_params *params,
+                              bds_state *states,
+                              unsigned char **wots_sigs,
+                              unsigned char *sk);
+
+/**
+ * Copies the 2d-1 BDS states and the upper-layer WOTS signatures into the sk,
+ * regardless of where their buffers live. This is what allows states that
+ * have been swapped by pointer to be written back to the sk format.
+ */
+void xmssmt_export_state(const xmss_params *params, unsigned char *sk,
+                         const bds_state *states,
+                         const unsigned char *wots_sigs);
+
+/**
+ * Swaps two BDS states by copying their contents, for states that are mapped
+ * onto fixed offsets in the sk.
+ */
+void deep_state_swap(const xmss_params *params, bds_state *a, bds_state *b);
+
+/**
+ * Swaps two BDS states by exchanging their pointers, for states that own
+ * their buffers.
+ */
+void bds_state_swap(const xmss_params *params, bds_state *a, bds_state *b);
+
+/**
+ * Returns the treehash instance that the next update of state goes to; i.e.
+ * the unfinished instance with the lowest node on the stack (or the lowest
+ * instance among those), or h - k if all instances are finished.
+ * Unless built with BDS_LINEAR_SCAN, this is the top of the schedule heap.
+ */
+unsigned int bds_treehash_select(const xmss_params *params,
+                                 const bds_state *state);
+
+/**
+ * Restores the schedule heap after treehash instance i of state (and thereby
+ * possibly the stack) has changed.
+ */
+void bds_treehash_reschedule(const xmss_params *params,
+                             bds_state *state, unsigned int i);
+
+/**
+ * Rebuilds the schedule heap of state from its treehash instances.
+ */
+void bds_treehash_schedule_init(const xmss_params *params, bds_state *state);
+
+/**
+ * Produces the signature for leaf idx: the index, R, the bottom-most WOTS
+ * signature and the auth paths (and upper-layer WOTS signatures) that are
+ * currently held in the BDS states. The message is appended.
+ * keys points to [SK_SEED || SK_PRF || root || PUB_SEED].
+ * If chains is not NULL, it holds the output of wots_chains_gen for leaf idx
+ * and the bottom-most WOTS signature is looked up rather than computed.
+ * The scratch memory is taken from ws (see bds_workspace_size).
+ * Returns -1 without signing if ws has less than that left, 0 otherwise.
+ */
+int bds_sign_leaf(const xmss_params *params,
+                  unsigned char *sm, unsigned long long *smlen,
+                  const unsigned char *m, unsigned long long mlen,
+                  unsigned long long idx, const unsigned char *keys,
+                  const bds_state *states, const unsigned char *wots_sigs,
+                  const unsigned char *chains, xmss_workspace *ws);
+
+/**
+ * Advances the BDS states after leaf idx has been used, so that they hold the
+ * auth paths for idx + 1. This does not depend on the signed message.
+ * If tables is not NULL, it points to d-1 tables (each with wots_len * w * n
+ * bytes of chains) in which the upper-layer WOTS signatures are prepared
+ * evenly across all signatures of a tree, rather than computed at once when
+ * crossing the tree boundary. The resulting state is the same either way.
+ * If pool is not NULL, the leaves for the treehash updates of a layer are
+ * computed concurrently on it (and the workers use their own stacks).
+ * The scratch memory of the calling thread is taken from ws; returns -1
+ * without changing the states if it has less than bds_workspace_size bytes
+ * left, 0 otherwise.
+ */
+int bds_advance(const xmss_params *params,
+                bds_state *states, unsigned char *wots_sigs,
+                unsigned long long idx, const unsigned char *keys,
+                bds_swap_fn swap, bds_wots_table *tables,
+                threadpool *pool, xmss_workspace *ws);
+
+/**
+ * Builds the state of every layer whose bit is clear in the bitmap *layers
+ * (bit i for layer i), and the WOTS signature on the root of its tree, as
+ * they are when idx is the next leaf to be used; then sets its bit. As after
+ * key generation, the NEXT state of a layer is left to the signatures that
+ * follow if idx is the first leaf of its tree, and is built in full
+ * otherwise. This lets a key hold only the layers that it has used so far.
+ * keys points to [SK_SEED || SK_PRF || root || PUB_SEED].
+ * Returns -1 without building anything if ws has less than
+ * bds_workspace_size bytes left, 0 otherwise.
+ */
+int bds_build_layers(const xmss_params *params, bds_state *states,
+                     unsigned char *wots_sigs, unsigned long long *layers,
+                     unsigned long long idx, const unsigned char *keys,
+                     xmss_workspace *ws);
+
+/**
+ * Returns the number of workspace bytes that bds_sign_leaf and bds_advance
+ * need at most, including the alignment of the allocations.
+ */
+unsigned long long bds_workspace_size(const xmss_params *params);
+
+#endif
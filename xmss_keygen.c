@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "xmss_keygen.h"
+
+int xmss_keygen_write_file(void *ctx, const unsigned char *record,
+                           unsigned long long len)
+{
+    const char *path = ctx;
+    char *tmp = malloc(strlen(path) + 5);
+    unsigned long long written = 0;
+    ssize_t ret;
+    int fd;
+
+    if (tmp == NULL) {
+        return -1;
+    }
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+    while (written < len) {
+        ret = write(fd, record + written, len - written);
+        if (ret <= 0) {
+            break;
+        }
+        written += ret;
+    }
+    /* Only replace the previous checkpoint once this one is on storage. */
+    if (written < len || fsync(fd)) {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    if (close(fd) || rename(tmp, path)) {
+        unlink(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    return 0;
+}
+
+int xmss_keygen_read_file(const char *path, unsigned char *record,
+                          unsigned long long len)
+{
+    unsigned long long done = 0;
+    struct stat st;
+    ssize_t ret;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) || (unsigned long long)st.st_size != len) {
+        close(fd);
+        return -1;
+    }
+    while (done < len) {
+        ret = read(fd, record + done, len - done);
+        if (ret <= 0) {
+            break;
+        }
+        done += ret;
+    }
+    close(fd);
+    return done == len ? 0 : -1;
+}
@@ -0,0 +1,99 @@
+#ifndef XMSS_KEYGEN_H
+#define XMSS_KEYGEN_H
+
+#include "params.h"
+
+/* Key generation computes every leaf of the d trees of the initial BDS state,
+   which takes hours for tall trees. A resumable key generation periodically
+   hands a checkpoint to the caller, from which it can be continued after a
+   crash or restart, and produces the same key as if it had not been stopped.
+   A checkpoint holds the secret key seeds; store it as the key itself.
+
+   Resumable key generation is only provided by the fast (BDS-based) core. */
+
+/* Stores a checkpoint record durably, e.g. by writing and syncing it to a
+   file (see xmss_keygen_write_file). Returns 0 once the record is stored;
+   otherwise, key generation is stopped. */
+typedef int (*xmss_keygen_checkpoint_fn)(void *ctx, const unsigned char *record,
+                                         unsigned long long len);
+
+/* Reports that 'done' of 'total' leaves have been computed (including those
+   before a resumed checkpoint), at 'rate' leaves per second since the start
+   or resumption of the key generation. */
+typedef void (*xmss_keygen_progress_fn)(void *ctx, unsigned long long done,
+                                        unsigned long long total, double rate);
+
+/**
+ * Returns the size of a checkpoint record: the position within the tree that
+ * is being computed, its stack of unmerged nodes, and the secret key with the
+ * part of the BDS state that has been filled in so far.
+ */
+unsigned long long xmss_keygen_checkpoint_bytes(const xmss_params *params);
+
+/**
+ * Generates a key pair as xmssmt_core_keypair does (which works for XMSS
+ * too), or continues the one that the checkpoint record 'resume' was taken
+ * of, if it is not NULL. After every 'interval' leaves of a tree (if not 0),
+ * and after every tree but the last, the record of the key generation so
+ * far is passed to checkpoint, and progress is reported (either may be NULL).
+ * The same ctx is passed to both.
+ * With 'threads' greater than 1, the leaves are computed in a pipeline on
+ * that many threads: they compute blocks of consecutive leaves into a bounded
+ * ring, from which one thread at a time adds them to the trees in order.
+ * With 'threads' 0, the pipeline runs on the shared pool (see threadpool.h),
+ * and with 1 on the calling thread. The key is the same either way.
+ * Returns -1 if the record is invalid or checkpoint failed, 0 otherwise.
+ */
+int xmssmt_core_keypair_resumable(const xmss_params *params,
+                                  unsigned char *pk, unsigned char *sk,
+                                  const unsigned char *resume,
+                                  unsigned long long interval,
+                                  unsigned int threads,
+                                  xmss_keygen_checkpoint_fn checkpoint,
+                                  xmss_keygen_progress_fn progress, void *ctx);
+
+/**
+ * Returns the size of a secret key from xmssmt_core_keypair_lazy, which only
+ * holds the BDS state of the top layer (see xmss_xmssmt_core_sk_bytes).
+ */
+unsigned long long xmssmt_core_lazy_sk_bytes(const xmss_params *params);
+
+/**
+ * Generates a key pair as xmssmt_core_keypair does, but only builds the state
+ * of the top layer, which the root of the key is taken from. lazy_sk has
+ * xmssmt_core_lazy_sk_bytes bytes, rather than params->sk_bytes: the states
+ * of the layers below the top, the NEXT states and the WOTS signatures on the
+ * roots are left out. A signer loaded with xmss_signer_load_lazy builds
+ * them when it first needs them, which then takes about as long as the rest
+ * of the key generation would have; so does xmssmt_core_materialize, which
+ * expands the key into a full sk for xmssmt_core_sign. For XMSSMT with d
+ * layers, this makes the key generation d times faster.
+ */
+int xmssmt_core_keypair_lazy(const xmss_params *params,
+                             unsigned char *pk, unsigned char *lazy_sk);
+
+/**
+ * Expands lazy_sk from xmssmt_core_keypair_lazy into sk (params->sk_bytes),
+ * building the layers that were left out. Signatures are the same as for a
+ * key generated by xmssmt_core_keypair from the same seeds.
+ * Returns -1 if lazy_sk is not at index 0, 0 otherwise.
+ */
+int xmssmt_core_materialize(const xmss_params *params, unsigned char *sk,
+                            const unsigned char *lazy_sk);
+
+/**
+ * A checkpoint function that writes the record to the file whose path is
+ * ctx. The record is written to a temporary file next to it, synced, and
+ * renamed over the path, so that the file always holds a complete record.
+ */
+int xmss_keygen_write_file(void *ctx, const unsigned char *record,
+                           unsigned long long len);
+
+/**
+ * Reads a checkpoint record of len bytes from the file at path.
+ * Returns -1 if the file does not exist or has a different size, 0 otherwise.
+ */
+int xmss_keygen_read_file(const char *path, unsigned char *record,
+                          unsigned long long len);
+
+#endif
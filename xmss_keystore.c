@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "xmss_commons.h"
+#include "xmss_keystore.h"
+
+struct xmss_keystore {
+    int fd;
+    /* The mapping starts at the page that contains the secret key. */
+    unsigned char *map;
+    unsigned long long maplen;
+    unsigned char *sk;
+    unsigned long long pagesize;
+};
+
+xmss_keystore *xmss_keystore_open(const char *path,
+                                  unsigned long long offset,
+                                  unsigned long long len)
+{
+    xmss_keystore *store = malloc(sizeof(xmss_keystore));
+    unsigned long long start;
+    void *map;
+
+    if (store == NULL) {
+        return NULL;
+    }
+    store->pagesize = sysconf(_SC_PAGESIZE);
+    store->fd = open(path, O_RDWR);
+    if (store->fd < 0) {
+        free(store);
+        return NULL;
+    }
+
+    /* mmap needs an offset that is a multiple of the page size. */
+    start = offset - offset % store->pagesize;
+    store->maplen = offset + len - start;
+    map = mmap(NULL, store->maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+               store->fd, start);
+    if (map == MAP_FAILED) {
+        close(store->fd);
+        free(store);
+        return NULL;
+    }
+    store->map = map;
+    store->sk = store->map + (offset - start);
+    return store;
+}
+
+unsigned char *xmss_keystore_sk(xmss_keystore *store)
+{
+    return store->sk;
+}
+
+int xmss_keystore_sync(xmss_keystore *store,
+                       const xmss_sk_range *ranges, unsigned int count)
+{
+    unsigned long long first, last;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        if (ranges[i].len == 0) {
+            continue;
+        }
+        first = (store->sk - store->map) + ranges[i].offset;
+        last = first + ranges[i].len;
+        first -= first % store->pagesize;
+        if (msync(store->map + first, last - first, MS_SYNC)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void xmss_keystore_close(xmss_keystore *store)
+{
+    if (store == NULL) {
+        return;
+    }
+    munmap(store->map, store->maplen);
+    close(store->fd);
+    free(store);
+}
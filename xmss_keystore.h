@@ -0,0 +1,41 @@
+#ifndef XMSS_KEYSTORE_H
+#define XMSS_KEYSTORE_H
+
+#include "xmss_commons.h"
+
+/* A key store maps the secret key in a file into memory, so that a state can
+   be persisted by changing only the bytes that differ (for example using
+   xmss_signer_persist_dirty) and syncing only the pages that hold them,
+   rather than rewriting and syncing the whole key. */
+
+typedef struct xmss_keystore xmss_keystore;
+
+/**
+ * Maps the len bytes at offset in the file at path, which must already
+ * contain them (e.g. the sk part of a key pair file written by keypair).
+ * Returns NULL if the file could not be opened or mapped.
+ */
+xmss_keystore *xmss_keystore_open(const char *path,
+                                  unsigned long long offset,
+                                  unsigned long long len);
+
+/**
+ * Returns the mapped secret key. Changes to it end up in the file, but are
+ * only guaranteed to be on storage after xmss_keystore_sync.
+ */
+unsigned char *xmss_keystore_sk(xmss_keystore *store);
+
+/**
+ * Writes the pages that hold the given ranges of the secret key to storage,
+ * and waits until that has completed.
+ * Returns -1 if that failed, 0 otherwise.
+ */
+int xmss_keystore_sync(xmss_keystore *store,
+                       const xmss_sk_range *ranges, unsigned int count);
+
+/**
+ * Unmaps the secret key and closes the file. This does not sync it.
+ */
+void xmss_keystore_close(xmss_keystore *store);
+
+#endif
@@ -0,0 +1,790 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "hash_address.h"
+#include "params.h"
+#include "threadpool.h"
+#include "utils.h"
+#include "wots.h"
+#include "xmss_commons.h"
+#include "xmss_core_fast.h"
+#include "xmss_keygen.h"
+#include "xmss_signer.h"
+
+struct xmss_signer {
+    xmss_params params;
+    /* The index of the next one-time key to use. */
+    unsigned long long idx;
+    /* The end of the range of a sub-key, or 0 for a whole key. */
+    unsigned long long end;
+    /* A private copy of the sk; the BDS states point into it. */
+    unsigned char *sk;
+    /* [SK_SEED || SK_PRF || root || PUB_SEED], inside sk. */
+    unsigned char *keys;
+    bds_state *states;
+    /* Bit i is set if the state of layer i (with its NEXT state and the
+       WOTS signature on its root) has been built; see xmss_signer_load_lazy.
+       The NEXT states themselves are filled in gradually, as ever. */
+    unsigned long long layers;
+    treehash_inst *treehash;
+    unsigned char *heap;
+    unsigned char *wots_sigs;
+    /* Scratch memory for signing and advancing the state; whichever of the
+       caller and the background worker owns the state also owns this. */
+    unsigned char *ws_buf;
+    xmss_workspace ws;
+    /* Ring of WOTS chains for upcoming leaves; slot i holds the chains of
+       the leaf with index precomp_idx[i], if precomp_valid[i] is set. */
+    unsigned int precomp_leaves;
+    unsigned char *precomp_chains;
+    unsigned long long *precomp_idx;
+    unsigned char *precomp_valid;
+    /* Scratch lists of the leaves that a refill computes, and their slots;
+       allocated with the ring, so that its size does not land on the stack. */
+    unsigned long long *precomp_todo;
+    unsigned int *precomp_slots;
+    /* Upper-layer WOTS signatures that are prepared ahead of the tree
+       boundaries, one table per layer below the top; NULL if disabled. */
+    bds_wots_table *smoothing;
+    /* Threads that compute the leaves of the treehash updates and the
+       precomputed WOTS chains; NULL if the signer advances its state on a
+       single thread, or if it uses the shared pool (see signer_pool). */
+    threadpool *pool;
+    int shared_pool;
+    /* Lease-ahead persistence; indices below the watermark have been
+       persisted as used, and can be handed out without calling persist. */
+    unsigned int lease_window;
+    xmss_signer_persist_fn lease_persist;
+    void *lease_ctx;
+    unsigned char *lease_record;
+    unsigned long long watermark;
+    /* Background worker that advances the state after each signature. While
+       busy is set, it owns everything above (except for idx). */
+    int async;
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int busy;
+    int stop;
+    unsigned long long job_idx;
+    /* Set if the worker could not advance the state past job_idx; the state
+       then still holds leaf job_idx, and signer_sync tries again. */
+    int advance_failed;
+};
+
+/* The number of bytes wots_chains_gen produces for a single leaf. */
+static unsigned long long chains_bytes(const xmss_params *params)
+{
+    return (unsigned long long)params->wots_len * params->wots_w * params->n;
+}
+
+/**
+ * Destroys the secret key material, leaving the signer in the same state as
+ * an sk that xmssmt_core_sign deleted after its last signature.
+ */
+static void signer_wipe(xmss_signer *signer)
+{
+    const xmss_params *params = &signer->params;
+    unsigned int i;
+
+    memset(signer->sk, 0xFF, params->index_bytes);
+    signer->idx = bytes_to_ull(signer->sk, params->index_bytes);
+    memset(signer->sk + params->index_bytes, 0,
+           params->sk_bytes - params->index_bytes);
+    if (signer->precomp_leaves > 0) {
+        memset(signer->precomp_chains, 0,
+               signer->precomp_leaves * chains_bytes(params));
+        memset(signer->precomp_valid, 0, signer->precomp_leaves);
+    }
+    if (signer->smoothing != NULL) {
+        memset(signer->smoothing[0].chains, 0,
+               (params->d - 1) * chains_bytes(params));
+        for (i = 0; i + 1 < params->d; i++) {
+            signer->smoothing[i].done = 0;
+        }
+    }
+}
+
+/**
+ * Returns the precomputed chains for leaf idx, or NULL if they are not there.
+ */
+static unsigned char *precomp_lookup(const xmss_signer *signer,
+                                     unsigned long long idx)
+{
+    unsigned int slot;
+
+    if (signer->precomp_leaves == 0) {
+        return NULL;
+    }
+    slot = idx % signer->precomp_leaves;
+    if (!signer->precomp_valid[slot] || signer->precomp_idx[slot] != idx) {
+        return NULL;
+    }
+    return signer->precomp_chains + slot * chains_bytes(&signer->params);
+}
+
+/**
+ * Returns the pool that the signer computes on (NULL for a single thread).
+ */
+static threadpool *signer_pool(const xmss_signer *signer)
+{
+    return signer->shared_pool ? threadpool_shared() : signer->pool;
+}
+
+/**
+ * Waits until the background worker (if any) has finished advancing the
+ * state, after which the caller can use the state. If the worker failed to
+ * advance it, this does so itself; returns -1 if that fails too, 0 otherwise.
+ */
+static int signer_sync(xmss_signer *signer)
+{
+    if (!signer->async) {
+        return 0;
+    }
+    pthread_mutex_lock(&signer->lock);
+    while (signer->busy) {
+        pthread_cond_wait(&signer->cond, &signer->lock);
+    }
+    pthread_mutex_unlock(&signer->lock);
+
+    if (signer->advance_failed) {
+        if (bds_advance(&signer->params, signer->states, signer->wots_sigs,
+                        signer->job_idx, signer->keys, bds_state_swap,
+                        signer->smoothing, signer_pool(signer), &signer->ws)) {
+            return -1;
+        }
+        signer->advance_failed = 0;
+    }
+    return 0;
+}
+
+/**
+ * Builds the layers that a lazily loaded signer does not have yet; every
+ * signature carries an auth path of each layer, so they are all needed from
+ * the first signature on. Returns -1 if that fails, 0 otherwise.
+ */
+static int signer_build_layers(xmss_signer *signer)
+{
+    const xmss_params *params = &signer->params;
+
+    if (signer->layers == (1ULL << params->d) - 1) {
+        return 0;
+    }
+    return bds_build_layers(params, signer->states, signer->wots_sigs,
+                            &signer->layers, signer->idx, signer->keys,
+                            &signer->ws);
+}
+
+/* The leaves of the precomputation ring whose chains are computed in one
+   batch, with the slots that they go to. */
+typedef struct {
+    const xmss_signer *signer;
+    const unsigned long long *idx;
+    const unsigned int *slot;
+} precompute_job;
+
+/**
+ * Computes the chains of leaf i of a batch; called from threadpool_run.
+ */
+static void precompute_leaf(void *arg, unsigned int i)
+{
+    const precompute_job *job = arg;
+    const xmss_signer *signer = job->signer;
+    const xmss_params *params = &signer->params;
+    uint32_t ots_addr[8] = {0};
+
+    /* This is the address that bds_sign_leaf uses for leaf idx. */
+    set_type(ots_addr, 0);
+    set_layer_addr(ots_addr, 0);
+    set_tree_addr(ots_addr, job->idx[i] >> params->tree_height);
+    set_ots_addr(ots_addr, job->idx[i] & ((1 << params->tree_height)-1));
+
+    wots_chains_gen(params, signer->precomp_chains + job->slot[i] * chains_bytes(params),
+                    signer->keys, signer->keys + 3*params->n, ots_addr);
+}
+
+/**
+ * Fills the precomputation ring for the upcoming leaves, computing the
+ * chains of the missing leaves concurrently on the pool of the signer.
+ */
+static void precompute_upcoming(xmss_signer *signer)
+{
+    const xmss_params *params = &signer->params;
+    unsigned long long idx;
+    unsigned long long *todo = signer->precomp_todo;
+    unsigned int *slots = signer->precomp_slots;
+    precompute_job job = {signer, todo, slots};
+    unsigned int count = 0, i;
+
+    for (idx = signer->idx; idx < signer->idx + signer->precomp_leaves; idx++) {
+        /* There are no leaves beyond the last index (of the range). */
+        if (idx > ((1ULL << params->full_height) - 1) ||
+            (signer->end != 0 && idx >= signer->end)) {
+            break;
+        }
+        if (precomp_lookup(signer, idx) != NULL) {
+            continue;
+        }
+        todo[count] = idx;
+        slots[count] = idx % signer->precomp_leaves;
+        count++;
+    }
+
+    threadpool_run(signer_pool(signer), precompute_leaf, &job, count);
+    for (i = 0; i < count; i++) {
+        signer->precomp_idx[slots[i]] = todo[i];
+        signer->precomp_valid[slots[i]] = 1;
+    }
+}
+
+/**
+ * Performs the message-independent work after the signature for job_idx has
+ * been handed out: it advances the BDS states and refills the precomputed
+ * WOTS chains.
+ */
+static void *signer_worker(void *arg)
+{
+    xmss_signer *signer = arg;
+    unsigned long long idx;
+
+    pthread_mutex_lock(&signer->lock);
+    for (;;) {
+        while (!signer->busy && !signer->stop) {
+            pthread_cond_wait(&signer->cond, &signer->lock);
+        }
+        if (!signer->busy) {
+            break;
+        }
+        idx = signer->job_idx;
+        pthread_mutex_unlock(&signer->lock);
+
+        if (bds_advance(&signer->params, signer->states, signer->wots_sigs, idx,
+                        signer->keys, bds_state_swap, signer->smoothing,
+                        signer_pool(signer), &signer->ws)) {
+            signer->advance_failed = 1;
+        }
+        else {
+            precompute_upcoming(signer);
+        }
+
+        pthread_mutex_lock(&signer->lock);
+        signer->busy = 0;
+        pthread_cond_broadcast(&signer->cond);
+    }
+    pthread_mutex_unlock(&signer->lock);
+
+    return NULL;
+}
+
+/**
+ * Creates a signer with room for the state of a full key, without loading
+ * a state into it yet (see signer_load_states).
+ */
+static xmss_signer *signer_create(const xmss_params *params)
+{
+    unsigned int states = 2*params->d - 1;
+    unsigned int instances = params->tree_height - params->bds_k;
+    xmss_signer *signer;
+
+    signer = calloc(1, sizeof(xmss_signer));
+    if (signer == NULL) {
+        return NULL;
+    }
+    signer->params = *params;
+    signer->sk = malloc(params->sk_bytes);
+    signer->states = malloc(states * sizeof(bds_state));
+    /* Allocate at least one instance, as malloc(0) may return NULL. */
+    signer->treehash = malloc((states * instances + 1) * sizeof(treehash_inst));
+    signer->heap = malloc(states * instances + 1);
+    signer->ws_buf = malloc(bds_workspace_size(params) + XMSS_WS_ALIGN);
+    if (signer->sk == NULL || signer->states == NULL ||
+        signer->treehash == NULL || signer->heap == NULL ||
+        signer->ws_buf == NULL) {
+        xmss_signer_free(signer);
+        return NULL;
+    }
+    xmss_ws_init(&signer->ws, signer->ws_buf,
+                 bds_workspace_size(params) + XMSS_WS_ALIGN);
+    return signer;
+}
+
+/**
+ * Points the states of the signer into signer->sk, and sets up their
+ * treehash schedules.
+ */
+static void signer_load_states(xmss_signer *signer)
+{
+    const xmss_params *params = &signer->params;
+    unsigned int instances = params->tree_height - params->bds_k;
+    unsigned int i;
+
+    signer->idx = bytes_to_ull(signer->sk, params->index_bytes);
+    signer->keys = signer->sk + params->index_bytes;
+
+    for (i = 0; i < 2*params->d - 1; i++) {
+        signer->states[i].treehash = signer->treehash + i * instances;
+        signer->states[i].heap = signer->heap + i * instances;
+    }
+    xmssmt_deserialize_state(params, signer->states, &signer->wots_sigs,
+                             signer->sk);
+    /* The NEXT states do not use their treehash instances until swapped in. */
+    for (i = 0; i < params->d; i++) {
+        bds_treehash_schedule_init(params, &signer->states[i]);
+    }
+}
+
+xmss_signer *xmss_signer_load(const xmss_params *params,
+                              const unsigned char *sk)
+{
+    xmss_signer *signer = signer_create(params);
+
+    if (signer == NULL) {
+        return NULL;
+    }
+    memcpy(signer->sk, sk, params->sk_bytes);
+    signer_load_states(signer);
+    signer->layers = (1ULL << params->d) - 1;
+
+    return signer;
+}
+
+xmss_signer *xmss_signer_load_lazy(const xmss_params *params,
+                                   const unsigned char *lazy_sk)
+{
+    const unsigned long long keys_bytes = params->index_bytes + 4*params->n;
+    const unsigned long long state_bytes =
+        xmssmt_core_lazy_sk_bytes(params) - keys_bytes;
+    xmss_signer *signer;
+
+    /* A lazy key cannot sign, so it is always at its first index. */
+    if (bytes_to_ull(lazy_sk, params->index_bytes) != 0) {
+        return NULL;
+    }
+    signer = signer_create(params);
+    if (signer == NULL) {
+        return NULL;
+    }
+    /* The top state goes where it is in a full sk; the others stay empty
+       until signer_build_layers builds them. */
+    memset(signer->sk, 0, params->sk_bytes);
+    memcpy(signer->sk, lazy_sk, keys_bytes);
+    memcpy(signer->sk + keys_bytes + (params->d - 1) * state_bytes,
+           lazy_sk + keys_bytes, state_bytes);
+    signer_load_states(signer);
+    signer->layers = 1ULL << (params->d - 1);
+
+    return signer;
+}
+
+xmss_signer *xmss_signer_load_subkey(const xmss_params *params,
+                                     const unsigned char *subkey)
+{
+    xmss_signer *signer = xmss_signer_load(params, subkey);
+
+    if (signer != NULL) {
+        signer->end = bytes_to_ull(subkey + params->sk_bytes,
+                                   params->index_bytes);
+    }
+    return signer;
+}
+
+xmss_signer *xmss_signer_load_lease(const xmss_params *params,
+                                    const unsigned char *record)
+{
+    xmss_signer *signer = xmss_signer_load(params, record);
+    unsigned long long idx;
+
+    if (signer == NULL) {
+        return NULL;
+    }
+    /* The state was exported at an earlier position; catch up with the
+       watermark, as signing (without the signatures) would. A record of a
+       deleted key has nothing to catch up with. */
+    if (signer->idx <= ((1ULL << params->full_height) - 1)) {
+        for (idx = bytes_to_ull(record + params->sk_bytes, params->index_bytes);
+             idx < signer->idx && idx < ((1ULL << params->full_height) - 1);
+             idx++) {
+            if (bds_advance(params, signer->states, signer->wots_sigs, idx,
+                            signer->keys, bds_state_swap, NULL, NULL,
+                            &signer->ws)) {
+                xmss_signer_free(signer);
+                return NULL;
+            }
+        }
+    }
+    signer->watermark = signer->idx;
+    signer->end = bytes_to_ull(record + params->sk_bytes + params->index_bytes,
+                               params->index_bytes);
+    return signer;
+}
+
+/**
+ * Extends the lease beyond idx, if it does not cover idx yet: writes a record
+ * of the current state with the new watermark as its index, and hands it to
+ * the persist callback. Returns -1 if that fails, 0 otherwise.
+ */
+static int lease_extend(xmss_signer *signer, unsigned long long idx)
+{
+    const xmss_params *params = &signer->params;
+    unsigned long long watermark;
+
+    if (signer->lease_persist == NULL || idx < signer->watermark) {
+        return 0;
+    }
+    watermark = idx + signer->lease_window;
+    if (watermark > ((1ULL << params->full_height) - 1)) {
+        watermark = (1ULL << params->full_height) - 1;
+    }
+    if (signer->end != 0 && watermark > signer->end) {
+        watermark = signer->end;
+    }
+    /* Never less than one index ahead, so that idx itself is covered. */
+    if (watermark <= idx) {
+        watermark = idx + 1;
+    }
+
+    xmss_signer_persist(signer, signer->lease_record);
+    ull_to_bytes(signer->lease_record, params->index_bytes, watermark);
+    ull_to_bytes(signer->lease_record + params->sk_bytes, params->index_bytes,
+                 idx);
+    ull_to_bytes(signer->lease_record + params->sk_bytes + params->index_bytes,
+                 params->index_bytes, signer->end);
+    if (signer->lease_persist(signer->lease_ctx, signer->lease_record,
+                              xmss_signer_lease_bytes(params))) {
+        return -1;
+    }
+    signer->watermark = watermark;
+    return 0;
+}
+
+int xmss_signer_sign(xmss_signer *signer,
+                     unsigned char *sm, unsigned long long *smlen,
+                     const unsigned char *m, unsigned long long mlen)
+{
+    const xmss_params *params = &signer->params;
+    unsigned long long idx = signer->idx;
+    unsigned char *chains;
+
+    /* Take over the state from the background worker. */
+    if (signer_sync(signer)) {
+        return -1;
+    }
+
+    /* See xmssmt_core_sign for the treatment of the last index. */
+    if (idx >= ((1ULL << params->full_height) - 1)) {
+        if ((idx > ((1ULL << params->full_height) - 1)) ||
+            ((params->full_height == 64) && (idx == ((1ULL << params->full_height) - 1)))) {
+            signer_wipe(signer);
+            return -2;
+        }
+    }
+
+    if (signer->end != 0 && idx >= signer->end) {
+        signer_wipe(signer);
+        return -2;
+    }
+
+    if (signer_build_layers(signer)) {
+        return -1;
+    }
+
+    /* The index must be persisted as used before the signature exists. */
+    if (lease_extend(signer, idx)) {
+        return -1;
+    }
+
+    chains = precomp_lookup(signer, idx);
+    if (bds_sign_leaf(params, sm, smlen, m, mlen, idx, signer->keys,
+                      signer->states, signer->wots_sigs, chains, &signer->ws)) {
+        return -1;
+    }
+    if (chains != NULL) {
+        /* The chains contain the WOTS private key; do not keep it around. */
+        memset(chains, 0, chains_bytes(params));
+        signer->precomp_valid[idx % signer->precomp_leaves] = 0;
+    }
+
+    if (idx >= ((1ULL << params->full_height) - 1) || idx + 1 == signer->end) {
+        signer_wipe(signer);
+        return 0;
+    }
+
+    if (signer->async) {
+        /* Hand the state to the worker, and return the signature already. */
+        signer->idx = idx + 1;
+        pthread_mutex_lock(&signer->lock);
+        signer->job_idx = idx;
+        signer->busy = 1;
+        pthread_cond_broadcast(&signer->cond);
+        pthread_mutex_unlock(&signer->lock);
+        return 0;
+    }
+
+    /* Since the states own their buffers, tree boundaries only swap
+       pointers rather than copying the states. If the states cannot be
+       advanced, they still hold leaf idx; withhold the signature, so that
+       idx is not used up. */
+    if (bds_advance(params, signer->states, signer->wots_sigs, idx,
+                    signer->keys, bds_state_swap, signer->smoothing,
+                    signer_pool(signer), &signer->ws)) {
+        memset(sm, 0, *smlen);
+        *smlen = 0;
+        return -1;
+    }
+    signer->idx = idx + 1;
+
+    return 0;
+}
+
+int xmss_signer_set_async(xmss_signer *signer, int enable)
+{
+    if (enable && !signer->async) {
+        if (pthread_mutex_init(&signer->lock, NULL)) {
+            return -1;
+        }
+        if (pthread_cond_init(&signer->cond, NULL)) {
+            pthread_mutex_destroy(&signer->lock);
+            return -1;
+        }
+        signer->busy = 0;
+        signer->stop = 0;
+        if (pthread_create(&signer->worker, NULL, signer_worker, signer)) {
+            pthread_cond_destroy(&signer->cond);
+            pthread_mutex_destroy(&signer->lock);
+            return -1;
+        }
+        signer->async = 1;
+    }
+    else if (!enable && signer->async) {
+        signer_sync(signer);
+        pthread_mutex_lock(&signer->lock);
+        signer->stop = 1;
+        pthread_cond_broadcast(&signer->cond);
+        pthread_mutex_unlock(&signer->lock);
+        pthread_join(signer->worker, NULL);
+        pthread_cond_destroy(&signer->cond);
+        pthread_mutex_destroy(&signer->lock);
+        signer->async = 0;
+    }
+    return 0;
+}
+
+int xmss_signer_set_precompute(xmss_signer *signer, unsigned int leaves)
+{
+    const xmss_params *params = &signer->params;
+
+    signer_sync(signer);
+
+    if (signer->precomp_leaves > 0) {
+        memset(signer->precomp_chains, 0,
+               signer->precomp_leaves * chains_bytes(params));
+    }
+    free(signer->precomp_chains);
+    free(signer->precomp_idx);
+    free(signer->precomp_valid);
+    free(signer->precomp_todo);
+    free(signer->precomp_slots);
+    signer->precomp_leaves = 0;
+    signer->precomp_chains = NULL;
+    signer->precomp_idx = NULL;
+    signer->precomp_valid = NULL;
+    signer->precomp_todo = NULL;
+    signer->precomp_slots = NULL;
+
+    if (leaves == 0) {
+        return 0;
+    }
+    signer->precomp_chains = malloc(leaves * chains_bytes(params));
+    signer->precomp_idx = malloc(leaves * sizeof(unsigned long long));
+    signer->precomp_valid = calloc(leaves, 1);
+    signer->precomp_todo = malloc(leaves * sizeof(unsigned long long));
+    signer->precomp_slots = malloc(leaves * sizeof(unsigned int));
+    if (signer->precomp_chains == NULL || signer->precomp_idx == NULL ||
+        signer->precomp_valid == NULL || signer->precomp_todo == NULL ||
+        signer->precomp_slots == NULL) {
+        free(signer->precomp_chains);
+        free(signer->precomp_idx);
+        free(signer->precomp_valid);
+        free(signer->precomp_todo);
+        free(signer->precomp_slots);
+        signer->precomp_chains = NULL;
+        signer->precomp_idx = NULL;
+        signer->precomp_valid = NULL;
+        signer->precomp_todo = NULL;
+        signer->precomp_slots = NULL;
+        return -1;
+    }
+    signer->precomp_leaves = leaves;
+    return 0;
+}
+
+int xmss_signer_set_smoothing(xmss_signer *signer, int enable)
+{
+    const xmss_params *params = &signer->params;
+    unsigned char *chains;
+    unsigned int i;
+
+    signer_sync(signer);
+
+    if (signer->smoothing != NULL) {
+        memset(signer->smoothing[0].chains, 0,
+               (params->d - 1) * chains_bytes(params));
+        free(signer->smoothing[0].chains);
+        free(signer->smoothing);
+        signer->smoothing = NULL;
+    }
+
+    /* Without upper layers, there are no WOTS signatures to prepare. */
+    if (!enable || params->d == 1) {
+        return 0;
+    }
+    signer->smoothing = calloc(params->d - 1, sizeof(bds_wots_table));
+    chains = malloc((params->d - 1) * chains_bytes(params));
+    if (signer->smoothing == NULL || chains == NULL) {
+        free(signer->smoothing);
+        free(chains);
+        signer->smoothing = NULL;
+        return -1;
+    }
+    for (i = 0; i + 1 < params->d; i++) {
+        signer->smoothing[i].chains = chains + i * chains_bytes(params);
+    }
+    return 0;
+}
+
+int xmss_signer_set_threads(xmss_signer *signer, unsigned int threads)
+{
+    signer_sync(signer);
+
+    threadpool_free(signer->pool);
+    signer->pool = NULL;
+    signer->shared_pool = threads == 0;
+    if (threads < 2) {
+        return 0;
+    }
+    signer->pool = threadpool_create(threads);
+    return signer->pool == NULL ? -1 : 0;
+}
+
+unsigned long long xmss_signer_lease_bytes(const xmss_params *params)
+{
+    return params->sk_bytes + 2 * params->index_bytes;
+}
+
+int xmss_signer_set_lease(xmss_signer *signer, unsigned int window,
+                          xmss_signer_persist_fn persist, void *ctx)
+{
+    signer_sync(signer);
+
+    if (signer->lease_record != NULL) {
+        memset(signer->lease_record, 0,
+               xmss_signer_lease_bytes(&signer->params));
+    }
+    free(signer->lease_record);
+    signer->lease_record = NULL;
+    signer->lease_persist = NULL;
+    signer->lease_window = 0;
+
+    if (persist == NULL || window == 0) {
+        return 0;
+    }
+    signer->lease_record = malloc(xmss_signer_lease_bytes(&signer->params));
+    if (signer->lease_record == NULL) {
+        return -1;
+    }
+    signer->lease_window = window;
+    signer->lease_persist = persist;
+    signer->lease_ctx = ctx;
+    /* Nothing ahead of the current index has been leased yet. */
+    signer->watermark = signer->idx;
+    return 0;
+}
+
+unsigned long long xmss_signer_watermark(const xmss_signer *signer)
+{
+    return signer->watermark;
+}
+
+void xmss_signer_precompute(xmss_signer *signer)
+{
+    signer_sync(signer);
+    precompute_upcoming(signer);
+}
+
+void xmss_signer_persist(xmss_signer *signer, unsigned char *sk)
+{
+    const xmss_params *params = &signer->params;
+
+    signer_sync(signer);
+    /* The format of an sk has no room for missing layers. This cannot fail,
+       as the signer's own workspace is large enough. */
+    signer_build_layers(signer);
+
+    ull_to_bytes(sk, params->index_bytes, signer->idx);
+    memcpy(sk + params->index_bytes, signer->keys, 4 * params->n);
+    xmssmt_export_state(params, sk, signer->states, signer->wots_sigs);
+}
+
+int xmss_signer_persist_dirty(xmss_signer *signer, unsigned char *sk,
+                              xmss_sk_range *ranges, unsigned int max)
+{
+    const xmss_params *params = &signer->params;
+    unsigned char *current;
+    unsigned int count, i;
+
+    signer_sync(signer);
+    if (bytes_to_ull(sk, params->index_bytes) > signer->idx) {
+        return -1;
+    }
+
+    current = malloc(params->sk_bytes);
+    if (current == NULL) {
+        xmss_signer_persist(signer, sk);
+        ranges[0].offset = 0;
+        ranges[0].len = params->sk_bytes;
+        return 1;
+    }
+
+    xmss_signer_persist(signer, current);
+    count = xmss_sk_diff(ranges, max, sk, current, params->sk_bytes);
+    for (i = 0; i < count; i++) {
+        memcpy(sk + ranges[i].offset, current + ranges[i].offset, ranges[i].len);
+    }
+
+    memset(current, 0, params->sk_bytes);
+    free(current);
+    return count;
+}
+
+unsigned long long xmss_signer_index(const xmss_signer *signer)
+{
+    return signer->idx;
+}
+
+unsigned long long xmss_signer_layers(const xmss_signer *signer)
+{
+    return signer->layers;
+}
+
+void xmss_signer_free(xmss_signer *signer)
+{
+    if (signer == NULL) {
+        return;
+    }
+    xmss_signer_set_async(signer, 0);
+    if (signer->sk != NULL) {
+        memset(signer->sk, 0, signer->params.sk_bytes);
+    }
+    xmss_signer_set_precompute(signer, 0);
+    xmss_signer_set_smoothing(signer, 0);
+    xmss_signer_set_threads(signer, 1);
+    xmss_signer_set_lease(signer, 0, NULL, NULL);
+    free(signer->sk);
+    free(signer->states);
+    free(signer->treehash);
+    free(signer->heap);
+    free(signer->ws_buf);
+    free(signer);
+}
@@ -0,0 +1,188 @@
+#ifndef XMSS_SIGNER_H
+#define XMSS_SIGNER_H
+
+#include "params.h"
+#include "xmss_commons.h"
+
+/* A signer keeps an XMSS or XMSSMT secret key in memory in its native form;
+   i.e. with parsed parameters and BDS states that own their buffers. Signing
+   through a signer does not parse or rewrite the secret key byte array, so
+   the caller decides when the state is written back (see persist).
+
+   Signers are only provided by the fast (BDS-based) core. */
+
+typedef struct xmss_signer xmss_signer;
+
+/* Stores a lease record (see xmss_signer_set_lease) durably, e.g. by writing
+   and syncing it to a file. Returns 0 once the record is stored. */
+typedef int (*xmss_signer_persist_fn)(void *ctx, const unsigned char *record,
+                                      unsigned long long len);
+
+/**
+ * Creates a signer from a secret key as produced by xmss[mt]_core_keypair,
+ * i.e. without OID. The sk is copied; it is not modified by the signer.
+ * Returns NULL if memory could not be allocated.
+ */
+xmss_signer *xmss_signer_load(const xmss_params *params,
+                              const unsigned char *sk);
+
+/**
+ * Creates a signer from a key from xmssmt_core_keypair_lazy, which only holds
+ * the state of the top layer. The signer builds the states of the layers
+ * below it (and the WOTS signatures on their roots) the first time they are
+ * needed, and tracks which ones it has (see xmss_signer_layers). As every
+ * signature carries an auth path of each layer, that is at the first
+ * signature, which takes about as long as the rest of a key generation, or
+ * when the state is persisted, as an sk holds all layers. Until then, lazy_sk
+ * is all that needs to be stored. Signatures are the same as for a key from
+ * xmssmt_core_keypair with the same seeds.
+ * Returns NULL if lazy_sk is not at index 0 or memory could not be allocated.
+ */
+xmss_signer *xmss_signer_load_lazy(const xmss_params *params,
+                                   const unsigned char *lazy_sk);
+
+/**
+ * Creates a signer from a sub-key as produced by xmssmt_core_subkey, which
+ * signs with the one-time keys of the sub-key's range only. persist writes
+ * the first params->sk_bytes of the sub-key; the end of the range that
+ * follows them does not change.
+ */
+xmss_signer *xmss_signer_load_subkey(const xmss_params *params,
+                                     const unsigned char *subkey);
+
+/**
+ * Creates a signer from the last lease record that was persisted through
+ * xmss_signer_set_lease (e.g. after a crash). The signer continues at the
+ * watermark of the record; the indices of the lease before it are skipped.
+ * A signer of a sub-key keeps the end of its range.
+ */
+xmss_signer *xmss_signer_load_lease(const xmss_params *params,
+                                    const unsigned char *record);
+
+/**
+ * Signs a message, using and advancing the in-memory state.
+ * The output has the same format as xmss[mt]_core_sign, and is identical to
+ * it for the same secret key state.
+ * Returns -2 if all one-time keys (of the sub-key's range) have been used,
+ * and -1 if the lease could not be extended (see xmss_signer_set_lease) or
+ * the state could not be advanced. In the latter case, no signature is
+ * produced and the index is not used up; only if the state is advanced in
+ * the background has the previous signature already been handed out, and
+ * then the advance is tried again on the next call.
+ */
+int xmss_signer_sign(xmss_signer *signer,
+                     unsigned char *sm, unsigned long long *smlen,
+                     const unsigned char *m, unsigned long long mlen);
+
+/**
+ * Enables (or disables) asynchronous mode. In this mode, a background thread
+ * advances the BDS state for the next index (and refills the precomputed
+ * WOTS chains, see below) after xmss_signer_sign has returned a signature.
+ * The next call that needs the state waits for the thread to finish first.
+ * Disabling waits for pending work and stops the thread.
+ * Returns -1 if the thread could not be started, 0 otherwise.
+ */
+int xmss_signer_set_async(xmss_signer *signer, int enable);
+
+/**
+ * Reserves room to precompute the WOTS chains of the next 'leaves' one-time
+ * keys (wots_len * w * n bytes each), or releases it if leaves is 0.
+ * Any chains that were already precomputed are discarded.
+ * Returns -1 if memory could not be allocated, 0 otherwise.
+ */
+int xmss_signer_set_precompute(xmss_signer *signer, unsigned int leaves);
+
+/**
+ * Enables (or disables) smoothing of the signing latency for XMSSMT. Without
+ * it, the signature that completes a tree also computes the WOTS signature on
+ * the root of the next tree (and more than one at higher tree boundaries).
+ * With it, the WOTS chains for those signatures are computed in equal shares
+ * while advancing the state after every signature, for which the signer keeps
+ * d-1 tables of wots_len * w * n bytes. Signatures are unaffected.
+ * This has no effect for XMSS. Returns -1 if memory could not be allocated.
+ */
+int xmss_signer_set_smoothing(xmss_signer *signer, int enable);
+
+/**
+ * Sets the number of threads (including the calling one, or the background
+ * thread in asynchronous mode) that advance the state after a signature.
+ * The (h - k) / 2 treehash updates per signature each compute a leaf; with
+ * more than one thread, these leaves are computed concurrently, as are the
+ * chains of the leaves that are precomputed together. Signatures are
+ * unaffected. 1 disables this; 0 uses the shared pool (see threadpool.h).
+ * Returns -1 if the threads could not be started, 0 otherwise.
+ */
+int xmss_signer_set_threads(xmss_signer *signer, unsigned int threads);
+
+/**
+ * Returns the size of a lease record: the secret key, with the watermark as
+ * its index, followed by the index that the state in it was exported at and
+ * the end of the range of a sub-key (0 for a whole key).
+ */
+unsigned long long xmss_signer_lease_bytes(const xmss_params *params);
+
+/**
+ * Enables lease-ahead persistence (or disables it if persist is NULL or
+ * window is 0). Rather than persisting the state after every signature, the
+ * signer reserves the next 'window' indices at once: whenever it is about to
+ * use an index at or beyond the watermark, it first calls persist with a
+ * lease record whose watermark is that index plus the window. Signatures
+ * within the lease then only use the in-memory state. After a crash, the
+ * signer is restored with xmss_signer_load_lease, and the unused indices of
+ * the last lease are lost.
+ * Returns -1 if memory could not be allocated, 0 otherwise.
+ */
+int xmss_signer_set_lease(xmss_signer *signer, unsigned int window,
+                          xmss_signer_persist_fn persist, void *ctx);
+
+/**
+ * Returns the watermark of the last persisted lease; i.e. the index that a
+ * signer restored from that lease continues at.
+ */
+unsigned long long xmss_signer_watermark(const xmss_signer *signer);
+
+/**
+ * Computes the WOTS chains of the upcoming one-time keys that do not have
+ * them yet. This does not depend on any message, so it can be called ahead
+ * of time (e.g. while idle); a signature for a leaf with precomputed chains
+ * then only copies chain values instead of computing the WOTS signature.
+ */
+void xmss_signer_precompute(xmss_signer *signer);
+
+/**
+ * Writes the current state of the signer to sk (params->sk_bytes, without
+ * OID), in the format used by xmss[mt]_core_sign.
+ */
+void xmss_signer_persist(xmss_signer *signer, unsigned char *sk);
+
+/**
+ * Writes the current state of the signer to sk as persist does, assuming that
+ * sk holds a state that was persisted before, and only writes the bytes that
+ * have changed since. These are reported as up to max (at least 1) ranges,
+ * so that only those parts have to be written to storage; see xmss_sk_diff.
+ * After a signature, these are typically a few hundred bytes.
+ * Returns the number of ranges, or -1 (and leaves sk as it is) if sk already
+ * holds a later index than the signer, i.e. the signer is stale and writing
+ * its state would allow one-time keys to be used again.
+ */
+int xmss_signer_persist_dirty(xmss_signer *signer, unsigned char *sk,
+                              xmss_sk_range *ranges, unsigned int max);
+
+/**
+ * Returns the index of the next one-time key that will be used.
+ */
+unsigned long long xmss_signer_index(const xmss_signer *signer);
+
+/**
+ * Returns the bitmap of the layers whose state the signer has built; bit i
+ * stands for layer i. All d bits are set, unless the signer was loaded with
+ * xmss_signer_load_lazy and has not signed or persisted since.
+ */
+unsigned long long xmss_signer_layers(const xmss_signer *signer);
+
+/**
+ * Erases the in-memory secret key material and releases the signer.
+ */
+void xmss_signer_free(xmss_signer *signer);
+
+#endif
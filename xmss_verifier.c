@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hash.h"
+#include "params.h"
+#include "utils.h"
+#include "xmss_commons.h"
+#include "xmss_verifier.h"
+
+typedef struct {
+    unsigned int layer;
+    unsigned long long tree;
+    /* When the entry was last used; the least recently used one is evicted.
+       0 if the entry is empty. */
+    unsigned long long stamp;
+    unsigned char *root;
+    /* The signature above the tree; i.e. the parts of layers layer+1 .. d-1. */
+    unsigned char *tail;
+} root_entry;
+
+struct xmss_verifier {
+    xmss_params params;
+    unsigned char *pk;
+    unsigned int capacity;
+    root_entry *entries;
+    unsigned char *buffers;
+    unsigned long long clock;
+    unsigned long long layers;
+    unsigned long long skipped;
+};
+
+/* The number of bytes of a signature that belong to a single layer. */
+static unsigned long long layer_bytes(const xmss_params *params)
+{
+    return params->wots_sig_bytes + params->tree_height * params->n;
+}
+
+static root_entry *cache_find(xmss_verifier *verifier,
+                              unsigned int layer, unsigned long long tree)
+{
+    unsigned int i;
+
+    for (i = 0; i < verifier->capacity; i++) {
+        if (verifier->entries[i].stamp != 0 &&
+            verifier->entries[i].layer == layer &&
+            verifier->entries[i].tree == tree) {
+            return &verifier->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Stores the authenticated root of a tree, along with the signature above it.
+ */
+static void cache_insert(xmss_verifier *verifier,
+                         unsigned int layer, unsigned long long tree,
+                         const unsigned char *root, const unsigned char *tail)
+{
+    const xmss_params *params = &verifier->params;
+    root_entry *entry = cache_find(verifier, layer, tree);
+    unsigned int i;
+
+    if (entry == NULL) {
+        entry = &verifier->entries[0];
+        for (i = 1; i < verifier->capacity; i++) {
+            if (verifier->entries[i].stamp < entry->stamp) {
+                entry = &verifier->entries[i];
+            }
+        }
+    }
+    entry->layer = layer;
+    entry->tree = tree;
+    entry->stamp = ++verifier->clock;
+    memcpy(entry->root, root, params->n);
+    memcpy(entry->tail, tail, (params->d - 1 - layer) * layer_bytes(params));
+}
+
+xmss_verifier *xmss_verifier_create(const xmss_params *params,
+                                    const unsigned char *pk,
+                                    unsigned int capacity)
+{
+    const unsigned long long entry_bytes =
+        params->n + (params->d - 1) * layer_bytes(params);
+    xmss_verifier *verifier;
+    unsigned int i;
+
+    verifier = calloc(1, sizeof(xmss_verifier));
+    if (verifier == NULL) {
+        return NULL;
+    }
+    verifier->params = *params;
+    verifier->params.seed_ctx = NULL;
+    /* There is nothing to cache below the top layer of XMSS. */
+    verifier->capacity = params->d > 1 ? capacity : 0;
+    verifier->pk = malloc(params->pk_bytes);
+    verifier->entries = calloc(verifier->capacity + 1, sizeof(root_entry));
+    verifier->buffers = malloc(verifier->capacity * entry_bytes + 1);
+    if (verifier->pk == NULL || verifier->entries == NULL ||
+        verifier->buffers == NULL) {
+        xmss_verifier_free(verifier);
+        return NULL;
+    }
+    memcpy(verifier->pk, pk, params->pk_bytes);
+    /* Without a seed context (other than SHA2 with n = 32 or 64, or out of
+       memory), PUB_SEED is simply hashed along with every key and mask. */
+    verifier->params.seed_ctx = xmss_seed_ctx_create(params, pk + params->n);
+    for (i = 0; i < verifier->capacity; i++) {
+        verifier->entries[i].root = verifier->buffers + i * entry_bytes;
+        verifier->entries[i].tail = verifier->entries[i].root + params->n;
+    }
+    return verifier;
+}
+
+xmss_verifier *xmss_verifier_create_oid(const unsigned char *pk, int xmssmt,
+                                        unsigned int capacity)
+{
+    xmss_params params;
+    uint32_t oid = (uint32_t)bytes_to_ull(pk, XMSS_OID_LEN);
+
+    if (xmssmt ? xmssmt_parse_oid(&params, oid) : xmss_parse_oid(&params, oid)) {
+        return NULL;
+    }
+    return xmss_verifier_create(&params, pk + XMSS_OID_LEN, capacity);
+}
+
+int xmss_verifier_open(xmss_verifier *verifier,
+                       unsigned char *m, unsigned long long *mlen,
+                       const unsigned char *sm, unsigned long long smlen)
+{
+    const xmss_params *params = &verifier->params;
+    const unsigned char *pub_root = verifier->pk;
+    const unsigned char *pub_seed = verifier->pk + params->n;
+    const unsigned char *sig;
+    unsigned char roots[params->d][params->n];
+    unsigned long long trees[params->d];
+    unsigned char mhash[params->n];
+    unsigned long long idx;
+    unsigned int i, j;
+    uint32_t idx_leaf;
+    root_entry *entry = NULL;
+    int valid;
+
+    *mlen = smlen - params->sig_bytes;
+    idx = bytes_to_ull(sm, params->index_bytes);
+
+    /* See xmssmt_core_sign_open. */
+    memcpy(m + params->sig_bytes, sm + params->sig_bytes, *mlen);
+    hash_message(params, mhash, sm + params->index_bytes, verifier->pk, idx,
+                 m + params->sig_bytes - params->padding_len - 3*params->n,
+                 *mlen);
+    sig = sm + params->index_bytes + params->n;
+
+    for (i = 0; i < params->d; i++) {
+        idx_leaf = (idx & ((1 << params->tree_height)-1));
+        idx = idx >> params->tree_height;
+        trees[i] = idx;
+
+        xmss_subtree_root(params, roots[i], sig, i == 0 ? mhash : roots[i-1],
+                          i, idx, idx_leaf, pub_seed);
+        sig += layer_bytes(params);
+        verifier->layers++;
+
+        /* The root of the top tree is the public key. */
+        if (i + 1 == params->d) {
+            break;
+        }
+        /* If this tree was authenticated before, the rest of the signature
+           must match what authenticated it. */
+        entry = cache_find(verifier, i, idx);
+        if (entry != NULL) {
+            break;
+        }
+    }
+
+    if (entry != NULL) {
+        valid = !memcmp(roots[i], entry->root, params->n) &&
+                !memcmp(sig, entry->tail, (params->d - 1 - i) * layer_bytes(params));
+        verifier->skipped += params->d - 1 - i;
+        if (valid) {
+            entry->stamp = ++verifier->clock;
+        }
+    }
+    else {
+        valid = !memcmp(roots[params->d - 1], pub_root, params->n);
+    }
+
+    if (!valid) {
+        memset(m, 0, *mlen);
+        *mlen = 0;
+        return -1;
+    }
+
+    /* All trees below the one that was authenticated are now authenticated
+       as well. */
+    sig = sm + params->index_bytes + params->n;
+    for (j = 0; j < i && j + 1 < params->d && verifier->capacity > 0; j++) {
+        cache_insert(verifier, j, trees[j], roots[j],
+                     sig + (j + 1) * layer_bytes(params));
+    }
+
+    memcpy(m, sm + params->sig_bytes, *mlen);
+    return 0;
+}
+
+void xmss_verifier_stats(const xmss_verifier *verifier,
+                         unsigned long long *layers,
+                         unsigned long long *skipped)
+{
+    *layers = verifier->layers;
+    *skipped = verifier->skipped;
+}
+
+void xmss_verifier_free(xmss_verifier *verifier)
+{
+    if (verifier == NULL) {
+        return;
+    }
+    xmss_seed_ctx_free(verifier->params.seed_ctx);
+    free(verifier->pk);
+    free(verifier->entries);
+    free(verifier->buffers);
+    free(verifier);
+}
+
+/* The number of bytes of a public key (after the OID) that are hashed to
+   find its bucket; all supported keys are at least this long. */
+#define XMSS_VERIFIER_KEY_HASH_BYTES 16
+/* Marks the end of a list of cache entries. */
+#define XMSS_VERIFIER_NONE ((unsigned int)-1)
+
+typedef struct {
+    xmss_verifier *verifier;
+    /* The public key with OID; its length follows from the OID. */
+    unsigned char *pk;
+    unsigned int pklen;
+    /* The next entry in the same bucket. */
+    unsigned int chain;
+    /* The neighbours in the order of use, most recent first. */
+    unsigned int newer;
+    unsigned int older;
+} key_entry;
+
+struct xmss_verifier_cache {
+    int xmssmt;
+    unsigned int capacity;
+    unsigned int keys;
+    unsigned int used;
+    key_entry *entries;
+    unsigned int *buckets;
+    unsigned int mask;
+    unsigned int newest;
+    unsigned int oldest;
+};
+
+static unsigned int key_hash(const unsigned char *pk)
+{
+    uint32_t h = 2166136261u;
+    unsigned int i;
+
+    /* FNV-1a over the OID and the first bytes of the root. */
+    for (i = 0; i < XMSS_OID_LEN + XMSS_VERIFIER_KEY_HASH_BYTES; i++) {
+        h = (h ^ pk[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void lru_unlink(xmss_verifier_cache *cache, unsigned int e)
+{
+    key_entry *entry = &cache->entries[e];
+
+    if (entry->newer != XMSS_VERIFIER_NONE) {
+        cache->entries[entry->newer].older = entry->older;
+    }
+    else {
+        cache->newest = entry->older;
+    }
+    if (entry->older != XMSS_VERIFIER_NONE) {
+        cache->entries[entry->older].newer = entry->newer;
+    }
+    else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void lru_push(xmss_verifier_cache *cache, unsigned int e)
+{
+    key_entry *entry = &cache->entries[e];
+
+    entry->newer = XMSS_VERIFIER_NONE;
+    entry->older = cache->newest;
+    if (cache->newest != XMSS_VERIFIER_NONE) {
+        cache->entries[cache->newest].newer = e;
+    }
+    cache->newest = e;
+    if (cache->oldest == XMSS_VERIFIER_NONE) {
+        cache->oldest = e;
+    }
+}
+
+/**
+ * Removes entry e from its bucket and releases its verifier.
+ */
+static void entry_evict(xmss_verifier_cache *cache, unsigned int e)
+{
+    key_entry *entry = &cache->entries[e];
+    unsigned int *link = &cache->buckets[key_hash(entry->pk) & cache->mask];
+
+    while (*link != e) {
+        link = &cache->entries[*link].chain;
+    }
+    *link = entry->chain;
+    lru_unlink(cache, e);
+    xmss_verifier_free(entry->verifier);
+    free(entry->pk);
+    entry->verifier = NULL;
+    entry->pk = NULL;
+}
+
+xmss_verifier_cache *xmss_verifier_cache_create(int xmssmt, unsigned int keys,
+                                                unsigned int capacity)
+{
+    xmss_verifier_cache *cache;
+    unsigned int buckets = 1;
+    unsigned int i;
+
+    if (keys == 0) {
+        return NULL;
+    }
+    /* At least twice as many buckets as keys, to keep the chains short. */
+    while (buckets < 2 * keys) {
+        buckets <<= 1;
+    }
+    cache = calloc(1, sizeof(xmss_verifier_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->entries = calloc(keys, sizeof(key_entry));
+    cache->buckets = malloc(buckets * sizeof(unsigned int));
+    if (cache->entries == NULL || cache->buckets == NULL) {
+        free(cache->entries);
+        free(cache->buckets);
+        free(cache);
+        return NULL;
+    }
+    for (i = 0; i < buckets; i++) {
+        cache->buckets[i] = XMSS_VERIFIER_NONE;
+    }
+    cache->xmssmt = xmssmt;
+    cache->capacity = capacity;
+    cache->keys = keys;
+    cache->mask = buckets - 1;
+    cache->newest = XMSS_VERIFIER_NONE;
+    cache->oldest = XMSS_VERIFIER_NONE;
+    return cache;
+}
+
+xmss_verifier *xmss_verifier_cache_get(xmss_verifier_cache *cache,
+                                       const unsigned char *pk)
+{
+    unsigned int bucket = key_hash(pk) & cache->mask;
+    unsigned int e;
+    unsigned int pklen;
+    unsigned char *pk_copy;
+    key_entry *entry;
+    xmss_verifier *verifier;
+
+    for (e = cache->buckets[bucket]; e != XMSS_VERIFIER_NONE;
+         e = cache->entries[e].chain) {
+        entry = &cache->entries[e];
+        /* Keys with the same OID have the same length. */
+        if (!memcmp(entry->pk, pk, XMSS_OID_LEN) &&
+            !memcmp(entry->pk, pk, entry->pklen)) {
+            lru_unlink(cache, e);
+            lru_push(cache, e);
+            return entry->verifier;
+        }
+    }
+
+    verifier = xmss_verifier_create_oid(pk, cache->xmssmt, cache->capacity);
+    if (verifier == NULL) {
+        return NULL;
+    }
+    /* Allocate everything before taking an entry, so that a failure leaves
+       the cache as it was. */
+    pklen = XMSS_OID_LEN + verifier->params.pk_bytes;
+    pk_copy = malloc(pklen);
+    if (pk_copy == NULL) {
+        xmss_verifier_free(verifier);
+        return NULL;
+    }
+    memcpy(pk_copy, pk, pklen);
+
+    if (cache->used < cache->keys) {
+        e = cache->used++;
+    }
+    else {
+        e = cache->oldest;
+        entry_evict(cache, e);
+    }
+    entry = &cache->entries[e];
+    entry->pklen = pklen;
+    entry->pk = pk_copy;
+    entry->verifier = verifier;
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = e;
+    lru_push(cache, e);
+    return verifier;
+}
+
+int xmss_verifier_cache_open(xmss_verifier_cache *cache,
+                             unsigned char *m, unsigned long long *mlen,
+                             const unsigned char *sm, unsigned long long smlen,
+                             const unsigned char *pk)
+{
+    xmss_verifier *verifier = xmss_verifier_cache_get(cache, pk);
+
+    if (verifier == NULL) {
+        *mlen = 0;
+        return -1;
+    }
+    return xmss_verifier_open(verifier, m, mlen, sm, smlen);
+}
+
+void xmss_verifier_cache_free(xmss_verifier_cache *cache)
+{
+    unsigned int e;
+
+    if (cache == NULL) {
+        return;
+    }
+    for (e = 0; e < cache->used; e++) {
+        xmss_verifier_free(cache->entries[e].verifier);
+        free(cache->entries[e].pk);
+    }
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache);
+}
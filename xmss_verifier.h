@@ -0,0 +1,99 @@
+#ifndef XMSS_VERIFIER_H
+#define XMSS_VERIFIER_H
+
+#include "params.h"
+
+/* A verifier checks signatures under a single XMSSMT public key, and keeps a
+   bounded cache of subtree roots that it has already authenticated. The part
+   of a signature above a layer-i tree is the same for all signatures by
+   leaves of that tree; once a signature by such a leaf has been verified up
+   to the public key, the next ones only need to be verified up to the root of
+   that tree (which they must reproduce exactly, along with the rest of the
+   signature above it). For a stream of signatures by consecutive indices,
+   this verifies about one layer per signature rather than d.
+
+   A verifier is not thread-safe; use one per thread. It also keeps the hash
+   state of PUB_SEED (see xmss_seed_ctx), so that nothing that can be derived
+   from the public key is recomputed per signature. */
+
+typedef struct xmss_verifier xmss_verifier;
+
+/**
+ * Creates a verifier for the public key pk (without OID, i.e.
+ * [root || PUB_SEED]) that caches up to 'capacity' subtree roots.
+ * Each entry takes about (d - 1) * (wots_sig_bytes + tree_height * n) bytes.
+ * Returns NULL if memory could not be allocated.
+ */
+xmss_verifier *xmss_verifier_create(const xmss_params *params,
+                                    const unsigned char *pk,
+                                    unsigned int capacity);
+
+/**
+ * Creates a verifier for a public key with OID, as produced by xmss_keypair,
+ * or by xmssmt_keypair if xmssmt is set. The OID is only parsed here.
+ * Returns NULL if the OID is unknown or memory could not be allocated.
+ */
+xmss_verifier *xmss_verifier_create_oid(const unsigned char *pk, int xmssmt,
+                                        unsigned int capacity);
+
+/**
+ * Verifies a signed message as xmssmt_core_sign_open does, with the same
+ * result, using and updating the cache.
+ */
+int xmss_verifier_open(xmss_verifier *verifier,
+                       unsigned char *m, unsigned long long *mlen,
+                       const unsigned char *sm, unsigned long long smlen);
+
+/**
+ * Returns the number of layers that have been verified, and the number that
+ * were skipped because of cached roots, since the verifier was created.
+ */
+void xmss_verifier_stats(const xmss_verifier *verifier,
+                         unsigned long long *layers,
+                         unsigned long long *skipped);
+
+/**
+ * Releases the verifier.
+ */
+void xmss_verifier_free(xmss_verifier *verifier);
+
+/* A verifier cache keeps the verifiers of the most recently used public keys,
+   for services that verify signatures by many signers. Looking up the
+   verifier of a known key hashes and compares the key, but does not parse
+   it or set up anything else. Like a verifier, it is not thread-safe. */
+
+typedef struct xmss_verifier_cache xmss_verifier_cache;
+
+/**
+ * Creates a cache of up to 'keys' verifiers for XMSS public keys (or XMSSMT
+ * public keys if xmssmt is set), each of which caches up to 'capacity'
+ * subtree roots. Returns NULL if memory could not be allocated.
+ */
+xmss_verifier_cache *xmss_verifier_cache_create(int xmssmt, unsigned int keys,
+                                                unsigned int capacity);
+
+/**
+ * Returns the verifier for the public key pk (with OID), creating it (and
+ * evicting the least recently used one) if it is not in the cache. The
+ * verifier remains valid until it is evicted by a later call.
+ * Returns NULL if the OID is unknown or memory could not be allocated.
+ */
+xmss_verifier *xmss_verifier_cache_get(xmss_verifier_cache *cache,
+                                       const unsigned char *pk);
+
+/**
+ * Verifies a signed message under the public key pk (with OID), using the
+ * cached verifier of pk. Returns -1 if the signature is invalid or the key
+ * is not supported, 0 otherwise.
+ */
+int xmss_verifier_cache_open(xmss_verifier_cache *cache,
+                             unsigned char *m, unsigned long long *mlen,
+                             const unsigned char *sm, unsigned long long smlen,
+                             const unsigned char *pk);
+
+/**
+ * Releases the cache and all of its verifiers.
+ */
+void xmss_verifier_cache_free(xmss_verifier_cache *cache);
+
+#endif